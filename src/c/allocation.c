@@ -0,0 +1,163 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Bytes allocated by the current thread (JVM:allocated-bytes).
+ *
+ * Neither JNI nor JVMTI offer this counter, hence we call the same method
+ * that ThreadMXBean uses: com.sun.management.ThreadMXBean is resolved when
+ * the first event set with the event is created and the snapshot then only
+ * makes a single JNI call to getCurrentThreadAllocatedBytes (JDK 14 and
+ * newer, older JDKs would need Thread.currentThread() which may allocate
+ * and the event is thus not supported there).
+ *
+ * The call costs hundreds of nanoseconds, therefore the counter is read as
+ * the first thing in a start snapshot and as the last thing in a stop
+ * snapshot so that the call falls outside of the other measured events.
+ */
+
+#include "compiler.h"
+#include "logging.h"
+#include "mylock.h"
+#include "ubench.h"
+
+#pragma warning(push, 0)
+#include <assert.h>
+#include <stdbool.h>
+
+#include <jni.h>
+#pragma warning(pop)
+
+static JavaVM* allocation_jvm = NULL;
+
+static ubench_spinlock_t allocation_prepare_lock = UBENCH_SPINLOCK_INITIALIZER;
+static volatile bool allocation_prepared = false;
+
+static jobject allocation_bean = NULL;
+static jmethodID allocation_get_current = NULL;
+
+INTERNAL bool
+ubench_allocation_init(JavaVM* jvm) {
+	assert(jvm != NULL);
+	allocation_jvm = jvm;
+	return true;
+}
+
+static bool
+clear_exception(JNIEnv* jni) {
+	if ((*jni)->ExceptionCheck(jni)) {
+		(*jni)->ExceptionClear(jni);
+		return true;
+	}
+	return false;
+}
+
+static bool
+resolve_bean(JNIEnv* jni) {
+	jclass factory_class = (*jni)->FindClass(jni, "java/lang/management/ManagementFactory");
+	if (clear_exception(jni) || (factory_class == NULL)) {
+		return false;
+	}
+
+	jmethodID get_bean = (*jni)->GetStaticMethodID(jni, factory_class, "getThreadMXBean", "()Ljava/lang/management/ThreadMXBean;");
+	if (clear_exception(jni) || (get_bean == NULL)) {
+		return false;
+	}
+
+	jobject bean = (*jni)->CallStaticObjectMethod(jni, factory_class, get_bean);
+	if (clear_exception(jni) || (bean == NULL)) {
+		return false;
+	}
+
+	// Allocated bytes are only available through the HotSpot extension.
+	jclass bean_class = (*jni)->FindClass(jni, "com/sun/management/ThreadMXBean");
+	if (clear_exception(jni) || (bean_class == NULL) || !(*jni)->IsInstanceOf(jni, bean, bean_class)) {
+		return false;
+	}
+
+	jmethodID is_supported = (*jni)->GetMethodID(jni, bean_class, "isThreadAllocatedMemorySupported", "()Z");
+	jmethodID is_enabled = (*jni)->GetMethodID(jni, bean_class, "isThreadAllocatedMemoryEnabled", "()Z");
+	jmethodID set_enabled = (*jni)->GetMethodID(jni, bean_class, "setThreadAllocatedMemoryEnabled", "(Z)V");
+	if (clear_exception(jni) || (is_supported == NULL) || (is_enabled == NULL) || (set_enabled == NULL)) {
+		return false;
+	}
+
+	if (!(*jni)->CallBooleanMethod(jni, bean, is_supported)) {
+		clear_exception(jni);
+		return false;
+	}
+	if (!(*jni)->CallBooleanMethod(jni, bean, is_enabled)) {
+		(*jni)->CallVoidMethod(jni, bean, set_enabled, JNI_TRUE);
+	}
+	if (clear_exception(jni)) {
+		return false;
+	}
+
+	allocation_get_current = (*jni)->GetMethodID(jni, bean_class, "getCurrentThreadAllocatedBytes", "()J");
+	if (clear_exception(jni) || (allocation_get_current == NULL)) {
+		allocation_get_current = NULL;
+		return false;
+	}
+
+	allocation_bean = (*jni)->NewGlobalRef(jni, bean);
+	return allocation_bean != NULL;
+}
+
+/*
+ * Prepares reading of the allocation counter, called when creating an event
+ * set with JVM:allocated-bytes.
+ */
+INTERNAL bool
+ubench_allocation_prepare(JNIEnv* jni) {
+	if (allocation_prepared) {
+		return allocation_bean != NULL;
+	}
+
+	ubench_spinlock_lock(&allocation_prepare_lock);
+	if (!allocation_prepared) {
+		if (!resolve_bean(jni)) {
+			DEBUG_PRINTF("thread allocated bytes are not available.");
+		}
+		allocation_prepared = true;
+	}
+	ubench_spinlock_unlock(&allocation_prepare_lock);
+
+	return allocation_bean != NULL;
+}
+
+/*
+ * Returns number of bytes allocated by the current thread (-1 on error).
+ *
+ * Calls into the JVM, thus it must not be used from critical downcalls.
+ */
+INTERNAL int64_t
+ubench_allocation_get_current_thread_bytes(void) {
+	if ((allocation_jvm == NULL) || (allocation_bean == NULL)) {
+		return -1;
+	}
+
+	JNIEnv* jni;
+	if ((*allocation_jvm)->GetEnv(allocation_jvm, (void**) &jni, JNI_VERSION_1_8) != JNI_OK) {
+		return -1;
+	}
+
+	jlong result = (*jni)->CallLongMethod(jni, allocation_bean, allocation_get_current);
+	if (clear_exception(jni)) {
+		return -1;
+	}
+
+	return (int64_t) result;
+}
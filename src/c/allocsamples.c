@@ -0,0 +1,306 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Sampled allocations (see AllocationSampler and JVM:alloc-samples).
+ *
+ * When enabled, JVMTI reports roughly one allocation per sampling interval
+ * (in bytes) through SampledObjectAlloc. The callback runs in the
+ * allocating thread, so the samples are stored into a ring of that thread
+ * (see ring.h). The ring is released when the thread ends and reused by
+ * a thread started later, hence samples of ended threads are available
+ * only until then.
+ *
+ * The number of samples taken by a thread is also available as the
+ * JVM:alloc-samples event. The event also stores a wall clock timestamp,
+ * so that the samples can be matched with the measurements of an event set
+ * (see Measurement.getAllocationSamples).
+ */
+
+#include "compiler.h"
+#include "jvmutil.h"
+#include "logging.h"
+#include "ring.h"
+#include "strutil.h"
+#include "ubench.h"
+
+#pragma warning(push, 0)
+/* Ensure compatibility of JNI function types. */
+#include "cz_cuni_mff_d3s_perf_AllocationSampler.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <jni.h>
+#include <jvmti.h>
+#pragma warning(pop)
+
+#define SAMPLES_RING_SIZE 1024
+#define SAMPLE_CLASS_NAME_SIZE 108
+
+typedef struct {
+	int64_t timestamp;
+	int64_t size;
+	// Not the id of the ring as virtual threads share their carrier's ring.
+	int32_t thread_id;
+	char class_name[SAMPLE_CLASS_NAME_SIZE];
+} alloc_sample_t;
+
+static ubench_ring_list_t all_rings = UBENCH_RING_LIST_INITIALIZER(SAMPLES_RING_SIZE, alloc_sample_t);
+static THREAD_LOCAL ubench_ring_t* current_ring = NULL;
+
+static void JNICALL
+jvmti_callback_on_sampled_object_alloc(
+	jvmtiEnv* jvmti, JNIEnv* UNUSED_PARAMETER(jni), jthread UNUSED_PARAMETER(thread),
+	jobject UNUSED_PARAMETER(object), jclass object_class, jlong size
+) {
+	if (current_ring == NULL) {
+		current_ring = ubench_ring_acquire(&all_rings, ubench_measure_get_thread_id());
+		if (current_ring == NULL) {
+			return;
+		}
+	}
+
+	alloc_sample_t* entry = ubench_ring_next_entry(&all_rings, current_ring);
+	entry->timestamp = ubench_measure_get_wallclock();
+	entry->size = (int64_t) size;
+	entry->thread_id = ubench_measure_get_thread_id();
+	entry->class_name[0] = 0;
+
+	char* signature = NULL;
+	if ((*jvmti)->GetClassSignature(jvmti, object_class, &signature, NULL) == JVMTI_ERROR_NONE) {
+		ubench_str_append_class_name(entry->class_name, SAMPLE_CLASS_NAME_SIZE, signature);
+	}
+	(*jvmti)->Deallocate(jvmti, (unsigned char*) signature);
+
+	ubench_ring_publish(current_ring);
+}
+
+static void JNICALL
+jvmti_callback_on_thread_end(
+	jvmtiEnv* UNUSED_PARAMETER(jvmti), JNIEnv* UNUSED_PARAMETER(jni), jthread UNUSED_PARAMETER(thread)
+) {
+	if (current_ring != NULL) {
+		ubench_ring_release(&all_rings, current_ring);
+		current_ring = NULL;
+	}
+}
+
+static jvmti_context_t samples_context = {
+	.has_capabilities = true,
+	.capabilities = {
+		.can_generate_sampled_object_alloc_events = 1,
+	},
+	.callbacks = {
+		.SampledObjectAlloc = &jvmti_callback_on_sampled_object_alloc,
+		.ThreadEnd = &jvmti_callback_on_thread_end,
+	},
+	// Sampling itself is enabled only on request.
+	.events = {
+		JVMTI_EVENT_THREAD_END,
+		0
+	}
+};
+
+static bool samples_available = false;
+
+INTERNAL bool
+ubench_alloc_samples_init(JavaVM* jvm) {
+	assert(jvm != NULL);
+	samples_available = ubench_jvmti_context_init_and_enable(&samples_context, jvm);
+	return samples_available;
+}
+
+/*
+ * Returns number of allocation samples taken in the current thread.
+ */
+INTERNAL int64_t
+ubench_alloc_samples_get_current_thread_count(void) {
+	ubench_ring_t* ring = current_ring;
+	return (ring == NULL) ? 0 : (int64_t) ring->head;
+}
+
+static int
+compare_intervals(const void* a, const void* b) {
+	const ubench_interval_t* first = a;
+	const ubench_interval_t* second = b;
+
+	if (first->thread != second->thread) {
+		return (first->thread < second->thread) ? -1 : 1;
+	}
+	if (first->start != second->start) {
+		return (first->start < second->start) ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+ * Finds the interval (sorted by thread and start) containing the sample
+ * and returns its index (or -1).
+ */
+static int64_t
+find_interval(const ubench_interval_t* intervals, size_t count, const alloc_sample_t* sample) {
+	// Last interval of the thread that started before the sample.
+	size_t low = 0;
+	size_t high = count;
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		const ubench_interval_t* interval = &intervals[middle];
+		if ((interval->thread < sample->thread_id)
+			|| ((interval->thread == sample->thread_id) && (interval->start <= sample->timestamp))) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	if (low == 0) {
+		return -1;
+	}
+
+	const ubench_interval_t* candidate = &intervals[low - 1];
+	if ((candidate->thread == sample->thread_id) && (sample->timestamp <= candidate->end)) {
+		return candidate->index;
+	}
+	return -1;
+}
+
+/*
+ * Creates List<AllocationSample> with the recorded samples (or returns NULL
+ * when out of memory). When intervals are given, only samples of the given
+ * threads taken during them are kept (the intervals are sorted in place).
+ */
+INTERNAL jobject
+ubench_alloc_samples_export(JNIEnv* jni, ubench_interval_t* intervals, size_t interval_count) {
+	jclass array_list_class = (*jni)->FindClass(jni, "java/util/ArrayList");
+	if (array_list_class == NULL) {
+		return NULL;
+	}
+	jmethodID list_constructor = (*jni)->GetMethodID(jni, array_list_class, "<init>", "()V");
+	if (list_constructor == NULL) {
+		return NULL;
+	}
+	jmethodID add_method = (*jni)->GetMethodID(jni, array_list_class, "add", "(Ljava/lang/Object;)Z");
+	if (add_method == NULL) {
+		return NULL;
+	}
+	jclass sample_class = (*jni)->FindClass(jni, "cz/cuni/mff/d3s/perf/AllocationSample");
+	if (sample_class == NULL) {
+		return NULL;
+	}
+	jmethodID sample_constructor = (*jni)->GetMethodID(jni, sample_class, "<init>", "(Ljava/lang/String;JIJI)V");
+	if (sample_constructor == NULL) {
+		return NULL;
+	}
+
+	jobject jsamples = (*jni)->NewObject(jni, array_list_class, list_constructor);
+	if (jsamples == NULL) {
+		return NULL;
+	}
+
+	int* thread_ids;
+	size_t count;
+	alloc_sample_t* samples = ubench_ring_list_copy(&all_rings, &thread_ids, &count);
+	if (samples == NULL) {
+		return NULL;
+	}
+	free(thread_ids);
+
+	if (intervals != NULL) {
+		qsort(intervals, interval_count, sizeof(ubench_interval_t), compare_intervals);
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		int64_t measurement = -1;
+		if (intervals != NULL) {
+			measurement = find_interval(intervals, interval_count, &samples[i]);
+			if (measurement < 0) {
+				continue;
+			}
+		}
+
+		jstring jclass_name = (*jni)->NewStringUTF(jni, samples[i].class_name);
+		jobject jsample = (*jni)->NewObject(
+			jni, sample_class, sample_constructor,
+			jclass_name, (jlong) samples[i].size, (jint) samples[i].thread_id,
+			(jlong) samples[i].timestamp, (jint) measurement
+		);
+		if (jsample == NULL) {
+			free(samples);
+			return NULL;
+		}
+		(*jni)->CallBooleanMethod(jni, jsamples, add_method, jsample);
+
+		// There could be many samples.
+		(*jni)->DeleteLocalRef(jni, jsample);
+		(*jni)->DeleteLocalRef(jni, jclass_name);
+	}
+
+	free(samples);
+
+	return jsamples;
+}
+
+//
+
+JNIEXPORT jboolean JNICALL
+Java_cz_cuni_mff_d3s_perf_AllocationSampler_nativeEnable(
+	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(sampler_class), jint jinterval
+) {
+	if (!samples_available) {
+		return JNI_FALSE;
+	}
+
+	jvmtiEnv* jvmti = samples_context.jvmti;
+	jvmtiError err = (*jvmti)->SetHeapSamplingInterval(jvmti, jinterval);
+	if (err != JVMTI_ERROR_NONE) {
+		DEBUG_PRINTF("failed to set heap sampling interval (error %ld).", (long) err);
+		return JNI_FALSE;
+	}
+
+	err = (*jvmti)->SetEventNotificationMode(jvmti, JVMTI_ENABLE, JVMTI_EVENT_SAMPLED_OBJECT_ALLOC, NULL);
+	if (err != JVMTI_ERROR_NONE) {
+		DEBUG_PRINTF("failed to enable allocation sampling (error %ld).", (long) err);
+		return JNI_FALSE;
+	}
+
+	return JNI_TRUE;
+}
+
+JNIEXPORT void JNICALL
+Java_cz_cuni_mff_d3s_perf_AllocationSampler_disable(
+	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(sampler_class)
+) {
+	if (!samples_available) {
+		return;
+	}
+
+	jvmtiEnv* jvmti = samples_context.jvmti;
+	(*jvmti)->SetEventNotificationMode(jvmti, JVMTI_DISABLE, JVMTI_EVENT_SAMPLED_OBJECT_ALLOC, NULL);
+}
+
+JNIEXPORT void JNICALL
+Java_cz_cuni_mff_d3s_perf_AllocationSampler_clear(
+	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(sampler_class)
+) {
+	ubench_ring_list_clear(&all_rings);
+}
+
+JNIEXPORT jobject JNICALL
+Java_cz_cuni_mff_d3s_perf_AllocationSampler_getSamples(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(sampler_class)
+) {
+	return ubench_alloc_samples_export(jni, NULL, 0);
+}
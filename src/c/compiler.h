@@ -49,6 +49,27 @@
 
 #define UNUSED_VARIABLE(name) (void) name
 
+/*
+ * Thread-local storage class.
+ */
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/*
+ * Alignment to a cache line, used to keep data written by different
+ * threads apart (i.e. to prevent false sharing).
+ */
+#define CACHE_LINE_SIZE 64
+
+#ifdef _MSC_VER
+#define CACHE_ALIGNED __declspec(align(64))
+#else
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE_SIZE)))
+#endif
+
 /*
  * Macros to prevent 'condition expression is constant' warning in wrappers
  * around multi-statement macros (the do { ... } while (0) construct).
@@ -18,6 +18,7 @@
 #include "compiler.h"
 #include "jvmutil.h"
 #include "myatomic.h"
+#include "mylock.h"
 #include "ubench.h"
 
 #pragma warning(push, 0)
@@ -33,29 +34,83 @@
 #pragma warning(pop)
 
 
-ubench_atomic_int_t counter_compilation = { 0 };
-ubench_atomic_int_t counter_compilation_total = { 0 };
+/*
+ * Compilations are counted in striped counters: each compiler thread gets
+ * its own cache line (threads beyond COMPILATION_STRIPES share them), the
+ * stripes are summed when a snapshot is taken.
+ */
+#define COMPILATION_STRIPES 16
+
+typedef struct CACHE_ALIGNED {
+	ubench_atomic_int_t count;
+} compilation_stripe_t;
+
+static compilation_stripe_t compilation_stripes[COMPILATION_STRIPES];
+static ubench_atomic_int_t compilation_stripe_next = { 0 };
+static THREAD_LOCAL int current_compilation_stripe = -1;
+
+/* Total at last call of CompilationCounter.getCompilationCountAndReset. */
+static int compilation_total_at_reset = 0;
+static ubench_spinlock_t compilation_reset_lock = UBENCH_SPINLOCK_INITIALIZER;
+
 ubench_atomic_int_t counter_gc_total = { 0 };
+ubench_atomic_int64_t counter_gc_pause_time = { 0 };
+
+INTERNAL int
+ubench_counters_get_compilation_total(void) {
+	int total = 0;
+	for (int i = 0; i < COMPILATION_STRIPES; i++) {
+		total += ubench_atomic_int_get(&compilation_stripes[i].count);
+	}
+	return total;
+}
+
+/*
+ * Collections reported by JVMTI never overlap (the VM is stopped between
+ * GarbageCollectionStart and GarbageCollectionFinish), a single start
+ * timestamp is thus enough.
+ */
+static int64_t gc_start_timestamp = -1;
 
 static void JNICALL
 jvmti_callback_on_compiled_method_load(
-	jvmtiEnv* UNUSED_PARAMETER(jvmti), jmethodID UNUSED_PARAMETER(method),
-	jint UNUSED_PARAMETER(code_size), const void* UNUSED_PARAMETER(code_addr),
+	jvmtiEnv* UNUSED_PARAMETER(jvmti), jmethodID method,
+	jint code_size, const void* code_addr,
 	jint UNUSED_PARAMETER(map_length), const jvmtiAddrLocationMap* UNUSED_PARAMETER(map),
-	const void* UNUSED_PARAMETER(compile_info)
+	const void* compile_info
 ) {
-	/*
-	 * Currently, we do not record any information about the
-	 * method that was just compiled.
-	 *
-	 * We increment the counter only.
-	 */
-	ubench_atomic_int_inc(&counter_compilation);
-	ubench_atomic_int_inc(&counter_compilation_total);
+	if (current_compilation_stripe < 0) {
+		current_compilation_stripe = ubench_atomic_int_inc(&compilation_stripe_next) % COMPILATION_STRIPES;
+	}
+	ubench_atomic_int_inc(&compilation_stripes[current_compilation_stripe].count);
+
+	// Details are recorded only when the journal is enabled.
+	ubench_journal_record_load(method, code_size, code_addr, compile_info);
+}
+
+static void JNICALL
+jvmti_callback_on_compiled_method_unload(
+	jvmtiEnv* UNUSED_PARAMETER(jvmti), jmethodID method, const void* code_addr
+) {
+	ubench_journal_record_unload(method, code_addr);
+}
+
+static void JNICALL
+jvmti_callback_on_garbage_collection_start(jvmtiEnv* UNUSED_PARAMETER(jvmti)) {
+	gc_start_timestamp = ubench_measure_get_wallclock();
 }
 
 static void JNICALL
 jvmti_callback_on_garbage_collection_finish(jvmtiEnv* UNUSED_PARAMETER(jvmti)) {
+	// Agent might have been attached in the middle of a collection.
+	if (gc_start_timestamp >= 0) {
+		int64_t pause = ubench_measure_get_wallclock() - gc_start_timestamp;
+		ubench_atomic_int64_add(&counter_gc_pause_time, pause);
+		gc_start_timestamp = -1;
+	}
+
+	// Pause time is updated first so that reader seeing the new count sees
+	// the pause of that collection as well.
 	ubench_atomic_int_inc(&counter_gc_total);
 }
 
@@ -67,9 +122,17 @@ static jvmti_context_t counters_context = {
 	},
 	.callbacks = {
 		.CompiledMethodLoad = &jvmti_callback_on_compiled_method_load,
+		.CompiledMethodUnload = &jvmti_callback_on_compiled_method_unload,
+		.GarbageCollectionStart = &jvmti_callback_on_garbage_collection_start,
 		.GarbageCollectionFinish = &jvmti_callback_on_garbage_collection_finish,
 	},
-	.events = { JVMTI_EVENT_COMPILED_METHOD_LOAD, JVMTI_EVENT_GARBAGE_COLLECTION_FINISH, 0 }
+	.events = {
+		JVMTI_EVENT_COMPILED_METHOD_LOAD,
+		JVMTI_EVENT_COMPILED_METHOD_UNLOAD,
+		JVMTI_EVENT_GARBAGE_COLLECTION_START,
+		JVMTI_EVENT_GARBAGE_COLLECTION_FINISH,
+		0
+	}
 };
 
 //
@@ -77,7 +140,13 @@ static jvmti_context_t counters_context = {
 INTERNAL bool
 ubench_counters_init(JavaVM* jvm) {
 	assert(jvm != NULL);
-	return ubench_jvmti_context_init_and_enable(&counters_context, jvm);
+	if (!ubench_jvmti_context_init_and_enable(&counters_context, jvm)) {
+		return false;
+	}
+
+	// The journal resolves method names through the same environment.
+	ubench_journal_init(counters_context.jvmti);
+	return true;
 }
 
 //
@@ -86,5 +155,11 @@ JNIEXPORT jint JNICALL
 Java_cz_cuni_mff_d3s_perf_CompilationCounter_getCompilationCountAndReset(
 	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(counter_class)
 ) {
-	return ubench_atomic_int_reset(&counter_compilation);
+	ubench_spinlock_lock(&compilation_reset_lock);
+	int total = ubench_counters_get_compilation_total();
+	int result = total - compilation_total_at_reset;
+	compilation_total_at_reset = total;
+	ubench_spinlock_unlock(&compilation_reset_lock);
+
+	return result;
 }
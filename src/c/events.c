@@ -20,10 +20,15 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include "compiler.h"
+#include "logging.h"
 #include "strutil.h"
 #include "myatomic.h"
 #include "ubench.h"
 
+#pragma warning(push, 0)
+#include <assert.h>
+#pragma warning(pop)
+
 #ifdef HAS_QUERY_PERFORMANCE_COUNTER
 #pragma warning(push, 0)
 #include <windows.h>
@@ -40,10 +45,27 @@
 #include <sys/types.h>
 #endif
 
+#ifdef HAS_PERF_EVENTS
+#include <stdio.h>
+
+#include <linux/perf_event.h>
+#endif
+
 #ifdef HAS_QUERY_PERFORMANCE_COUNTER
 static LARGE_INTEGER windows_timer_frequency;
 #endif
 
+#ifdef HAS_TSC
+/*
+ * TSC ticks per second, zero when TSC cannot be used for time measurement
+ * (no invariant TSC or calibration failed).
+ */
+static uint64_t tsc_frequency = 0;
+
+/* How long to calibrate TSC against the system clock. */
+#define TSC_CALIBRATION_MS 10
+#endif
+
 typedef int (*resolve_event_func_t)(const char*, ubench_event_info_t*);
 typedef int (*event_lister_func_t)(event_info_iterator_callback_t, void*);
 
@@ -55,187 +77,426 @@ typedef struct {
 	unsigned int backend;
 	event_getter_raw_func_t getter_raw;
 	event_getter_func_t getter;
+	event_getter_column_func_t getter_column;
 } known_event_t;
 
-#define TIMESPEC_TO_NANOS(val) ((val).tv_sec * 1000 * 1000 * 1000 + (val).tv_nsec)
-#define TIMEVAL_TO_MICROS(val) ((val).tv_sec * 1000 * 1000 + (val).tv_usec)
+#ifdef HAS_TSC
+/*
+ * Determines TSC frequency by comparing it with the system monotonic
+ * clock over a short sleep. Done once at startup so that the snapshots
+ * only store the raw counter value.
+ */
+static uint64_t
+calibrate_tsc(void) {
+	if (!ubench_tsc_is_invariant()) {
+		WARN_PRINTF("CPU lacks invariant TSC, SYS:tsc event will not be available.");
+		return 0;
+	}
+
+#ifdef HAS_TIMESPEC
+	struct timespec clock_start, clock_end;
+	struct timespec delay = { 0, TSC_CALIBRATION_MS * 1000 * 1000 };
+
+	clock_gettime(CLOCK_MONOTONIC, &clock_start);
+	uint64_t tsc_start = ubench_tsc_read();
+	nanosleep(&delay, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &clock_end);
+	uint64_t tsc_end = ubench_tsc_read();
+
+	long long elapsed_ns = (clock_end.tv_sec - clock_start.tv_sec) * 1000LL * 1000 * 1000
+		+ (clock_end.tv_nsec - clock_start.tv_nsec);
+#elif defined(HAS_QUERY_PERFORMANCE_COUNTER)
+	LARGE_INTEGER clock_start, clock_end;
+
+	QueryPerformanceCounter(&clock_start);
+	uint64_t tsc_start = ubench_tsc_read();
+	Sleep(TSC_CALIBRATION_MS);
+	QueryPerformanceCounter(&clock_end);
+	uint64_t tsc_end = ubench_tsc_read();
+
+	if (windows_timer_frequency.QuadPart == 0) {
+		return 0;
+	}
+	long long elapsed_ns = (clock_end.QuadPart - clock_start.QuadPart) * 1000 * 1000 * 1000
+		/ windows_timer_frequency.QuadPart;
+#else
+	long long elapsed_ns = 0;
+	uint64_t tsc_start = 0;
+	uint64_t tsc_end = 0;
+#endif
+
+	if ((elapsed_ns <= 0) || (tsc_end <= tsc_start)) {
+		WARN_PRINTF("failed to calibrate TSC, SYS:tsc event will not be available.");
+		return 0;
+	}
+
+	uint64_t frequency = (uint64_t) ((double) (tsc_end - tsc_start) * 1e9 / (double) elapsed_ns);
+	DEBUG_PRINTF("TSC frequency is %" PRIu64 " Hz.", frequency);
+
+	return frequency;
+}
+
+static inline long long
+tsc_ticks_to_ns(uint64_t ticks) {
+	// Split the computation to avoid overflow for large absolute values.
+	uint64_t seconds = ticks / tsc_frequency;
+	uint64_t remainder = ticks % tsc_frequency;
+	return (long long) (seconds * 1000 * 1000 * 1000 + remainder * 1000 * 1000 * 1000 / tsc_frequency);
+}
+#endif
 
 INTERNAL bool
 ubench_event_init(void) {
+	ubench_kernels_init();
 #ifdef HAS_QUERY_PERFORMANCE_COUNTER
 	QueryPerformanceFrequency(&windows_timer_frequency);
+#endif
+#ifdef HAS_TSC
+	tsc_frequency = calibrate_tsc();
 #endif
 	return true;
 }
 
-#ifdef HAS_TIMESPEC
+/*
+ * Converts the units of the system wall clock (see read_wallclock() in
+ * measure.c) to nanoseconds.
+ */
 static inline long long
-timespec_diff_ns(const struct timespec* a, const struct timespec* b) {
-	long long sec_diff = b->tv_sec - a->tv_sec;
-	long long nanosec_diff = b->tv_nsec - a->tv_nsec;
-	return sec_diff * 1000 * 1000 * 1000 + nanosec_diff;
-}
-#endif
-
-static long long
-timestamp_diff_ns(const timestamp_t* a, const timestamp_t* b) {
-#ifdef HAS_TIMESPEC
-	return timespec_diff_ns(a, b);
-#elif defined(HAS_QUERY_PERFORMANCE_COUNTER)
+wallclock_ticks_to_ns(long long ticks) {
+#ifdef HAS_QUERY_PERFORMANCE_COUNTER
 	if (windows_timer_frequency.QuadPart == 0) {
 		return -1;
 	}
-	return (b->QuadPart - a->QuadPart) * 1000 * 1000 * 1000 / windows_timer_frequency.QuadPart;
+	return ticks * 1000 * 1000 * 1000 / windows_timer_frequency.QuadPart;
 #else
-	return *b - *a;
+	return ticks;
 #endif
 }
 
+/*
+ * Wall clock getters serve both SYS:wallclock-time and SYS:tsc. The latter
+ * keeps raw TSC ticks in the snapshot and they are converted here.
+ */
 static long long
 getter_wall_clock_time(
-	const ubench_events_snapshot_t* start, const ubench_events_snapshot_t* end,
-	const ubench_event_info_t* UNUSED_PARAMETER(info)
+	const ubench_snapshot_slot_t* start, const ubench_snapshot_slot_t* end,
+	const ubench_event_info_t* info
 ) {
-	return timestamp_diff_ns(&start->timestamp, &end->timestamp);
+	ubench_snapshot_slot_t diff = end[info->slot] - start[info->slot];
+#ifdef HAS_TSC
+	if (info->backend == UBENCH_EVENT_BACKEND_SYS_TSC) {
+		return tsc_ticks_to_ns((uint64_t) diff);
+	}
+#endif
+
+	return wallclock_ticks_to_ns(diff);
 }
 
 static long long
 getter_raw_wall_clock_time(
-	const ubench_events_snapshot_t* value, const ubench_event_info_t* UNUSED_PARAMETER(info)
+	const ubench_snapshot_slot_t* value, const ubench_event_info_t* info
 ) {
-#ifdef HAS_TIMESPEC
-	return TIMESPEC_TO_NANOS(value->timestamp);
-#elif defined(HAS_QUERY_PERFORMANCE_COUNTER)
-	if (windows_timer_frequency.QuadPart == 0) {
-		return -1;
+#ifdef HAS_TSC
+	if (info->backend == UBENCH_EVENT_BACKEND_SYS_TSC) {
+		return tsc_ticks_to_ns((uint64_t) value[info->slot]);
 	}
-	return value->timestamp.QuadPart * 1000 * 1000 * 1000 / windows_timer_frequency.QuadPart;
-#else
-	return value->timestamp;
 #endif
+
+	return wallclock_ticks_to_ns(value[info->slot]);
 }
 
+static long long
+getter_thread_time(
+	const ubench_snapshot_slot_t* start, const ubench_snapshot_slot_t* end,
+	const ubench_event_info_t* info
+) {
 #ifdef HAS_GET_THREAD_TIMES
+	// Stored in 100ns units, reported with microsecond precision.
+	return (end[info->slot] - start[info->slot]) / 10 * 1000;
+#else
+	return end[info->slot] - start[info->slot];
+#endif
+}
+
 static long long
-filetime_diff_us(const FILETIME* a, const FILETIME* b) {
-	long long result = ((LARGE_INTEGER*) b)->QuadPart - ((LARGE_INTEGER*) a)->QuadPart;
-	return result / 10;
+getter_raw_thread_time(
+	const ubench_snapshot_slot_t* value, const ubench_event_info_t* info
+) {
+#ifdef HAS_GET_THREAD_TIMES
+	return value[info->slot] / 10 * 1000;
+#else
+	return value[info->slot];
+#endif
 }
 
+/*
+ * Getters of events that store a plain counter in a single slot.
+ */
 static long long
-filetime_us(const FILETIME* val) {
-	return (((LARGE_INTEGER*) val)->QuadPart) / 10;
+getter_counter(
+	const ubench_snapshot_slot_t* start, const ubench_snapshot_slot_t* end,
+	const ubench_event_info_t* info
+) {
+	return end[info->slot] - start[info->slot];
 }
-#endif
 
 static long long
-getter_thread_time(
-	const ubench_events_snapshot_t* start, const ubench_events_snapshot_t* end,
-	const ubench_event_info_t* UNUSED_PARAMETER(info)
+getter_raw_counter(
+	const ubench_snapshot_slot_t* value, const ubench_event_info_t* info
 ) {
-#ifdef HAS_TIMESPEC
-	long long result = timespec_diff_ns(&start->threadtime, &end->threadtime);
-	// fprintf(stderr, "getter_thread_time(%lld:%lld, %lld:%lld) = %lld\n", (long long) bench->start.threadtime.tv_sec, (long long) bench->start.threadtime.tv_nsec, (long long) bench->end.threadtime.tv_sec, (long long) bench->end.threadtime.tv_nsec, result);
-	return result;
-#elif defined(HAS_GET_THREAD_TIMES)
-	long long kernel_us = filetime_diff_us(&start->threadtime.kernel, &end->threadtime.kernel);
-	long long user_us = filetime_diff_us(&start->threadtime.user, &end->threadtime.user);
-	return (user_us + kernel_us) * 1000;
-#else
-	return 0;
+	return value[info->slot];
+}
+
+/*
+ * Column getters compute values of many measurements at once. The slot
+ * values of the start and end records are gathered into contiguous arrays
+ * first so that the differences (and unit conversions) can be computed by
+ * the vectorized kernels. Start values are gathered block by block so that
+ * they stay in the cache.
+ */
+#define GATHER_BLOCK_SIZE 256
+
+static void
+gather_deltas(
+	const ubench_snapshot_pair_t* pairs, size_t count, size_t slot, int64_t* values
+) {
+	int64_t starts[GATHER_BLOCK_SIZE];
+
+	for (size_t block = 0; block < count; block += GATHER_BLOCK_SIZE) {
+		size_t block_count = count - block;
+		if (block_count > GATHER_BLOCK_SIZE) {
+			block_count = GATHER_BLOCK_SIZE;
+		}
+		for (size_t i = 0; i < block_count; i++) {
+			values[block + i] = pairs[block + i].end[slot];
+			starts[i] = pairs[block + i].start[slot];
+		}
+		ubench_kernel_subtract(values + block, starts, block_count);
+	}
+}
+
+/*
+ * Replaces values of measurements where the backend failed by the error
+ * code (of the start record first), as the pair getters do.
+ */
+static void
+report_failed_measurements(
+	const ubench_snapshot_pair_t* pairs, size_t count, size_t status_slot,
+	ubench_snapshot_slot_t ok_status, int64_t* values
+) {
+	for (size_t i = 0; i < count; i++) {
+		if (pairs[i].start[status_slot] != ok_status) {
+			values[i] = pairs[i].start[status_slot];
+		} else if (pairs[i].end[status_slot] != ok_status) {
+			values[i] = pairs[i].end[status_slot];
+		}
+	}
+}
+
+static void
+getter_column_counter(
+	const ubench_snapshot_pair_t* pairs, size_t count, int64_t* values,
+	const ubench_event_info_t* info
+) {
+	gather_deltas(pairs, count, info->slot, values);
+}
+
+static void
+getter_column_wall_clock_time(
+	const ubench_snapshot_pair_t* pairs, size_t count, int64_t* values,
+	const ubench_event_info_t* info
+) {
+	gather_deltas(pairs, count, info->slot, values);
+
+#ifdef HAS_TSC
+	if (info->backend == UBENCH_EVENT_BACKEND_SYS_TSC) {
+		for (size_t i = 0; i < count; i++) {
+			values[i] = tsc_ticks_to_ns((uint64_t) values[i]);
+		}
+		return;
+	}
+#endif
+
+#ifdef HAS_QUERY_PERFORMANCE_COUNTER
+	for (size_t i = 0; i < count; i++) {
+		values[i] = wallclock_ticks_to_ns(values[i]);
+	}
 #endif
 }
 
-static long long
-getter_raw_thread_time(
-	const ubench_events_snapshot_t* value, const ubench_event_info_t* UNUSED_PARAMETER(info)
+static void
+getter_column_thread_time(
+	const ubench_snapshot_pair_t* pairs, size_t count, int64_t* values,
+	const ubench_event_info_t* info
 ) {
-#ifdef HAS_TIMESPEC
-	return value->threadtime.tv_sec * 1000 * 1000 * 1000 + value->threadtime.tv_nsec;
-#elif defined(HAS_GET_THREAD_TIMES)
-	return (filetime_us(&value->threadtime.kernel) + filetime_us(&value->threadtime.user)) * 1000;
-#else
-	return 0;
+	gather_deltas(pairs, count, info->slot, values);
+
+#ifdef HAS_GET_THREAD_TIMES
+	for (size_t i = 0; i < count; i++) {
+		values[i] = values[i] / 10 * 1000;
+	}
 #endif
 }
 
+
+/*
+ * GC and monitor backends store a counter followed by the total time of
+ * the counted events (in wall clock units).
+ */
 static long long
-getter_jvm_compilations(
-	const ubench_events_snapshot_t* start, const ubench_events_snapshot_t* end,
-	const ubench_event_info_t* UNUSED_PARAMETER(info)
+getter_accumulated_time(
+	const ubench_snapshot_slot_t* start, const ubench_snapshot_slot_t* end,
+	const ubench_event_info_t* info
 ) {
-	return end->compilations - start->compilations;
+	return wallclock_ticks_to_ns(end[info->slot + 1] - start[info->slot + 1]);
 }
 
 static long long
-getter_raw_jvm_compilations(
-	const ubench_events_snapshot_t* value, const ubench_event_info_t* UNUSED_PARAMETER(info)
+getter_raw_accumulated_time(
+	const ubench_snapshot_slot_t* value, const ubench_event_info_t* info
 ) {
-	return value->compilations;
+	return wallclock_ticks_to_ns(value[info->slot + 1]);
 }
 
+static void
+getter_column_accumulated_time(
+	const ubench_snapshot_pair_t* pairs, size_t count, int64_t* values,
+	const ubench_event_info_t* info
+) {
+	gather_deltas(pairs, count, info->slot + 1, values);
+
+#ifdef HAS_QUERY_PERFORMANCE_COUNTER
+	for (size_t i = 0; i < count; i++) {
+		values[i] = wallclock_ticks_to_ns(values[i]);
+	}
+#endif
+}
 
 #ifdef HAS_GETRUSAGE
+/*
+ * Resource usage events share the slots: the first one holds the thread
+ * time, the second one forced context switches.
+ */
 static long long
 getter_context_switch_forced(
-	const ubench_events_snapshot_t* start, const ubench_events_snapshot_t* end,
-	const ubench_event_info_t* UNUSED_PARAMETER(info)
+	const ubench_snapshot_slot_t* start, const ubench_snapshot_slot_t* end,
+	const ubench_event_info_t* info
 ) {
-	return end->resource_usage.ru_nivcsw - start->resource_usage.ru_nivcsw;
+	return end[info->slot + 1] - start[info->slot + 1];
 }
 
 static long long
 getter_raw_context_switch_forced(
-	const ubench_events_snapshot_t* value, const ubench_event_info_t* UNUSED_PARAMETER(info)
+	const ubench_snapshot_slot_t* value, const ubench_event_info_t* info
 ) {
-	return value->resource_usage.ru_nivcsw;
+	return value[info->slot + 1];
 }
 
-static inline long long
-timeval_diff_us(const struct timeval* a, const struct timeval* b) {
-	// fprintf(stderr, "timeval_diff_us(%lld:%lld, %lld:%lld)\n", (long long) a->tv_sec, (long long) a->tv_usec, (long long) b->tv_sec, (long long) b->tv_usec);
-	long long sec_diff = b->tv_sec - a->tv_sec;
-	long long usec_diff = b->tv_usec - a->tv_usec;
+static long long
+getter_thread_time_rusage(
+	const ubench_snapshot_slot_t* start, const ubench_snapshot_slot_t* end,
+	const ubench_event_info_t* info
+) {
+	return (end[info->slot] - start[info->slot]) * (long long) 1000;
+}
+
+static long long
+getter_raw_thread_time_rusage(
+	const ubench_snapshot_slot_t* value, const ubench_event_info_t* info
+) {
+	return value[info->slot] * (long long) 1000;
+}
+
+static void
+getter_column_context_switch_forced(
+	const ubench_snapshot_pair_t* pairs, size_t count, int64_t* values,
+	const ubench_event_info_t* info
+) {
+	gather_deltas(pairs, count, info->slot + 1, values);
+}
+
+static void
+getter_column_thread_time_rusage(
+	const ubench_snapshot_pair_t* pairs, size_t count, int64_t* values,
+	const ubench_event_info_t* info
+) {
+	gather_deltas(pairs, count, info->slot, values);
+	ubench_kernel_multiply(values, 1000, count);
+}
+
+#endif
 
-	return sec_diff * 1000 * 1000 + usec_diff;
+#ifdef HAS_MMAP
+/*
+ * Safepoint backend stores the number of safepoints followed by their total
+ * time and total time to reach them, both in ticks of the HotSpot clock.
+ */
+static long long
+getter_safepoint_time(
+	const ubench_snapshot_slot_t* start, const ubench_snapshot_slot_t* end,
+	const ubench_event_info_t* info
+) {
+	return ubench_hsperf_ticks_to_ns(end[info->slot + 1] - start[info->slot + 1]);
 }
 
 static long long
-getter_thread_time_rusage(
-	const ubench_events_snapshot_t* start, const ubench_events_snapshot_t* end,
-	const ubench_event_info_t* UNUSED_PARAMETER(info)
+getter_raw_safepoint_time(
+	const ubench_snapshot_slot_t* value, const ubench_event_info_t* info
+) {
+	return ubench_hsperf_ticks_to_ns(value[info->slot + 1]);
+}
+
+static void
+getter_column_safepoint_time(
+	const ubench_snapshot_pair_t* pairs, size_t count, int64_t* values,
+	const ubench_event_info_t* info
 ) {
-	long long user_us = timeval_diff_us(&start->resource_usage.ru_utime, &end->resource_usage.ru_utime);
-	long long system_us = timeval_diff_us(&start->resource_usage.ru_stime, &end->resource_usage.ru_stime);
-	return (user_us + system_us) * (long long) 1000;
+	gather_deltas(pairs, count, info->slot + 1, values);
+	for (size_t i = 0; i < count; i++) {
+		values[i] = ubench_hsperf_ticks_to_ns(values[i]);
+	}
 }
 
 static long long
-getter_raw_thread_time_rusage(
-	const ubench_events_snapshot_t* value, const ubench_event_info_t* UNUSED_PARAMETER(info)
+getter_safepoint_sync_time(
+	const ubench_snapshot_slot_t* start, const ubench_snapshot_slot_t* end,
+	const ubench_event_info_t* info
 ) {
-	long long user_us = TIMEVAL_TO_MICROS(value->resource_usage.ru_utime);
-	long long system_us = TIMEVAL_TO_MICROS(value->resource_usage.ru_stime);
-	return (user_us + system_us) * (long long) 1000;
+	return ubench_hsperf_ticks_to_ns(end[info->slot + 2] - start[info->slot + 2]);
 }
 
+static long long
+getter_raw_safepoint_sync_time(
+	const ubench_snapshot_slot_t* value, const ubench_event_info_t* info
+) {
+	return ubench_hsperf_ticks_to_ns(value[info->slot + 2]);
+}
+
+static void
+getter_column_safepoint_sync_time(
+	const ubench_snapshot_pair_t* pairs, size_t count, int64_t* values,
+	const ubench_event_info_t* info
+) {
+	gather_deltas(pairs, count, info->slot + 2, values);
+	for (size_t i = 0; i < count; i++) {
+		values[i] = ubench_hsperf_ticks_to_ns(values[i]);
+	}
+}
 #endif
 
 #ifdef HAS_PAPI
 static long long
 getter_papi(
-	const ubench_events_snapshot_t* start, const ubench_events_snapshot_t* end,
+	const ubench_snapshot_slot_t* start, const ubench_snapshot_slot_t* end,
 	const ubench_event_info_t* info
 ) {
-	if (start->papi_rc1 != PAPI_OK) {
-		return start->papi_rc1;
-	} else if (start->papi_rc2 != PAPI_OK) {
-		return start->papi_rc2;
-	} else if (end->papi_rc1 != PAPI_OK) {
-		return end->papi_rc1;
+	if (start[info->status_slot] != PAPI_OK) {
+		return start[info->status_slot];
+	} else if (end[info->status_slot] != PAPI_OK) {
+		return end[info->status_slot];
 	}
 
-	long long result = end->papi_events[info->papi_index] - start->papi_events[info->papi_index];
+	long long result = end[info->slot] - start[info->slot];
 	if (result < 0) {
 		// FIXME: can this happen?
 		return result;
@@ -246,15 +507,22 @@ getter_papi(
 
 static long long
 getter_raw_papi(
-	const ubench_events_snapshot_t* value, const ubench_event_info_t* info
+	const ubench_snapshot_slot_t* value, const ubench_event_info_t* info
 ) {
-	if (value->papi_rc1 != PAPI_OK) {
-		return value->papi_rc1;
-	} else if (value->papi_rc2 != PAPI_OK) {
-		return value->papi_rc2;
+	if (value[info->status_slot] != PAPI_OK) {
+		return value[info->status_slot];
 	}
 
-	return value->papi_events[info->papi_index];
+	return value[info->slot];
+}
+
+static void
+getter_column_papi(
+	const ubench_snapshot_pair_t* pairs, size_t count, int64_t* values,
+	const ubench_event_info_t* info
+) {
+	gather_deltas(pairs, count, info->slot, values);
+	report_failed_measurements(pairs, count, info->status_slot, PAPI_OK, values);
 }
 
 static int
@@ -344,6 +612,211 @@ list_papi_events(event_info_iterator_callback_t callback, void* arg) {
 }
 #endif
 
+#ifdef HAS_PERF_EVENTS
+#define LINUX_HW_CACHE_CONFIG(cache, op, result) \
+	((PERF_COUNT_HW_CACHE_##cache) | (PERF_COUNT_HW_CACHE_OP_##op << 8) | (PERF_COUNT_HW_CACHE_RESULT_##result << 16))
+
+typedef struct {
+	const char* name;
+	uint32_t type;
+	uint64_t config;
+} linux_named_event_t;
+
+/* Names follow the symbolic event names used by perf(1). */
+static const linux_named_event_t linux_named_events[] = {
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ "cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+	{ "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ "branch-instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+	{ "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	{ "bus-cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BUS_CYCLES },
+	{ "stalled-cycles-frontend", PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_FRONTEND },
+	{ "stalled-cycles-backend", PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND },
+	{ "ref-cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES },
+
+	{ "L1-dcache-loads", PERF_TYPE_HW_CACHE, LINUX_HW_CACHE_CONFIG(L1D, READ, ACCESS) },
+	{ "L1-dcache-load-misses", PERF_TYPE_HW_CACHE, LINUX_HW_CACHE_CONFIG(L1D, READ, MISS) },
+	{ "L1-icache-load-misses", PERF_TYPE_HW_CACHE, LINUX_HW_CACHE_CONFIG(L1I, READ, MISS) },
+	{ "LLC-loads", PERF_TYPE_HW_CACHE, LINUX_HW_CACHE_CONFIG(LL, READ, ACCESS) },
+	{ "LLC-load-misses", PERF_TYPE_HW_CACHE, LINUX_HW_CACHE_CONFIG(LL, READ, MISS) },
+	{ "dTLB-load-misses", PERF_TYPE_HW_CACHE, LINUX_HW_CACHE_CONFIG(DTLB, READ, MISS) },
+	{ "iTLB-load-misses", PERF_TYPE_HW_CACHE, LINUX_HW_CACHE_CONFIG(ITLB, READ, MISS) },
+
+	{ "cpu-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK },
+	{ "task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+	{ "page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+	{ "minor-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MIN },
+	{ "major-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ },
+	{ "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+	{ "cpu-migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS },
+	{ "alignment-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_ALIGNMENT_FAULTS },
+	{ "emulation-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_EMULATION_FAULTS },
+
+	{ NULL, 0, 0 }
+};
+
+static long long
+getter_linux(
+	const ubench_snapshot_slot_t* start, const ubench_snapshot_slot_t* end,
+	const ubench_event_info_t* info
+) {
+	if (start[info->status_slot] != 0) {
+		return start[info->status_slot];
+	} else if (end[info->status_slot] != 0) {
+		return end[info->status_slot];
+	}
+
+	return (long long) ((uint64_t) end[info->slot] - (uint64_t) start[info->slot]);
+}
+
+static long long
+getter_raw_linux(
+	const ubench_snapshot_slot_t* value, const ubench_event_info_t* info
+) {
+	if (value[info->status_slot] != 0) {
+		return value[info->status_slot];
+	}
+
+	return (long long) value[info->slot];
+}
+
+static void
+getter_column_linux(
+	const ubench_snapshot_pair_t* pairs, size_t count, int64_t* values,
+	const ubench_event_info_t* info
+) {
+	gather_deltas(pairs, count, info->slot, values);
+	report_failed_measurements(pairs, count, info->status_slot, 0, values);
+}
+
+static int
+resolve_linux_raw_event(const char* name, uint64_t* config) {
+	// Raw events are specified as 'rNNNN' with NNNN being hexadecimal
+	// event descriptor (same as with perf(1)).
+	if ((name[0] != 'r') || (name[1] == 0)) {
+		return 0;
+	}
+
+	char* end = NULL;
+	unsigned long long value = strtoull(name + 1, &end, 16);
+	if (*end != 0) {
+		return 0;
+	}
+
+	*config = (uint64_t) value;
+	return 1;
+}
+
+static int
+resolve_linux_event(const char* name, ubench_event_info_t* info) {
+	const char* event_name = name + 6;
+
+	uint32_t type = PERF_TYPE_RAW;
+	uint64_t config = 0;
+
+	const linux_named_event_t* it = linux_named_events;
+	while ((it->name != NULL) && !ubench_str_is_icase_equal(event_name, it->name)) {
+		it++;
+	}
+
+	if (it->name != NULL) {
+		type = it->type;
+		config = it->config;
+	} else if (!resolve_linux_raw_event(event_name, &config)) {
+		return 0;
+	}
+
+	if (!ubench_perf_event_probe(type, config)) {
+		return 0;
+	}
+
+	info->linux_type = type;
+	info->linux_config = config;
+	return 1;
+}
+
+static int
+list_linux_events(event_info_iterator_callback_t callback, void* arg) {
+	char event_name_full[64];
+
+	for (const linux_named_event_t* it = linux_named_events; it->name != NULL; it++) {
+		if (!ubench_perf_event_probe(it->type, it->config)) {
+			continue;
+		}
+
+		snprintf(event_name_full, sizeof(event_name_full), "LINUX:%s", it->name);
+		int terminate = callback(event_name_full, arg);
+		if (terminate) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+#endif
+
+#ifdef HAS_TSC
+static int
+resolve_tsc_event(const char* event, ubench_event_info_t* UNUSED_PARAMETER(info)) {
+	if (!ubench_str_is_icase_equal(event, "SYS:tsc")) {
+		return 0;
+	}
+
+	// Refuse the event when TSC cannot be converted to time.
+	return tsc_frequency > 0;
+}
+
+static int
+list_tsc_events(event_info_iterator_callback_t callback, void* arg) {
+	if (tsc_frequency == 0) {
+		return 0;
+	}
+	return callback("SYS:tsc", arg);
+}
+#endif
+
+#ifdef HAS_MMAP
+/*
+ * Safepoint events are available only when the performance data of the
+ * JVM can be mapped.
+ */
+static int
+resolve_safepoint_event(const char* event, ubench_event_info_t* UNUSED_PARAMETER(info)) {
+	if (!ubench_str_is_icase_equal(event, "JVM:safepoint-count")
+		&& !ubench_str_is_icase_equal(event, "JVM:safepoint-ns")
+		&& !ubench_str_is_icase_equal(event, "JVM:safepoint-sync-ns")) {
+		return 0;
+	}
+
+	return ubench_hsperf_prepare();
+}
+
+static int
+list_safepoint_count_event(event_info_iterator_callback_t callback, void* arg) {
+	if (!ubench_hsperf_prepare()) {
+		return 0;
+	}
+	return callback("JVM:safepoint-count", arg);
+}
+
+static int
+list_safepoint_time_event(event_info_iterator_callback_t callback, void* arg) {
+	if (!ubench_hsperf_prepare()) {
+		return 0;
+	}
+	return callback("JVM:safepoint-ns", arg);
+}
+
+static int
+list_safepoint_sync_time_event(event_info_iterator_callback_t callback, void* arg) {
+	if (!ubench_hsperf_prepare()) {
+		return 0;
+	}
+	return callback("JVM:safepoint-sync-ns", arg);
+}
+#endif
+
 
 static known_event_t known_events[] = {
 	/* Legacy names first. */
@@ -354,8 +827,9 @@ static known_event_t known_events[] = {
 		.resolver = NULL,
 		.lister = NULL,
 		.backend = UBENCH_EVENT_BACKEND_JVM_COMPILATIONS,
-		.getter_raw = getter_raw_jvm_compilations,
-		.getter = getter_jvm_compilations
+		.getter_raw = getter_raw_counter,
+		.getter = getter_counter,
+		.getter_column = getter_column_counter
 	},
 	{
 		.name = "SYS_WALLCLOCK",
@@ -364,7 +838,8 @@ static known_event_t known_events[] = {
 		.lister = NULL,
 		.backend = UBENCH_EVENT_BACKEND_SYS_WALLCLOCK,
 		.getter_raw = getter_raw_wall_clock_time,
-		.getter = getter_wall_clock_time
+		.getter = getter_wall_clock_time,
+		.getter_column = getter_column_wall_clock_time
 	},
 
 #ifdef HAS_GETRUSAGE
@@ -375,7 +850,8 @@ static known_event_t known_events[] = {
 		.lister = NULL,
 		.backend = UBENCH_EVENT_BACKEND_RESOURCE_USAGE,
 		.getter_raw = getter_raw_context_switch_forced,
-		.getter = getter_context_switch_forced
+		.getter = getter_context_switch_forced,
+		.getter_column = getter_column_context_switch_forced
 	},
 #endif
 
@@ -387,10 +863,116 @@ static known_event_t known_events[] = {
 		.resolver = NULL,
 		.lister = NULL,
 		.backend = UBENCH_EVENT_BACKEND_JVM_COMPILATIONS,
-		.getter_raw = getter_raw_jvm_compilations,
-		.getter = getter_jvm_compilations
+		.getter_raw = getter_raw_counter,
+		.getter = getter_counter,
+		.getter_column = getter_column_counter
+	},
+	{
+		.name = "JVM:gc-count",
+		.obsolete = 0,
+		.resolver = NULL,
+		.lister = NULL,
+		.backend = UBENCH_EVENT_BACKEND_JVM_GC,
+		.getter_raw = getter_raw_counter,
+		.getter = getter_counter,
+		.getter_column = getter_column_counter
+	},
+	{
+		.name = "JVM:gc-pause-ns",
+		.obsolete = 0,
+		.resolver = NULL,
+		.lister = NULL,
+		.backend = UBENCH_EVENT_BACKEND_JVM_GC,
+		.getter_raw = getter_raw_accumulated_time,
+		.getter = getter_accumulated_time,
+		.getter_column = getter_column_accumulated_time
+	},
+#ifdef HAS_MMAP
+	{
+		.name = "JVM:safepoint-count",
+		.obsolete = 0,
+		.resolver = resolve_safepoint_event,
+		.lister = list_safepoint_count_event,
+		.backend = UBENCH_EVENT_BACKEND_JVM_SAFEPOINTS,
+		.getter_raw = getter_raw_counter,
+		.getter = getter_counter,
+		.getter_column = getter_column_counter
+	},
+	{
+		.name = "JVM:safepoint-ns",
+		.obsolete = 0,
+		.resolver = resolve_safepoint_event,
+		.lister = list_safepoint_time_event,
+		.backend = UBENCH_EVENT_BACKEND_JVM_SAFEPOINTS,
+		.getter_raw = getter_raw_safepoint_time,
+		.getter = getter_safepoint_time,
+		.getter_column = getter_column_safepoint_time
+	},
+	{
+		.name = "JVM:safepoint-sync-ns",
+		.obsolete = 0,
+		.resolver = resolve_safepoint_event,
+		.lister = list_safepoint_sync_time_event,
+		.backend = UBENCH_EVENT_BACKEND_JVM_SAFEPOINTS,
+		.getter_raw = getter_raw_safepoint_sync_time,
+		.getter = getter_safepoint_sync_time,
+		.getter_column = getter_column_safepoint_sync_time
+	},
+#endif
+	{
+		.name = "JVM:allocated-bytes",
+		.obsolete = 0,
+		.resolver = NULL,
+		.lister = NULL,
+		.backend = UBENCH_EVENT_BACKEND_JVM_ALLOCATIONS,
+		.getter_raw = getter_raw_counter,
+		.getter = getter_counter,
+		.getter_column = getter_column_counter
+	},
+	{
+		.name = "JVM:alloc-samples",
+		.obsolete = 0,
+		.resolver = NULL,
+		.lister = NULL,
+		.backend = UBENCH_EVENT_BACKEND_JVM_ALLOC_SAMPLES,
+		.getter_raw = getter_raw_counter,
+		.getter = getter_counter,
+		.getter_column = getter_column_counter
+	},
+	{
+		.name = "JVM:monitor-contended-enter",
+		.obsolete = 0,
+		.resolver = NULL,
+		.lister = NULL,
+		.backend = UBENCH_EVENT_BACKEND_JVM_MONITORS,
+		.getter_raw = getter_raw_counter,
+		.getter = getter_counter,
+		.getter_column = getter_column_counter
+	},
+	{
+		.name = "JVM:monitor-wait-ns",
+		.obsolete = 0,
+		.resolver = NULL,
+		.lister = NULL,
+		.backend = UBENCH_EVENT_BACKEND_JVM_MONITORS,
+		.getter_raw = getter_raw_accumulated_time,
+		.getter = getter_accumulated_time,
+		.getter_column = getter_column_accumulated_time
 	},
 
+#ifdef HAS_PERF_EVENTS
+	{
+		.name = "LINUX:",
+		.obsolete = 0,
+		.resolver = resolve_linux_event,
+		.lister = list_linux_events,
+		.backend = UBENCH_EVENT_BACKEND_LINUX,
+		.getter_raw = getter_raw_linux,
+		.getter = getter_linux,
+		.getter_column = getter_column_linux
+	},
+#endif
+
 #ifdef HAS_PAPI
 	{
 		.name = "PAPI:",
@@ -399,7 +981,8 @@ static known_event_t known_events[] = {
 		.lister = list_papi_events,
 		.backend = UBENCH_EVENT_BACKEND_PAPI,
 		.getter_raw = getter_raw_papi,
-		.getter = getter_papi
+		.getter = getter_papi,
+		.getter_column = getter_column_papi
 	},
 #endif
 
@@ -411,7 +994,8 @@ static known_event_t known_events[] = {
 		.lister = NULL,
 		.backend = UBENCH_EVENT_BACKEND_RESOURCE_USAGE,
 		.getter_raw = getter_raw_context_switch_forced,
-		.getter = getter_context_switch_forced
+		.getter = getter_context_switch_forced,
+		.getter_column = getter_column_context_switch_forced
 	},
 #endif
 
@@ -422,7 +1006,8 @@ static known_event_t known_events[] = {
 		.lister = NULL,
 		.backend = UBENCH_EVENT_BACKEND_SYS_THREADTIME,
 		.getter_raw = getter_raw_thread_time,
-		.getter = getter_thread_time
+		.getter = getter_thread_time,
+		.getter_column = getter_column_thread_time
 	},
 
 #ifdef HAS_GETRUSAGE
@@ -433,7 +1018,21 @@ static known_event_t known_events[] = {
 		.lister = NULL,
 		.backend = UBENCH_EVENT_BACKEND_RESOURCE_USAGE,
 		.getter_raw = getter_raw_thread_time_rusage,
-		.getter = getter_thread_time_rusage
+		.getter = getter_thread_time_rusage,
+		.getter_column = getter_column_thread_time_rusage
+	},
+#endif
+
+#ifdef HAS_TSC
+	{
+		.name = "SYS:tsc",
+		.obsolete = 0,
+		.resolver = resolve_tsc_event,
+		.lister = list_tsc_events,
+		.backend = UBENCH_EVENT_BACKEND_SYS_TSC,
+		.getter_raw = getter_raw_wall_clock_time,
+		.getter = getter_wall_clock_time,
+		.getter_column = getter_column_wall_clock_time
 	},
 #endif
 
@@ -444,7 +1043,8 @@ static known_event_t known_events[] = {
 		.lister = NULL,
 		.backend = UBENCH_EVENT_BACKEND_SYS_WALLCLOCK,
 		.getter_raw = getter_raw_wall_clock_time,
-		.getter = getter_wall_clock_time
+		.getter = getter_wall_clock_time,
+		.getter_column = getter_column_wall_clock_time
 	},
 
 #ifdef HAS_PAPI
@@ -455,7 +1055,8 @@ static known_event_t known_events[] = {
 		.lister = NULL,
 		.backend = UBENCH_EVENT_BACKEND_PAPI,
 		.getter_raw = getter_raw_papi,
-		.getter = getter_papi
+		.getter = getter_papi,
+		.getter_column = getter_column_papi
 	},
 #endif
 
@@ -467,7 +1068,8 @@ static known_event_t known_events[] = {
 		.lister = NULL,
 		.backend = 0,
 		.getter_raw = NULL,
-		.getter = NULL
+		.getter = NULL,
+		.getter_column = NULL
 	}
 };
 
@@ -494,6 +1096,7 @@ ubench_event_resolve(const char* event, ubench_event_info_t* info) {
 		info->backend = it->backend;
 		info->op_get_raw = it->getter_raw;
 		info->op_get = it->getter;
+		info->op_get_column = it->getter_column;
 		info->name = ubench_str_dup(event);
 		return 1;
 	}
@@ -526,3 +1129,99 @@ ubench_event_iterate(event_info_iterator_callback_t iterator_callback, void* arg
 		}
 	}
 }
+
+static size_t
+allocate_slots(const benchmark_configuration_t* config, unsigned int backend, size_t count, size_t* next_free) {
+	if ((config->used_backends & backend) == 0) {
+		return UBENCH_SNAPSHOT_SLOT_NONE;
+	}
+
+	size_t first = *next_free;
+	*next_free += count;
+	return first;
+}
+
+/*
+ * Computes the record layout for backends used by the event set and
+ * assigns record slots to the individual events.
+ *
+ * Must be called after all events were resolved and the PAPI and LINUX
+ * events were registered in the configuration.
+ */
+INTERNAL void
+ubench_event_compute_layout(benchmark_configuration_t* config) {
+	ubench_snapshot_layout_t* layout = &config->layout;
+	size_t next_free = UBENCH_SNAPSHOT_SLOT_THREAD + 1;
+
+	layout->wallclock = allocate_slots(config, UBENCH_EVENT_BACKEND_SYS_WALLCLOCK, 1, &next_free);
+	layout->tsc = allocate_slots(config, UBENCH_EVENT_BACKEND_SYS_TSC, 1, &next_free);
+	layout->threadtime = allocate_slots(config, UBENCH_EVENT_BACKEND_SYS_THREADTIME, 1, &next_free);
+	layout->resource_usage = allocate_slots(config, UBENCH_EVENT_BACKEND_RESOURCE_USAGE, 2, &next_free);
+	layout->compilations = allocate_slots(config, UBENCH_EVENT_BACKEND_JVM_COMPILATIONS, 1, &next_free);
+	layout->gc = allocate_slots(config, UBENCH_EVENT_BACKEND_JVM_GC, 2, &next_free);
+	layout->allocations = allocate_slots(config, UBENCH_EVENT_BACKEND_JVM_ALLOCATIONS, 1, &next_free);
+	layout->alloc_samples = allocate_slots(config, UBENCH_EVENT_BACKEND_JVM_ALLOC_SAMPLES, 2, &next_free);
+	layout->monitors = allocate_slots(config, UBENCH_EVENT_BACKEND_JVM_MONITORS, 2, &next_free);
+	layout->safepoints = allocate_slots(config, UBENCH_EVENT_BACKEND_JVM_SAFEPOINTS, 3, &next_free);
+#ifdef HAS_PAPI
+	layout->papi = allocate_slots(config, UBENCH_EVENT_BACKEND_PAPI, 1 + config->used_papi_events_count, &next_free);
+#else
+	layout->papi = UBENCH_SNAPSHOT_SLOT_NONE;
+#endif
+#ifdef HAS_PERF_EVENTS
+	layout->linux_events = allocate_slots(config, UBENCH_EVENT_BACKEND_LINUX, 2 + config->used_linux_events_count, &next_free);
+#else
+	layout->linux_events = UBENCH_SNAPSHOT_SLOT_NONE;
+#endif
+	layout->size = next_free;
+
+	for (size_t i = 0; i < config->used_events_count; i++) {
+		ubench_event_info_t* info = &config->used_events[i];
+		info->status_slot = UBENCH_SNAPSHOT_SLOT_NONE;
+
+		switch (info->backend) {
+		case UBENCH_EVENT_BACKEND_SYS_WALLCLOCK:
+			info->slot = layout->wallclock;
+			break;
+		case UBENCH_EVENT_BACKEND_SYS_TSC:
+			info->slot = layout->tsc;
+			break;
+		case UBENCH_EVENT_BACKEND_SYS_THREADTIME:
+			info->slot = layout->threadtime;
+			break;
+		case UBENCH_EVENT_BACKEND_RESOURCE_USAGE:
+			info->slot = layout->resource_usage;
+			break;
+		case UBENCH_EVENT_BACKEND_JVM_COMPILATIONS:
+			info->slot = layout->compilations;
+			break;
+		case UBENCH_EVENT_BACKEND_JVM_GC:
+			info->slot = layout->gc;
+			break;
+		case UBENCH_EVENT_BACKEND_JVM_ALLOCATIONS:
+			info->slot = layout->allocations;
+			break;
+		case UBENCH_EVENT_BACKEND_JVM_ALLOC_SAMPLES:
+			info->slot = layout->alloc_samples;
+			break;
+		case UBENCH_EVENT_BACKEND_JVM_MONITORS:
+			info->slot = layout->monitors;
+			break;
+		case UBENCH_EVENT_BACKEND_JVM_SAFEPOINTS:
+			info->slot = layout->safepoints;
+			break;
+		case UBENCH_EVENT_BACKEND_PAPI:
+			info->status_slot = layout->papi;
+			info->slot = layout->papi + 1 + info->papi_index;
+			break;
+		case UBENCH_EVENT_BACKEND_LINUX:
+			// Skip the status and the number of counters in the group.
+			info->status_slot = layout->linux_events;
+			info->slot = layout->linux_events + 2 + info->linux_index;
+			break;
+		default:
+			assert(false && "unknown backend");
+			break;
+		}
+	}
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * HDR histograms of event values (see HISTOGRAM event sets).
+ *
+ * The layout follows HdrHistogram: values are split into buckets by
+ * powers of two and every bucket is divided into the same number of
+ * linear sub-buckets, so that the relative error stays the same over the
+ * whole range of non-negative 64-bit values. Java LatencyHistogram uses
+ * the same layout to interpret the counts.
+ */
+
+#include "compiler.h"
+#include "ubench.h"
+
+#ifdef _MSC_VER
+#pragma warning(push, 0)
+#include <intrin.h>
+#pragma warning(pop)
+#endif
+
+#define SUB_BUCKET_HALF_COUNT (1 << UBENCH_HISTOGRAM_SUB_BUCKET_HALF_COUNT_MAGNITUDE)
+#define SUB_BUCKET_MASK ((uint64_t) (2 * SUB_BUCKET_HALF_COUNT - 1))
+#define LEADING_ZERO_COUNT_BASE (64 - UBENCH_HISTOGRAM_SUB_BUCKET_HALF_COUNT_MAGNITUDE - 1)
+
+static inline int
+count_leading_zeros(uint64_t value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return 63 - (int) index;
+#else
+	return __builtin_clzll(value);
+#endif
+}
+
+static inline size_t
+get_counts_index(uint64_t value) {
+	// Or-ing with the mask keeps small values in the first bucket (and
+	// the argument of count_leading_zeros non-zero).
+	int bucket_index = LEADING_ZERO_COUNT_BASE - count_leading_zeros(value | SUB_BUCKET_MASK);
+	size_t sub_bucket_index = (size_t) (value >> bucket_index);
+
+	return ((size_t) (bucket_index + 1) << UBENCH_HISTOGRAM_SUB_BUCKET_HALF_COUNT_MAGNITUDE)
+		+ (sub_bucket_index - SUB_BUCKET_HALF_COUNT);
+}
+
+INTERNAL void
+ubench_histogram_reset(ubench_histogram_t* histogram) {
+	memset(histogram, 0, sizeof(*histogram));
+}
+
+/*
+ * Records a single value. Negative values (i.e., backend errors) are
+ * only counted as dropped.
+ */
+INTERNAL void
+ubench_histogram_record(ubench_histogram_t* histogram, int64_t value) {
+	if (value < 0) {
+		histogram->dropped_count++;
+		return;
+	}
+
+	histogram->counts[get_counts_index((uint64_t) value)]++;
+}
+
+INTERNAL void
+ubench_histogram_merge(ubench_histogram_t* histogram, const ubench_histogram_t* other) {
+	for (size_t i = 0; i < UBENCH_HISTOGRAM_COUNTS_LENGTH; i++) {
+		histogram->counts[i] += other->counts[i];
+	}
+	histogram->dropped_count += other->dropped_count;
+}
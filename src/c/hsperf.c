@@ -0,0 +1,218 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * HotSpot performance counters (JVM:safepoint-count, JVM:safepoint-ns and
+ * JVM:safepoint-sync-ns).
+ *
+ * JVMTI does not report safepoints, but HotSpot keeps their statistics in
+ * its performance data memory (the one read by jstat) that is backed by
+ * the /tmp/hsperfdata_<user>/<pid> file. We map the file of our own
+ * process read-only and read the counters directly, so a snapshot costs
+ * only three loads. The counters are not available when the JVM runs with
+ * -XX:-UsePerfData or -XX:+PerfDisableSharedMem.
+ */
+
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+
+#include "compiler.h"
+#include "logging.h"
+#include "mylock.h"
+#include "ubench.h"
+
+#ifdef HAS_MMAP
+
+#pragma warning(push, 0)
+#include <fcntl.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#pragma warning(pop)
+
+/* Magic number as read on big and little endian machines. */
+#define HSPERF_MAGIC_BIG_ENDIAN 0xcafec0c0
+#define HSPERF_MAGIC_LITTLE_ENDIAN 0xc0c0feca
+#define HSPERF_TYPE_LONG 'J'
+
+/* Layout of the performance data memory (see perfMemory.hpp in HotSpot). */
+typedef struct {
+	uint32_t magic;
+	int8_t byte_order;
+	int8_t major_version;
+	int8_t minor_version;
+	int8_t accessible;
+	int32_t used;
+	int32_t overflow;
+	int64_t mod_time_stamp;
+	int32_t entry_offset;
+	int32_t num_entries;
+} hsperf_prologue_t;
+
+typedef struct {
+	int32_t entry_length;
+	int32_t name_offset;
+	int32_t vector_length;
+	int8_t data_type;
+	int8_t flags;
+	int8_t data_units;
+	int8_t data_variability;
+	int32_t data_offset;
+} hsperf_entry_t;
+
+static ubench_spinlock_t hsperf_lock = UBENCH_SPINLOCK_INITIALIZER;
+static volatile bool hsperf_prepared = false;
+
+static const volatile int64_t* safepoint_count = NULL;
+static const volatile int64_t* safepoint_time = NULL;
+static const volatile int64_t* safepoint_sync_time = NULL;
+static int64_t ticks_frequency = 0;
+
+/*
+ * Finds a long counter of the given name, returns NULL when not found.
+ */
+static const volatile int64_t*
+find_counter(const char* data, size_t size, const char* name) {
+	const hsperf_prologue_t* prologue = (const hsperf_prologue_t*) data;
+
+	size_t offset = (size_t) prologue->entry_offset;
+	for (int32_t i = 0; i < prologue->num_entries; i++) {
+		if (offset + sizeof(hsperf_entry_t) > size) {
+			break;
+		}
+		const hsperf_entry_t* entry = (const hsperf_entry_t*) (data + offset);
+		if ((entry->entry_length <= 0) || (offset + (size_t) entry->entry_length > size)) {
+			break;
+		}
+
+		// Names are zero-terminated within the entry.
+		const char* entry_name = data + offset + entry->name_offset;
+		size_t max_name_length = (size_t) (entry->entry_length - entry->name_offset);
+		if ((entry->data_type == HSPERF_TYPE_LONG) && (entry->vector_length == 0)
+			&& (strlen(name) < max_name_length) && (strncmp(entry_name, name, max_name_length) == 0)) {
+			return (const volatile int64_t*) (data + offset + entry->data_offset);
+		}
+
+		offset += (size_t) entry->entry_length;
+	}
+
+	return NULL;
+}
+
+static bool
+map_hsperf_data(void) {
+	struct passwd pwd;
+	struct passwd* result = NULL;
+	char pwd_buffer[1024];
+	if ((getpwuid_r(geteuid(), &pwd, pwd_buffer, sizeof(pwd_buffer), &result) != 0) || (result == NULL)) {
+		DEBUG_PRINTF("failed to get user name for hsperfdata.");
+		return false;
+	}
+
+	char path[1024];
+	snprintf(path, sizeof(path), "/tmp/hsperfdata_%s/%ld", pwd.pw_name, (long) getpid());
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		DEBUG_PRINTF("failed to open %s.", path);
+		return false;
+	}
+
+	struct stat info;
+	if ((fstat(fd, &info) != 0) || ((size_t) info.st_size < sizeof(hsperf_prologue_t))) {
+		close(fd);
+		return false;
+	}
+
+	size_t size = (size_t) info.st_size;
+	char* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		DEBUG_PRINTF("failed to map %s.", path);
+		return false;
+	}
+
+	// It is our own JVM, so the byte order matches.
+	const hsperf_prologue_t* prologue = (const hsperf_prologue_t*) data;
+	if ((prologue->magic != HSPERF_MAGIC_BIG_ENDIAN) && (prologue->magic != HSPERF_MAGIC_LITTLE_ENDIAN)) {
+		DEBUG_PRINTF("unexpected format of %s.", path);
+		munmap(data, size);
+		return false;
+	}
+
+	const volatile int64_t* frequency = find_counter(data, size, "sun.os.hrt.frequency");
+	safepoint_count = find_counter(data, size, "sun.rt.safepoints");
+	safepoint_time = find_counter(data, size, "sun.rt.safepointTime");
+	safepoint_sync_time = find_counter(data, size, "sun.rt.safepointSyncTime");
+	if ((frequency == NULL) || (*frequency <= 0) || (safepoint_count == NULL)
+		|| (safepoint_time == NULL) || (safepoint_sync_time == NULL)) {
+		DEBUG_PRINTF("safepoint counters not found in %s.", path);
+		safepoint_count = NULL;
+		safepoint_time = NULL;
+		safepoint_sync_time = NULL;
+		munmap(data, size);
+		return false;
+	}
+	ticks_frequency = *frequency;
+
+	// The mapping is kept for the whole lifetime of the process.
+	return true;
+}
+
+/*
+ * Maps the performance data of this JVM when called for the first time,
+ * tells whether the safepoint counters are available.
+ */
+INTERNAL bool
+ubench_hsperf_prepare(void) {
+	if (!hsperf_prepared) {
+		ubench_spinlock_lock(&hsperf_lock);
+		if (!hsperf_prepared) {
+			map_hsperf_data();
+			hsperf_prepared = true;
+		}
+		ubench_spinlock_unlock(&hsperf_lock);
+	}
+
+	return safepoint_count != NULL;
+}
+
+/*
+ * Stores the number of safepoints, the total time spent in them once all
+ * threads stopped (sun.rt.safepointTime) and the total time needed to stop
+ * the threads (sun.rt.safepointSyncTime), both in ticks of the HotSpot
+ * clock.
+ */
+INTERNAL void
+ubench_hsperf_store_safepoints(ubench_snapshot_slot_t* slots) {
+	slots[0] = *safepoint_count;
+	slots[1] = *safepoint_time;
+	slots[2] = *safepoint_sync_time;
+}
+
+INTERNAL long long
+ubench_hsperf_ticks_to_ns(long long ticks) {
+	// Split the computation to avoid overflow for large absolute values.
+	long long seconds = ticks / ticks_frequency;
+	long long remainder = ticks % ticks_frequency;
+	return seconds * 1000 * 1000 * 1000 + remainder * 1000 * 1000 * 1000 / ticks_frequency;
+}
+
+#endif
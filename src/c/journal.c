@@ -0,0 +1,234 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Journal of JIT compilation events (see CompilationJournal).
+ *
+ * When enabled, every CompiledMethodLoad and CompiledMethodUnload event is
+ * stored into a ring of the thread that reported it (usually a compiler
+ * thread, see ring.h), so the callbacks take no locks. Older entries are
+ * overwritten when the ring is full.
+ *
+ * Only method ids are stored, names are resolved when the journal is read.
+ */
+
+#include "compiler.h"
+#include "ring.h"
+#include "strutil.h"
+#include "ubench.h"
+
+#pragma warning(push, 0)
+/* Ensure compatibility of JNI function types. */
+#include "cz_cuni_mff_d3s_perf_CompilationJournal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <jni.h>
+#include <jvmti.h>
+#include <jvmticmlr.h>
+#pragma warning(pop)
+
+#define JOURNAL_RING_SIZE 4096
+
+#define JOURNAL_KIND_LOAD 1
+#define JOURNAL_KIND_UNLOAD 2
+
+typedef struct {
+	int64_t timestamp;
+	int64_t method;
+	int64_t code_address;
+	int32_t code_size;
+	int16_t kind;
+	int16_t inlining_depth;
+} journal_entry_t;
+
+/* Values of a single entry passed to Java. */
+#define JOURNAL_ENTRY_FIELDS 7
+
+static jvmtiEnv* journal_jvmti = NULL;
+static volatile bool journal_enabled = false;
+
+// Rings are not released as there are only a few compiler threads.
+static ubench_ring_list_t all_rings = UBENCH_RING_LIST_INITIALIZER(JOURNAL_RING_SIZE, journal_entry_t);
+static THREAD_LOCAL ubench_ring_t* current_ring = NULL;
+
+INTERNAL void
+ubench_journal_init(jvmtiEnv* jvmti) {
+	journal_jvmti = jvmti;
+}
+
+static void
+record_entry(int kind, jmethodID method, const void* code_address, jint code_size, int inlining_depth) {
+	if (current_ring == NULL) {
+		current_ring = ubench_ring_acquire(&all_rings, ubench_measure_get_thread_id());
+		if (current_ring == NULL) {
+			return;
+		}
+	}
+
+	journal_entry_t* entry = ubench_ring_next_entry(&all_rings, current_ring);
+	entry->timestamp = ubench_measure_get_wallclock();
+	entry->method = (int64_t) (intptr_t) method;
+	entry->code_address = (int64_t) (intptr_t) code_address;
+	entry->code_size = (int32_t) code_size;
+	entry->kind = (int16_t) kind;
+	entry->inlining_depth = (int16_t) inlining_depth;
+
+	ubench_ring_publish(current_ring);
+}
+
+/*
+ * Returns the deepest inlining found in the compile_info records of
+ * a CompiledMethodLoad event (0 when nothing was inlined or the VM does
+ * not provide the records).
+ */
+static int
+get_inlining_depth(const void* compile_info) {
+	int depth = 0;
+
+	const jvmtiCompiledMethodLoadRecordHeader* header = compile_info;
+	for (; header != NULL; header = header->next) {
+		if (header->kind != JVMTI_CMLR_INLINE_INFO) {
+			continue;
+		}
+
+		const jvmtiCompiledMethodLoadInlineRecord* record = (const jvmtiCompiledMethodLoadInlineRecord*) header;
+		for (jint i = 0; i < record->numpcs; i++) {
+			if (record->pcinfo[i].numstackframes - 1 > depth) {
+				depth = record->pcinfo[i].numstackframes - 1;
+			}
+		}
+	}
+
+	return depth;
+}
+
+INTERNAL void
+ubench_journal_record_load(jmethodID method, jint code_size, const void* code_address, const void* compile_info) {
+	if (!journal_enabled) {
+		return;
+	}
+
+	record_entry(JOURNAL_KIND_LOAD, method, code_address, code_size, get_inlining_depth(compile_info));
+}
+
+INTERNAL void
+ubench_journal_record_unload(jmethodID method, const void* code_address) {
+	if (!journal_enabled) {
+		return;
+	}
+
+	record_entry(JOURNAL_KIND_UNLOAD, method, code_address, 0, 0);
+}
+
+//
+
+JNIEXPORT void JNICALL
+Java_cz_cuni_mff_d3s_perf_CompilationJournal_setEnabled(
+	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(journal_class), jboolean jenabled
+) {
+	journal_enabled = (jenabled == JNI_TRUE);
+}
+
+JNIEXPORT void JNICALL
+Java_cz_cuni_mff_d3s_perf_CompilationJournal_clear(
+	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(journal_class)
+) {
+	ubench_ring_list_clear(&all_rings);
+}
+
+/*
+ * Returns entries of all rings, JOURNAL_ENTRY_FIELDS values per entry
+ * (or NULL when out of memory).
+ */
+JNIEXPORT jlongArray JNICALL
+Java_cz_cuni_mff_d3s_perf_CompilationJournal_readEntries(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(journal_class)
+) {
+	int* thread_ids;
+	size_t count;
+	journal_entry_t* entries = ubench_ring_list_copy(&all_rings, &thread_ids, &count);
+	if (entries == NULL) {
+		return NULL;
+	}
+
+	jlong* values = malloc((count > 0 ? count : 1) * JOURNAL_ENTRY_FIELDS * sizeof(jlong));
+	if (values == NULL) {
+		free(entries);
+		free(thread_ids);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		const journal_entry_t* entry = &entries[i];
+		jlong* out = &values[i * JOURNAL_ENTRY_FIELDS];
+		out[0] = (jlong) entry->timestamp;
+		out[1] = (jlong) entry->kind;
+		out[2] = (jlong) entry->method;
+		out[3] = (jlong) entry->code_address;
+		out[4] = (jlong) entry->code_size;
+		out[5] = (jlong) entry->inlining_depth;
+		out[6] = (jlong) thread_ids[i];
+	}
+	free(entries);
+	free(thread_ids);
+
+	jlongArray jvalues = (*jni)->NewLongArray(jni, (jsize) (count * JOURNAL_ENTRY_FIELDS));
+	if (jvalues != NULL) {
+		(*jni)->SetLongArrayRegion(jni, jvalues, 0, (jsize) (count * JOURNAL_ENTRY_FIELDS), values);
+	}
+	free(values);
+
+	return jvalues;
+}
+
+JNIEXPORT jstring JNICALL
+Java_cz_cuni_mff_d3s_perf_CompilationJournal_resolveMethodName(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(journal_class), jlong jmethod
+) {
+	if (journal_jvmti == NULL) {
+		return NULL;
+	}
+
+	jvmtiEnv* jvmti = journal_jvmti;
+	jmethodID method = (jmethodID) (intptr_t) jmethod;
+
+	jclass declaring_class;
+	char* class_signature = NULL;
+	char* method_name = NULL;
+	char* method_signature = NULL;
+
+	jstring jname = NULL;
+	if (((*jvmti)->GetMethodDeclaringClass(jvmti, method, &declaring_class) == JVMTI_ERROR_NONE)
+		&& ((*jvmti)->GetClassSignature(jvmti, declaring_class, &class_signature, NULL) == JVMTI_ERROR_NONE)
+		&& ((*jvmti)->GetMethodName(jvmti, method, &method_name, &method_signature, NULL) == JVMTI_ERROR_NONE)) {
+		char buffer[1024] = { 0 };
+		ubench_str_append_class_name(buffer, sizeof(buffer), class_signature);
+#ifdef _MSC_VER
+		_snprintf_s(buffer + strlen(buffer), sizeof(buffer) - strlen(buffer), _TRUNCATE, ".%s%s", method_name, method_signature);
+#else
+		snprintf(buffer + strlen(buffer), sizeof(buffer) - strlen(buffer), ".%s%s", method_name, method_signature);
+#endif
+		jname = (*jni)->NewStringUTF(jni, buffer);
+	}
+
+	(*jvmti)->Deallocate(jvmti, (unsigned char*) class_signature);
+	(*jvmti)->Deallocate(jvmti, (unsigned char*) method_name);
+	(*jvmti)->Deallocate(jvmti, (unsigned char*) method_signature);
+
+	return jname;
+}
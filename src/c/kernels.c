@@ -0,0 +1,167 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Vectorized kernels used when computing results column by column.
+ *
+ * On x86, the AVX2 variants are compiled with a function-level target
+ * attribute (the rest of the agent stays compiled for the baseline ISA)
+ * and are selected at runtime. NEON is part of the baseline on AArch64.
+ * Everything else uses the scalar variants.
+ */
+
+#include "compiler.h"
+#include "logging.h"
+#include "ubench.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAS_KERNELS_AVX2
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#pragma warning(push, 0)
+#include <immintrin.h>
+#pragma warning(pop)
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define HAS_KERNELS_AVX2
+#define TARGET_AVX2
+#pragma warning(push, 0)
+#include <immintrin.h>
+#include <intrin.h>
+#pragma warning(pop)
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define HAS_KERNELS_NEON
+#pragma warning(push, 0)
+#include <arm_neon.h>
+#pragma warning(pop)
+#endif
+
+typedef void (*kernel_subtract_func_t)(int64_t*, const int64_t*, size_t);
+typedef void (*kernel_multiply_func_t)(int64_t*, int64_t, size_t);
+
+static void
+subtract_scalar(int64_t* values, const int64_t* subtrahends, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		values[i] = (int64_t) ((uint64_t) values[i] - (uint64_t) subtrahends[i]);
+	}
+}
+
+static void
+multiply_scalar(int64_t* values, int64_t factor, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		values[i] = (int64_t) ((uint64_t) values[i] * (uint64_t) factor);
+	}
+}
+
+#ifdef HAS_KERNELS_AVX2
+TARGET_AVX2 static void
+subtract_avx2(int64_t* values, const int64_t* subtrahends, size_t count) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m256i a = _mm256_loadu_si256((const __m256i*) &values[i]);
+		__m256i b = _mm256_loadu_si256((const __m256i*) &subtrahends[i]);
+		_mm256_storeu_si256((__m256i*) &values[i], _mm256_sub_epi64(a, b));
+	}
+	subtract_scalar(values + i, subtrahends + i, count - i);
+}
+
+/*
+ * AVX2 has no 64-bit multiplication, the product is composed from 32-bit
+ * halves (the high halves multiplied together do not affect the result).
+ */
+TARGET_AVX2 static void
+multiply_avx2(int64_t* values, int64_t factor, size_t count) {
+	__m256i f = _mm256_set1_epi64x(factor);
+	__m256i f_high = _mm256_srli_epi64(f, 32);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m256i v = _mm256_loadu_si256((const __m256i*) &values[i]);
+		__m256i v_high = _mm256_srli_epi64(v, 32);
+		__m256i low = _mm256_mul_epu32(v, f);
+		__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(v_high, f), _mm256_mul_epu32(v, f_high));
+		__m256i product = _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+		_mm256_storeu_si256((__m256i*) &values[i], product);
+	}
+	multiply_scalar(values + i, factor, count - i);
+}
+
+static bool
+cpu_has_avx2(void) {
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 0);
+	if (regs[0] < 7) {
+		return false;
+	}
+	// The OS must also save the YMM registers (OSXSAVE and XCR0 bits).
+	__cpuid(regs, 1);
+	if (((regs[2] & (1 << 27)) == 0) || ((_xgetbv(0) & 6) != 6)) {
+		return false;
+	}
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+#ifdef HAS_KERNELS_NEON
+static void
+subtract_neon(int64_t* values, const int64_t* subtrahends, size_t count) {
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		vst1q_s64(&values[i], vsubq_s64(vld1q_s64(&values[i]), vld1q_s64(&subtrahends[i])));
+	}
+	subtract_scalar(values + i, subtrahends + i, count - i);
+}
+#endif
+
+static kernel_subtract_func_t kernel_subtract = subtract_scalar;
+static kernel_multiply_func_t kernel_multiply = multiply_scalar;
+
+INTERNAL void
+ubench_kernels_init(void) {
+#ifdef HAS_KERNELS_AVX2
+	if (cpu_has_avx2()) {
+		DEBUG_PRINTF("using AVX2 kernels.");
+		kernel_subtract = subtract_avx2;
+		kernel_multiply = multiply_avx2;
+		return;
+	}
+#endif
+#ifdef HAS_KERNELS_NEON
+	DEBUG_PRINTF("using NEON kernels.");
+	kernel_subtract = subtract_neon;
+#endif
+}
+
+/*
+ * Computes values[i] -= subtrahends[i] (wrapping around like unsigned
+ * counters do).
+ */
+INTERNAL void
+ubench_kernel_subtract(int64_t* values, const int64_t* subtrahends, size_t count) {
+	kernel_subtract(values, subtrahends, count);
+}
+
+/*
+ * Computes values[i] *= factor.
+ */
+INTERNAL void
+ubench_kernel_multiply(int64_t* values, int64_t factor, size_t count) {
+	kernel_multiply(values, factor, count);
+}
@@ -22,6 +22,7 @@
 
 #include "compiler.h"
 #include "logging.h"
+#include "mylock.h"
 #include "ubench.h"
 
 #pragma warning(push, 0)
@@ -45,127 +46,433 @@
 #include <sys/time.h>
 #endif
 
-#ifdef HAS_QUERY_PERFORMANCE_COUNTER
+#ifdef HAS_PERF_EVENTS
+#include <errno.h>
+#include <unistd.h>
+
+#include <linux/perf_event.h>
+#endif
+
+#if defined(HAS_QUERY_PERFORMANCE_COUNTER) || defined(HAS_GET_THREAD_TIMES)
 #pragma warning(push, 0)
 #include <windows.h>
 #pragma warning(pop)
 #endif
 
-static inline void
-store_wallclock(timestamp_t* ts) {
 #ifdef HAS_TIMESPEC
-	clock_gettime(CLOCK_MONOTONIC, ts);
+#define TIMESPEC_TO_NANOS(val) ((val).tv_sec * 1000LL * 1000 * 1000 + (val).tv_nsec)
+#endif
+
+static inline ubench_snapshot_slot_t
+read_wallclock(void) {
+#ifdef HAS_TIMESPEC
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return TIMESPEC_TO_NANOS(ts);
 #elif defined(HAS_QUERY_PERFORMANCE_COUNTER)
-	QueryPerformanceCounter(ts);
+	// Raw ticks, converted to nanoseconds when reading the results.
+	LARGE_INTEGER ts;
+	QueryPerformanceCounter(&ts);
+	return ts.QuadPart;
 #else
-	*ts = -1;
+	return -1;
 #endif
 }
 
-static inline void
-store_threadtime(threadtime_t* ts) {
+static inline ubench_snapshot_slot_t
+read_threadtime(void) {
 #ifdef HAS_TIMESPEC
-	clock_gettime(CLOCK_THREAD_CPUTIME_ID, ts);
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return TIMESPEC_TO_NANOS(ts);
 #elif defined(HAS_GET_THREAD_TIMES)
 	FILETIME t_creation, t_exit, t_kernel, t_user;
 	HANDLE thr = GetCurrentThread();
-	// For reasons yet unknown, directly passing &(ts->kernel), &(ts->user))
-	// causes segfault. Thus, we use a temporary variable.
 	GetThreadTimes(thr, &t_creation, &t_exit, &t_kernel, &t_user);
-	ts->kernel = t_kernel;
-	ts->user = t_user;
+	// Sum of kernel and user time in 100ns units.
+	return ((LARGE_INTEGER*) &t_kernel)->QuadPart + ((LARGE_INTEGER*) &t_user)->QuadPart;
 #else
-	*ts = -1;
+	return -1;
 #endif
 }
 
+#ifdef HAS_GETRUSAGE
+static inline void
+store_resource_usage(ubench_snapshot_slot_t* slots) {
+	struct rusage usage;
+	getrusage(RUSAGE_THREAD, &usage);
+	slots[0] = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000LL * 1000
+		+ usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+	slots[1] = usage.ru_nivcsw;
+}
+#endif
+
+#ifdef HAS_PERF_EVENTS_RDPMC
+#define COMPILER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+static inline uint64_t
+rdpmc(uint32_t counter) {
+	uint32_t low, high;
+	__asm__ __volatile__("rdpmc" : "=a"(low), "=d"(high) : "c"(counter));
+	return ((uint64_t) high << 32) | low;
+}
+
+/*
+ * Reads the counter from userspace following the protocol described
+ * with 'struct perf_event_mmap_page' in <linux/perf_event.h>: the page
+ * is protected by a sequence lock which changes whenever the kernel
+ * updates the page (e.g., when the thread migrates to another CPU).
+ *
+ * Returns false when the counter is not currently loaded on the PMU
+ * (and hence has to be read using the read() syscall).
+ */
+static inline bool
+read_linux_counter_rdpmc(volatile struct perf_event_mmap_page* page, uint64_t* value) {
+	uint32_t seq;
+	uint64_t count;
+
+	do {
+		seq = page->lock;
+		COMPILER_BARRIER();
+
+		uint32_t index = page->index;
+		if (!page->cap_user_rdpmc || (index == 0)) {
+			return false;
+		}
+
+		// Sign-extend the value read from the (narrower) PMU register.
+		uint16_t width = page->pmc_width;
+		uint64_t pmc = rdpmc(index - 1) << (64 - width);
+
+		count = page->offset + (uint64_t) ((int64_t) pmc >> (64 - width));
+
+		COMPILER_BARRIER();
+	} while (page->lock != seq);
+
+	*value = count;
+	return true;
+}
+
+static inline bool
+store_linux_events_rdpmc(const benchmark_configuration_t* config, uint64_t* group) {
+	// The counters are loaded on the PMU only when their thread is running.
+	if (!pthread_equal(pthread_self(), config->linux_rdpmc_thread)) {
+		return false;
+	}
+
+	for (size_t i = 0; i < config->used_linux_events_count; i++) {
+		if (!read_linux_counter_rdpmc(config->linux_pages[i], &group[i + 1])) {
+			return false;
+		}
+	}
+
+	group[0] = config->used_linux_events_count;
+	return true;
+}
+#endif
+
+#ifdef HAS_PERF_EVENTS
+/*
+ * Stores the counter group (number of counters followed by their values)
+ * into the given slots, returns 0 or negative errno.
+ */
+static inline int
+store_linux_events(const benchmark_configuration_t* config, uint64_t* group) {
+#ifdef HAS_PERF_EVENTS_RDPMC
+	if (config->linux_rdpmc && store_linux_events_rdpmc(config, group)) {
+		return 0;
+	}
+#endif
+
+	if (config->linux_grouped) {
+		// One read() of the group leader returns values of all counters.
+		size_t size = (1 + config->used_linux_events_count) * sizeof(group[0]);
+		ssize_t rc = read(config->linux_fds[0], group, size);
+		return (rc == (ssize_t) size) ? 0 : ((rc < 0) ? -errno : -EIO);
+	}
+
+	group[0] = config->used_linux_events_count;
+	for (size_t i = 0; i < config->used_linux_events_count; i++) {
+		ssize_t rc = read(config->linux_fds[i], &group[i + 1], sizeof(group[i + 1]));
+		if (rc != (ssize_t) sizeof(group[i + 1])) {
+			return (rc < 0) ? -errno : -EIO;
+		}
+	}
+
+	return 0;
+}
+#endif
+
+/*
+ * Identifier of the measuring thread stored with every snapshot so that
+ * measurements of threads sharing an event set can be told apart. Assigned
+ * lazily from a global counter, which is cheaper than asking the system.
+ * Being small, the ids also index the per-thread buffers of event sets,
+ * hence ids of ended threads are reused (by threads that start measuring
+ * later) to keep the ids bounded by the number of threads alive at once.
+ *
+ * Virtual threads (when tracked, see vthreads.c) get their own ids as
+ * they can start and stop a measurement on different carriers.
+ */
+static ubench_atomic_int_t last_thread_id = { .atomic_value = 0 };
+static THREAD_LOCAL int current_thread_id = 0;
+
+static ubench_spinlock_t free_thread_ids_lock = UBENCH_SPINLOCK_INITIALIZER;
+static int* free_thread_ids = NULL;
+static size_t free_thread_ids_count = 0;
+static size_t free_thread_ids_capacity = 0;
+
+INTERNAL int
+ubench_measure_new_thread_id(void) {
+	int thread_id = 0;
+
+	ubench_spinlock_lock(&free_thread_ids_lock);
+	if (free_thread_ids_count > 0) {
+		thread_id = free_thread_ids[--free_thread_ids_count];
+	}
+	ubench_spinlock_unlock(&free_thread_ids_lock);
+
+	if (thread_id == 0) {
+		thread_id = ubench_atomic_int_inc(&last_thread_id) + 1;
+	}
+	return thread_id;
+}
+
+/*
+ * Returns id of an ended thread for reuse (0 is ignored). When the list
+ * cannot grow, the id is simply not reused.
+ */
+INTERNAL void
+ubench_measure_release_thread_id(int thread_id) {
+	if (thread_id == 0) {
+		return;
+	}
+
+	ubench_spinlock_lock(&free_thread_ids_lock);
+	if (free_thread_ids_count == free_thread_ids_capacity) {
+		size_t capacity = (free_thread_ids_capacity == 0) ? 64 : 2 * free_thread_ids_capacity;
+		int* grown = realloc(free_thread_ids, capacity * sizeof(int));
+		if (grown != NULL) {
+			free_thread_ids = grown;
+			free_thread_ids_capacity = capacity;
+		}
+	}
+	if (free_thread_ids_count < free_thread_ids_capacity) {
+		free_thread_ids[free_thread_ids_count++] = thread_id;
+	}
+	ubench_spinlock_unlock(&free_thread_ids_lock);
+}
+
+/*
+ * Called when the current (platform) thread ends.
+ */
+INTERNAL void
+ubench_measure_release_current_thread_id(void) {
+	ubench_measure_release_thread_id(current_thread_id);
+	current_thread_id = 0;
+}
+
+INTERNAL int
+ubench_measure_get_thread_id(void) {
+	int vthread_id = ubench_vthreads_get_current_id();
+	if (vthread_id != 0) {
+		return vthread_id;
+	}
+
+	if (current_thread_id == 0) {
+		current_thread_id = ubench_measure_new_thread_id();
+	}
+	return current_thread_id;
+}
+
+/*
+ * Current time of the clock used by SYS:wallclock-time (in the units
+ * stored in the snapshots), for timestamps of other agent events.
+ */
+INTERNAL int64_t
+ubench_measure_get_wallclock(void) {
+	return read_wallclock();
+}
+
+/*
+ * CPU time of the current native thread (in the units stored in the
+ * snapshots of SYS:thread-time).
+ */
+INTERNAL int64_t
+ubench_measure_get_threadtime(void) {
+	return read_threadtime();
+}
+
 static inline void
 do_snapshot(
-	const benchmark_configuration_t* config, ubench_events_snapshot_t* snapshot
+	const benchmark_configuration_t* config, ubench_snapshot_slot_t* record
 ) {
+	const ubench_snapshot_layout_t* layout = &config->layout;
+
+	// Calls into the JVM, kept outside of all the other events.
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_JVM_ALLOCATIONS) > 0) {
+		record[layout->allocations] = ubench_allocation_get_current_thread_bytes();
+	}
+
 #ifdef HAS_GETRUSAGE
 	if ((config->used_backends & UBENCH_EVENT_BACKEND_RESOURCE_USAGE) > 0) {
-		getrusage(RUSAGE_THREAD, &(snapshot->resource_usage));
+		store_resource_usage(&record[layout->resource_usage]);
 	}
 #endif
 
 	if ((config->used_backends & UBENCH_EVENT_BACKEND_JVM_COMPILATIONS) > 0) {
-		snapshot->compilations = ubench_atomic_int_get(&counter_compilation_total);
+		record[layout->compilations] = ubench_counters_get_compilation_total();
 	}
 
-	snapshot->garbage_collections = ubench_atomic_int_get(&counter_gc_total);
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_JVM_GC) > 0) {
+		record[layout->gc] = ubench_atomic_int_get(&counter_gc_total);
+		record[layout->gc + 1] = ubench_atomic_int64_get(&counter_gc_pause_time);
+	}
+
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_JVM_MONITORS) > 0) {
+		ubench_monitors_store_current_thread(&record[layout->monitors]);
+	}
+
+#ifdef HAS_MMAP
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_JVM_SAFEPOINTS) > 0) {
+		ubench_hsperf_store_safepoints(&record[layout->safepoints]);
+	}
+#endif
+
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_JVM_ALLOC_SAMPLES) > 0) {
+		record[layout->alloc_samples] = ubench_alloc_samples_get_current_thread_count();
+		record[layout->alloc_samples + 1] = read_wallclock();
+	}
 
 	if ((config->used_backends & UBENCH_EVENT_BACKEND_SYS_THREADTIME) > 0) {
-		store_threadtime(&(snapshot->threadtime));
+		record[layout->threadtime] = ubench_vthreads_get_thread_time(read_threadtime());
 	}
 
 #ifdef HAS_PAPI
 	if ((config->used_backends & UBENCH_EVENT_BACKEND_PAPI) > 0) {
-		snapshot->papi_rc1 = PAPI_read(config->papi_eventset, snapshot->papi_events);
-		DEBUG_PRINTF("PAPI_read(%d) = %d", config->papi_eventset, snapshot->papi_rc2);
+		record[layout->papi] = PAPI_read(config->papi_eventset, (long long*) &record[layout->papi + 1]);
+		DEBUG_PRINTF("PAPI_read(%d) = %d", config->papi_eventset, (int) record[layout->papi]);
+	}
+#endif
+
+#ifdef HAS_PERF_EVENTS
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_LINUX) > 0) {
+		record[layout->linux_events] = store_linux_events(config, (uint64_t*) &record[layout->linux_events + 1]);
 	}
 #endif
 
 	if ((config->used_backends & UBENCH_EVENT_BACKEND_SYS_WALLCLOCK) > 0) {
-		store_wallclock(&(snapshot->timestamp));
+		record[layout->wallclock] = read_wallclock();
+	}
+
+#ifdef HAS_TSC
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_SYS_TSC) > 0) {
+		record[layout->tsc] = (ubench_snapshot_slot_t) ubench_tsc_read();
 	}
+#endif
 }
 
 INTERNAL void
 ubench_measure_start(
-	const benchmark_configuration_t* config, ubench_events_snapshot_t* snapshot
+	const benchmark_configuration_t* config, ubench_snapshot_slot_t* record
 ) {
 #ifdef HAS_PAPI
+	int papi_start_rc = PAPI_OK;
 	if ((config->used_backends & UBENCH_EVENT_BACKEND_PAPI) > 0) {
-		// TODO: check for errors
-		snapshot->papi_rc2 = PAPI_start(config->papi_eventset);
-		DEBUG_PRINTF("PAPI_start(%d) = %d", config->papi_eventset, snapshot->papi_rc1);
+		papi_start_rc = PAPI_start(config->papi_eventset);
+		DEBUG_PRINTF("PAPI_start(%d) = %d", config->papi_eventset, papi_start_rc);
 	}
 #endif
 
-	snapshot->type = UBENCH_SNAPSHOT_TYPE_START;
-	do_snapshot(config, snapshot);
+	record[UBENCH_SNAPSHOT_SLOT_TYPE] = UBENCH_SNAPSHOT_TYPE_START;
+	record[UBENCH_SNAPSHOT_SLOT_THREAD] = ubench_measure_get_thread_id();
+	do_snapshot(config, record);
+
+#ifdef HAS_PAPI
+	// Failure to start takes precedence over the (then failed) read.
+	if (papi_start_rc != PAPI_OK) {
+		record[config->layout.papi] = papi_start_rc;
+	}
+#endif
 }
 
 INTERNAL void
 ubench_measure_sample(
-	const benchmark_configuration_t* config, ubench_events_snapshot_t* snapshot, int user_id
+	const benchmark_configuration_t* config, ubench_snapshot_slot_t* record, int user_id
 ) {
-	snapshot->type = user_id;
-	do_snapshot(config, snapshot);
+	record[UBENCH_SNAPSHOT_SLOT_TYPE] = user_id;
+	record[UBENCH_SNAPSHOT_SLOT_THREAD] = ubench_measure_get_thread_id();
+	do_snapshot(config, record);
 }
 
 INTERNAL void
 ubench_measure_stop(
-	const benchmark_configuration_t* config, ubench_events_snapshot_t* snapshot
+	const benchmark_configuration_t* config, ubench_snapshot_slot_t* record
 ) {
+	const ubench_snapshot_layout_t* layout = &config->layout;
+
+#ifdef HAS_TSC
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_SYS_TSC) > 0) {
+		record[layout->tsc] = (ubench_snapshot_slot_t) ubench_tsc_read();
+	}
+#endif
+
 	if ((config->used_backends & UBENCH_EVENT_BACKEND_SYS_WALLCLOCK) > 0) {
-		store_wallclock(&(snapshot->timestamp));
+		record[layout->wallclock] = read_wallclock();
 	}
 
 #ifdef HAS_PAPI
-	// TODO: check for errors
 	if ((config->used_backends & UBENCH_EVENT_BACKEND_PAPI) > 0) {
-		snapshot->papi_rc1 = PAPI_stop(config->papi_eventset, snapshot->papi_events);
-		DEBUG_PRINTF("PAPI_stop(%d) = %d", config->papi_eventset, snapshot->papi_rc1);
+		record[layout->papi] = PAPI_stop(config->papi_eventset, (long long*) &record[layout->papi + 1]);
+		DEBUG_PRINTF("PAPI_stop(%d) = %d", config->papi_eventset, (int) record[layout->papi]);
+	}
+#endif
+
+#ifdef HAS_PERF_EVENTS
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_LINUX) > 0) {
+		record[layout->linux_events] = store_linux_events(config, (uint64_t*) &record[layout->linux_events + 1]);
 	}
 #endif
 
 	if ((config->used_backends & UBENCH_EVENT_BACKEND_SYS_THREADTIME) > 0) {
-		store_threadtime(&(snapshot->threadtime));
+		record[layout->threadtime] = ubench_vthreads_get_thread_time(read_threadtime());
 	}
 
 	if ((config->used_backends & UBENCH_EVENT_BACKEND_JVM_COMPILATIONS) > 0) {
-		snapshot->compilations = ubench_atomic_int_get(&counter_compilation_total);
+		record[layout->compilations] = ubench_counters_get_compilation_total();
+	}
+
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_JVM_GC) > 0) {
+		record[layout->gc] = ubench_atomic_int_get(&counter_gc_total);
+		record[layout->gc + 1] = ubench_atomic_int64_get(&counter_gc_pause_time);
 	}
 
-	snapshot->garbage_collections = ubench_atomic_int_get(&counter_gc_total);
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_JVM_MONITORS) > 0) {
+		ubench_monitors_store_current_thread(&record[layout->monitors]);
+	}
+
+#ifdef HAS_MMAP
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_JVM_SAFEPOINTS) > 0) {
+		ubench_hsperf_store_safepoints(&record[layout->safepoints]);
+	}
+#endif
+
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_JVM_ALLOC_SAMPLES) > 0) {
+		record[layout->alloc_samples + 1] = read_wallclock();
+		record[layout->alloc_samples] = ubench_alloc_samples_get_current_thread_count();
+	}
 
 #ifdef HAS_GETRUSAGE
 	if ((config->used_backends & UBENCH_EVENT_BACKEND_RESOURCE_USAGE) > 0) {
-		getrusage(RUSAGE_THREAD, &(snapshot->resource_usage));
+		store_resource_usage(&record[layout->resource_usage]);
 	}
 #endif
 
-	snapshot->type = UBENCH_SNAPSHOT_TYPE_END;
+	// Calls into the JVM, kept outside of all the other events.
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_JVM_ALLOCATIONS) > 0) {
+		record[layout->allocations] = ubench_allocation_get_current_thread_bytes();
+	}
+
+	record[UBENCH_SNAPSHOT_SLOT_TYPE] = UBENCH_SNAPSHOT_TYPE_END;
+	record[UBENCH_SNAPSHOT_SLOT_THREAD] = ubench_measure_get_thread_id();
 }
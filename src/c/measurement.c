@@ -22,14 +22,17 @@
 #include "compiler.h"
 #include "logging.h"
 #include "myatomic.h"
+#include "mylock.h"
 #include "ubench.h"
 
 #pragma warning(push, 0)
 /* Ensure compatibility of JNI function types. */
 #include "cz_cuni_mff_d3s_perf_Measurement.h"
+#include "cz_cuni_mff_d3s_perf_MeasurementEntryPoints.h"
 
 #include <assert.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -49,6 +52,16 @@
 #include <unistd.h>
 #endif
 
+#ifdef HAS_MMAP
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#pragma warning(push, 0)
+#include <malloc.h>
+#pragma warning(pop)
+#endif
+
 #ifdef HAS_QUERY_PERFORMANCE_COUNTER
 #pragma warning(push, 0)
 #include <windows.h>
@@ -56,14 +69,131 @@
 #endif
 
 
+#define EVENTSET_FREE 0
+#define EVENTSET_RESERVED 1
+#define EVENTSET_VALID 2
+
+/*
+ * Records of a single thread of an event set with PER_THREAD_BUFFERS.
+ *
+ * The buffers are allocated lazily by their threads and only the owning
+ * thread ever records into them, hence the index is not updated atomically.
+ * The records follow right after this header and each buffer starts at
+ * a cache line boundary, so no two threads write into the same line.
+ */
+typedef struct CACHE_ALIGNED thread_buffer {
+	size_t index;
+} thread_buffer_t;
+
+/*
+ * Per-thread buffers are indexed by the (small) thread ids assigned by
+ * ubench_measure_get_thread_id(), again in chunks that never move. Ids of
+ * ended threads are reused, hence so are their buffers and the number of
+ * buffers is bounded by the number of threads alive at the same time.
+ */
+#define THREAD_BUFFER_CHUNK_SIZE 64
+#define THREAD_BUFFER_MAX_CHUNKS 1024
+
+typedef struct {
+	thread_buffer_t* volatile buffers[THREAD_BUFFER_CHUNK_SIZE];
+} thread_buffer_chunk_t;
+
 typedef struct {
 	benchmark_configuration_t config;
-	int valid;
+	// Per-thread buffers (NULL unless created with PER_THREAD_BUFFERS).
+	thread_buffer_chunk_t* volatile* thread_buffers;
+	// Records lost because the thread got no buffer (too many threads
+	// or out of memory).
+	ubench_atomic_size_t unbuffered_records;
+	// Created with SUMMARY: per-thread buffers hold only the last start
+	// and end record followed by running statistics of every event.
+	bool summary;
+	// Created with HISTOGRAM: summary event set with a histogram of every
+	// event after the statistics.
+	bool histogram;
+	// Cannot be measured from critical natives and downcalls: some events
+	// (JVM:allocated-bytes) call into the JVM, other event sets may block
+	// (allocating buffers, growing spill files, PAPI or all-threads scans).
+	bool needs_jni;
+#ifdef HAS_PERF_EVENTS
+	// Created with ALL_THREADS: counters of all threads of the process,
+	// recorded by perfevents.c instead of the buffers above.
+	ubench_perf_process_t* process;
+#endif
+	volatile int state;
+	// Bumped whenever the event set is destroyed, so that groups can tell
+	// their event set from a new one reusing the same slot.
+	volatile unsigned int generation;
 } eventset_t;
 
-static eventset_t* all_eventsets = NULL;
+/*
+ * Event sets are allocated in chunks that are never moved or freed, so that
+ * threads recording into existing event sets need no locking even when
+ * new event sets are being created. The lock only serializes changes of
+ * the event set states.
+ */
+#define EVENTSET_CHUNK_SIZE 64
+#define EVENTSET_MAX_CHUNKS 1024
+
+static eventset_t* all_eventsets[EVENTSET_MAX_CHUNKS];
 /* We use jint as we compare the passed IDs with this value. */
-static jint all_eventset_count = 0;
+static volatile jint all_eventset_count = 0;
+static ubench_spinlock_t all_eventsets_lock = UBENCH_SPINLOCK_INITIALIZER;
+
+static inline eventset_t*
+get_eventset_entry(jint id) {
+	return &all_eventsets[id / EVENTSET_CHUNK_SIZE][id % EVENTSET_CHUNK_SIZE];
+}
+
+/*
+ * Returns the event set with the given id or NULL if there is no such
+ * (valid) event set.
+ */
+static inline eventset_t*
+get_eventset(jint id) {
+	if ((id < 0) || (id >= all_eventset_count)) {
+		return NULL;
+	}
+
+	eventset_t* eventset = get_eventset_entry(id);
+	return (eventset->state == EVENTSET_VALID) ? eventset : NULL;
+}
+
+static void
+set_eventset_state(eventset_t* eventset, int state) {
+	ubench_spinlock_lock(&all_eventsets_lock);
+	eventset->state = state;
+	ubench_spinlock_unlock(&all_eventsets_lock);
+}
+
+/*
+ * Allocates zeroed memory starting at a cache line boundary.
+ */
+static void*
+alloc_cache_aligned(size_t size) {
+	void* result;
+#ifdef _WIN32
+	result = _aligned_malloc(size, CACHE_LINE_SIZE);
+#else
+	if (posix_memalign(&result, CACHE_LINE_SIZE, size) != 0) {
+		result = NULL;
+	}
+#endif
+
+	if (result != NULL) {
+		memset(result, 0, size);
+	}
+	return result;
+}
+
+static void
+free_cache_aligned(void* ptr) {
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
 
 
 #ifdef HAS_PAPI
@@ -131,75 +261,328 @@ do_papi_error_throw(JNIEnv* jni, int rc, const char* function_that_failed) {
 }
 #endif
 
+#if defined(HAS_PERF_EVENTS) || defined(HAS_MMAP)
+static void
+do_errno_throw(JNIEnv* jni, int rc, const char* function_that_failed) {
+	char message[512];
+	snprintf(message, sizeof(message), "%s failed: %s.", function_that_failed, strerror(rc));
+	do_throw(jni, message);
+}
+#endif
+
 #define THROW_OOM(env, message) \
 	do_throw(env, "Out of memory (" message ").")
 
-JNIEXPORT jint JNICALL
-Java_cz_cuni_mff_d3s_perf_Measurement_createEventSet(
-	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class),
-	jint jmeasurements, jobjectArray jeventNames, jintArray joptions
-) {
-#ifndef HAS_PAPI
-	UNUSED_VARIABLE(joptions);
-#endif
+/*
+ * Finds a free event set (or allocates a new one) and marks it reserved.
+ * Returns its id or -1 (with an exception thrown).
+ */
+static jint
+reserve_eventset(JNIEnv* jni) {
+	ubench_spinlock_lock(&all_eventsets_lock);
 
-	// FIXME: where to properly compute this number
-	jmeasurements *= 2;
+	for (jint i = 0; i < all_eventset_count; i++) {
+		eventset_t* eventset = get_eventset_entry(i);
+		if (eventset->state == EVENTSET_FREE) {
+			eventset->state = EVENTSET_RESERVED;
+			ubench_spinlock_unlock(&all_eventsets_lock);
+			return i;
+		}
+	}
 
-	if (jmeasurements <= 0) {
-		do_throw(jni, "Number of measurements has to be positive.");
+	jint eventset_id = all_eventset_count;
+	size_t chunk = (size_t) eventset_id / EVENTSET_CHUNK_SIZE;
+	if (chunk >= EVENTSET_MAX_CHUNKS) {
+		ubench_spinlock_unlock(&all_eventsets_lock);
+		do_throw(jni, "Too many event sets.");
 		return -1;
 	}
 
-	size_t event_count = (*jni)->GetArrayLength(jni, jeventNames);
-	if (event_count == 0) {
-		do_throw(jni, "List of events cannot be empty.");
-		return -1;
+	if (all_eventsets[chunk] == NULL) {
+		// Aligned, so that event sets do not share cache lines.
+		all_eventsets[chunk] = alloc_cache_aligned(EVENTSET_CHUNK_SIZE * sizeof(eventset_t));
+		if (all_eventsets[chunk] == NULL) {
+			ubench_spinlock_unlock(&all_eventsets_lock);
+			THROW_OOM(jni, "allocating an event set");
+			return -1;
+		}
 	}
 
-	// FIXME: locking
+	get_eventset_entry(eventset_id)->state = EVENTSET_RESERVED;
+	all_eventset_count = eventset_id + 1;
 
-	/*
-	 * First find whether some id is free, then reallocate.
-	 */
-	eventset_t* eventset = NULL;
-	jint eventset_id = -1;
-	for (jint i = 0; i < all_eventset_count; i++) {
-		if (!all_eventsets[i].valid) {
-			eventset = &all_eventsets[i];
-			eventset_id = i;
-			break;
+	ubench_spinlock_unlock(&all_eventsets_lock);
+	return eventset_id;
+}
+
+static inline ubench_snapshot_slot_t*
+get_thread_buffer_data(thread_buffer_t* buffer) {
+	return (ubench_snapshot_slot_t*) (buffer + 1);
+}
+
+static inline ubench_summary_t*
+get_thread_buffer_summaries(const benchmark_configuration_t* config, thread_buffer_t* buffer) {
+	return (ubench_summary_t*) (get_thread_buffer_data(buffer) + config->data_size * config->layout.size);
+}
+
+static inline ubench_histogram_t*
+get_thread_buffer_histograms(const benchmark_configuration_t* config, thread_buffer_t* buffer) {
+	return (ubench_histogram_t*) (get_thread_buffer_summaries(config, buffer) + config->used_events_count);
+}
+
+static size_t
+get_thread_buffer_size(const eventset_t* eventset) {
+	const benchmark_configuration_t* config = &eventset->config;
+
+	size_t size = sizeof(thread_buffer_t) + config->data_size * config->layout.size * sizeof(ubench_snapshot_slot_t);
+	if (eventset->summary) {
+		size += config->used_events_count * sizeof(ubench_summary_t);
+	}
+	if (eventset->histogram) {
+		size += config->used_events_count * sizeof(ubench_histogram_t);
+	}
+	return size;
+}
+
+static void
+reset_thread_buffer_summaries(const eventset_t* eventset, thread_buffer_t* buffer) {
+	const benchmark_configuration_t* config = &eventset->config;
+
+	ubench_summary_t* summaries = get_thread_buffer_summaries(config, buffer);
+	for (size_t i = 0; i < config->used_events_count; i++) {
+		ubench_summary_reset(&summaries[i]);
+	}
+
+	if (eventset->histogram) {
+		ubench_histogram_t* histograms = get_thread_buffer_histograms(config, buffer);
+		for (size_t i = 0; i < config->used_events_count; i++) {
+			ubench_histogram_reset(&histograms[i]);
 		}
 	}
+}
 
-	if (eventset == NULL) {
-		eventset_t* new_eventset = realloc(all_eventsets, sizeof(eventset_t) * (all_eventset_count + 1));
-		if (new_eventset == NULL) {
-			THROW_OOM(jni, "allocating an event set");
-			return -1;
+static void
+free_thread_buffers(eventset_t* eventset) {
+	for (size_t i = 0; i < THREAD_BUFFER_MAX_CHUNKS; i++) {
+		thread_buffer_chunk_t* chunk = eventset->thread_buffers[i];
+		if (chunk == NULL) {
+			continue;
+		}
+		for (size_t j = 0; j < THREAD_BUFFER_CHUNK_SIZE; j++) {
+			free_cache_aligned(chunk->buffers[j]);
 		}
-		all_eventsets = new_eventset;
+		free(chunk);
+	}
 
-		eventset = &all_eventsets[all_eventset_count];
-		eventset->valid = 0;
-		eventset_id = all_eventset_count;
+	free((void*) eventset->thread_buffers);
+	eventset->thread_buffers = NULL;
+}
 
-		all_eventset_count++;
+static void
+free_eventset_data(eventset_t* eventset) {
+	if (eventset->thread_buffers != NULL) {
+		free_thread_buffers(eventset);
+		return;
 	}
 
-	eventset->config.used_backends = 0;
+#ifdef HAS_MMAP
+	if (eventset->config.spill != NULL) {
+		ubench_spill_close(&eventset->config);
+		return;
+	}
+#endif
 
-	eventset->config.data = calloc(jmeasurements, sizeof(ubench_events_snapshot_t));
-	if (eventset->config.data == NULL) {
-		THROW_OOM(jni, "allocating place for measurements");
-		return -1;
+	free(eventset->config.data);
+	eventset->config.data = NULL;
+}
+
+/*
+ * Returns the buffer of the given thread, allocating it on first use.
+ * Returns NULL when the buffer cannot be allocated.
+ */
+static thread_buffer_t*
+get_thread_buffer(eventset_t* eventset, int thread_id) {
+	size_t chunk_index = (size_t) thread_id / THREAD_BUFFER_CHUNK_SIZE;
+	if (chunk_index >= THREAD_BUFFER_MAX_CHUNKS) {
+		return NULL;
+	}
+
+	thread_buffer_chunk_t* chunk = eventset->thread_buffers[chunk_index];
+	if (chunk == NULL) {
+		// The chunk is shared with other threads, allocate it only once.
+		ubench_spinlock_lock(&all_eventsets_lock);
+		chunk = eventset->thread_buffers[chunk_index];
+		if (chunk == NULL) {
+			chunk = calloc(1, sizeof(thread_buffer_chunk_t));
+			eventset->thread_buffers[chunk_index] = chunk;
+		}
+		ubench_spinlock_unlock(&all_eventsets_lock);
+
+		if (chunk == NULL) {
+			return NULL;
+		}
+	}
+
+	// Only the owning thread stores its buffer, no locking is needed.
+	thread_buffer_t* buffer = chunk->buffers[thread_id % THREAD_BUFFER_CHUNK_SIZE];
+	if (buffer == NULL) {
+		buffer = alloc_cache_aligned(get_thread_buffer_size(eventset));
+		if (buffer == NULL) {
+			DEBUG_PRINTF("failed to allocate buffer of thread %d.", thread_id);
+			return NULL;
+		}
+		buffer->index = 0;
+		if (eventset->summary) {
+			reset_thread_buffer_summaries(eventset, buffer);
+		}
+		chunk->buffers[thread_id % THREAD_BUFFER_CHUNK_SIZE] = buffer;
+	}
+
+	return buffer;
+}
+
+/*
+ * Returns the record to overwrite when the buffer is full. Start and stop
+ * records come in pairs, so the last complete pair keeps being overwritten
+ * (the index itself keeps growing to count the dropped records).
+ */
+static inline size_t
+get_overflow_index(size_t index, size_t size) {
+	return (size & ~(size_t) 1) - 2 + (index & 1);
+}
+
+/*
+ * Claims the next record in the buffer of the calling thread (see
+ * get_overflow_index() for what happens when the buffer is full).
+ */
+static inline ubench_snapshot_slot_t*
+claim_thread_record(eventset_t* eventset) {
+	const benchmark_configuration_t* config = &eventset->config;
+
+	thread_buffer_t* buffer = get_thread_buffer(eventset, ubench_measure_get_thread_id());
+	if (buffer == NULL) {
+		ubench_atomic_size_inc(&eventset->unbuffered_records);
+		return NULL;
+	}
+	if (config->data_size < 2) {
+		return NULL;
+	}
+
+	size_t index = buffer->index++;
+	if (index >= config->data_size) {
+		index = get_overflow_index(index, config->data_size);
+	}
+	return get_thread_buffer_data(buffer) + index * config->layout.size;
+}
+
+static void
+reset_thread_buffers(eventset_t* eventset) {
+	for (size_t i = 0; i < THREAD_BUFFER_MAX_CHUNKS; i++) {
+		thread_buffer_chunk_t* chunk = eventset->thread_buffers[i];
+		if (chunk == NULL) {
+			continue;
+		}
+		for (size_t j = 0; j < THREAD_BUFFER_CHUNK_SIZE; j++) {
+			if (chunk->buffers[j] == NULL) {
+				continue;
+			}
+			chunk->buffers[j]->index = 0;
+			if (eventset->summary) {
+				reset_thread_buffer_summaries(eventset, chunk->buffers[j]);
+			}
+		}
+	}
+}
+
+/*
+ * Claims the next record of the event set. Several threads may record into
+ * the same event set, each of them gets a different record until the buffer
+ * is full. Event sets spilled to a file grow, in-memory event sets overwrite
+ * their last measurement (see get_overflow_index()).
+ */
+static inline ubench_snapshot_slot_t*
+claim_record(eventset_t* eventset) {
+	if (eventset->thread_buffers != NULL) {
+		return claim_thread_record(eventset);
+	}
+
+	benchmark_configuration_t* config = &eventset->config;
+	size_t index = ubench_atomic_size_inc(&config->data_index);
+
+	while (index >= config->data_size) {
+#ifdef HAS_MMAP
+		if ((config->spill != NULL) && ubench_spill_grow(config, index)) {
+			continue;
+		}
+#endif
+		if (config->data_size < 2) {
+			return NULL;
+		}
+		index = get_overflow_index(index, config->data_size);
+	}
+
+	return ubench_snapshot_get(config, index);
+}
+
+#ifdef HAS_MMAP
+/*
+ * Spill files are created in the directory given by the 'ubench.spill.dir'
+ * system property, defaulting to 'java.io.tmpdir'.
+ */
+static bool
+get_spill_path(JNIEnv* jni, jint eventset_id, char* path, size_t path_size) {
+	jclass system_class = (*jni)->FindClass(jni, "java/lang/System");
+	if (system_class == NULL) {
+		return false;
+	}
+	jmethodID get_property = (*jni)->GetStaticMethodID(jni, system_class, "getProperty", "(Ljava/lang/String;)Ljava/lang/String;");
+	if (get_property == NULL) {
+		return false;
+	}
+
+	jstring jdir = (*jni)->CallStaticObjectMethod(jni, system_class, get_property, (*jni)->NewStringUTF(jni, "ubench.spill.dir"));
+	if (jdir == NULL) {
+		jdir = (*jni)->CallStaticObjectMethod(jni, system_class, get_property, (*jni)->NewStringUTF(jni, "java.io.tmpdir"));
+	}
+	if (jdir == NULL) {
+		return false;
 	}
-	eventset->config.data_index = 0;
-	eventset->config.data_size = jmeasurements;
+
+	const char* dir = (*jni)->GetStringUTFChars(jni, jdir, 0);
+	int len = snprintf(path, path_size, "%s/ubench-%ld-%d.spill", dir, (long) getpid(), (int) eventset_id);
+	(*jni)->ReleaseStringUTFChars(jni, jdir, dir);
+
+	return (len > 0) && ((size_t) len < path_size);
+}
+#endif
+
+/*
+ * Initializes a reserved event set. Returns its id or -1 (with an exception
+ * thrown).
+ */
+static jint
+init_eventset(
+	JNIEnv* jni, eventset_t* eventset, jint eventset_id,
+	jint jmeasurements, size_t event_count, jobjectArray jeventNames, jintArray joptions
+) {
+	eventset->config.used_backends = 0;
+
+	// Allocated once the record layout is known.
+	eventset->config.data = NULL;
+	eventset->config.spill = NULL;
+	eventset->thread_buffers = NULL;
+	ubench_atomic_size_set(&eventset->unbuffered_records, 0);
+	eventset->summary = false;
+	eventset->histogram = false;
+#ifdef HAS_PERF_EVENTS
+	eventset->process = NULL;
+#endif
+	ubench_atomic_size_set(&eventset->config.data_index, 0);
+	// Already doubled by the caller (a start and a stop record per measurement).
+	eventset->config.data_size = (size_t) jmeasurements;
 
 	eventset->config.used_events = calloc(event_count, sizeof(ubench_event_info_t));
 	if (eventset->config.used_events == NULL) {
-		free(eventset->config.data);
 		THROW_OOM(jni, "allocating place for event metadata");
 		return -1;
 	}
@@ -211,6 +594,16 @@ Java_cz_cuni_mff_d3s_perf_Measurement_createEventSet(
 	eventset->config.used_papi_events_count = 0;
 #endif
 
+#ifdef HAS_PERF_EVENTS
+	eventset->config.used_linux_events_count = 0;
+	eventset->config.linux_grouped = false;
+	eventset->config.linux_rdpmc = false;
+	for (size_t i = 0; i < UBENCH_MAX_LINUX_EVENTS; i++) {
+		eventset->config.linux_fds[i] = -1;
+		eventset->config.linux_pages[i] = NULL;
+	}
+#endif
+
 	for (size_t i = 0; i < event_count; i++) {
 		jstring jevent_name = (jstring) (*jni)->GetObjectArrayElement(jni, jeventNames, (jsize) i);
 		const char* event_name = (*jni)->GetStringUTFChars(jni, jevent_name, 0);
@@ -228,7 +621,7 @@ Java_cz_cuni_mff_d3s_perf_Measurement_createEventSet(
 			buf[511] = 0;
 			(*jni)->ReleaseStringUTFChars(jni, jevent_name, event_name);
 			free(eventset->config.used_events);
-			free(eventset->config.data);
+			free_eventset_data(eventset);
 			do_throw(jni, buf);
 			return -1;
 		}
@@ -272,20 +665,165 @@ Java_cz_cuni_mff_d3s_perf_Measurement_createEventSet(
 		}
 #endif
 
+#ifdef HAS_PERF_EVENTS
+		if (event_info->backend == UBENCH_EVENT_BACKEND_LINUX) {
+			/* Check that the counter is not already there. */
+			size_t j;
+			for (j = 0; j < eventset->config.used_linux_events_count; j++) {
+				if ((eventset->config.used_linux_event_types[j] == event_info->linux_type)
+					&& (eventset->config.used_linux_event_configs[j] == event_info->linux_config)) {
+					break;
+				}
+			}
+			if (j == eventset->config.used_linux_events_count) {
+				if (j == UBENCH_MAX_LINUX_EVENTS) {
+					(*jni)->ReleaseStringUTFChars(jni, jevent_name, event_name);
+					free(eventset->config.used_events);
+					free_eventset_data(eventset);
+					do_throw(jni, "Too many LINUX events in the event set.");
+					return -1;
+				}
+				eventset->config.used_linux_event_types[j] = event_info->linux_type;
+				eventset->config.used_linux_event_configs[j] = event_info->linux_config;
+				eventset->config.used_linux_events_count++;
+			}
+			event_info->linux_index = j;
+		}
+#endif
+
 		(*jni)->ReleaseStringUTFChars(jni, jevent_name, event_name);
 	}
 
-#ifdef HAS_PAPI
+	bool inherit = false;
+	bool allow_rdpmc = true;
+	bool spill_to_file = false;
+	bool per_thread = false;
+	bool summary = false;
+	bool histogram = false;
+	bool all_threads = false;
 	size_t option_count = (*jni)->GetArrayLength(jni, joptions);
 	jint* options = (*jni)->GetIntArrayElements(jni, joptions, NULL);
+	for (size_t i = 0; i < option_count; i++) {
+		if (options[i] == cz_cuni_mff_d3s_perf_Measurement_THREAD_INHERIT) {
+			inherit = true;
+		} else if (options[i] == cz_cuni_mff_d3s_perf_Measurement_NO_RDPMC) {
+			allow_rdpmc = false;
+		} else if (options[i] == cz_cuni_mff_d3s_perf_Measurement_SPILL_TO_FILE) {
+			spill_to_file = true;
+		} else if (options[i] == cz_cuni_mff_d3s_perf_Measurement_PER_THREAD_BUFFERS) {
+			per_thread = true;
+		} else if (options[i] == cz_cuni_mff_d3s_perf_Measurement_SUMMARY) {
+			summary = true;
+		} else if (options[i] == cz_cuni_mff_d3s_perf_Measurement_HISTOGRAM) {
+			summary = true;
+			histogram = true;
+		} else if (options[i] == cz_cuni_mff_d3s_perf_Measurement_ALL_THREADS) {
+			all_threads = true;
+		}
+	}
+	(*jni)->ReleaseIntArrayElements(jni, joptions, options, JNI_ABORT);
+
+	ubench_event_compute_layout(&eventset->config);
+	DEBUG_PRINTF("Event set %d uses records of %zu slots.", eventset_id, eventset->config.layout.size);
+
+	if (spill_to_file && per_thread) {
+		free(eventset->config.used_events);
+		do_throw(jni, "Per-thread buffers cannot be spilled to a file.");
+		return -1;
+	}
+	if (spill_to_file && summary) {
+		free(eventset->config.used_events);
+		do_throw(jni, "Summaries cannot be spilled to a file.");
+		return -1;
+	}
+	if (all_threads && (eventset->config.used_backends != UBENCH_EVENT_BACKEND_LINUX)) {
+		free(eventset->config.used_events);
+		do_throw(jni, "Only LINUX events can be measured on all threads.");
+		return -1;
+	}
+	if (all_threads && (inherit || spill_to_file || per_thread || summary)) {
+		free(eventset->config.used_events);
+		do_throw(jni, "Measuring all threads cannot be combined with other options.");
+		return -1;
+	}
+
+	bool calls_jvm = (eventset->config.used_backends & UBENCH_EVENT_BACKEND_JVM_ALLOCATIONS) > 0;
+	if (calls_jvm && !ubench_allocation_prepare(jni)) {
+		free(eventset->config.used_events);
+		do_throw(jni, "Thread allocated bytes are not available in this JVM.");
+		return -1;
+	}
+
+	// Only plain in-memory event sets are cheap (and safe) enough for
+	// critical natives and downcalls.
+	eventset->needs_jni = calls_jvm || spill_to_file || per_thread || summary || all_threads
+		|| ((eventset->config.used_backends & UBENCH_EVENT_BACKEND_PAPI) > 0);
+
+	if (((eventset->config.used_backends & UBENCH_EVENT_BACKEND_JVM_MONITORS) > 0) && !ubench_monitors_enable()) {
+		free(eventset->config.used_events);
+		do_throw(jni, "Monitor events are not available in this JVM.");
+		return -1;
+	}
+
+	if ((eventset->config.used_backends & UBENCH_EVENT_BACKEND_SYS_THREADTIME) > 0) {
+		// Failure only means that there are no virtual threads to care about.
+		ubench_vthreads_enable();
+	}
+
+	if (summary) {
+		// Only the pending measurement of each thread is kept.
+		eventset->summary = true;
+		eventset->histogram = histogram;
+		eventset->config.data_size = 2;
+		per_thread = true;
+	}
 
+	if (per_thread) {
+		// The buffers themselves are allocated by the recording threads.
+		eventset->thread_buffers = calloc(THREAD_BUFFER_MAX_CHUNKS, sizeof(thread_buffer_chunk_t*));
+		if (eventset->thread_buffers == NULL) {
+			free(eventset->config.used_events);
+			THROW_OOM(jni, "allocating place for per-thread buffers");
+			return -1;
+		}
+	} else if (spill_to_file) {
+#ifdef HAS_MMAP
+		char path[1024];
+		if (!get_spill_path(jni, eventset_id, path, sizeof(path))) {
+			free(eventset->config.used_events);
+			do_throw(jni, "Unable to determine spill file path.");
+			return -1;
+		}
+
+		int rc = ubench_spill_open(&eventset->config, path);
+		if (rc != 0) {
+			free(eventset->config.used_events);
+			do_errno_throw(jni, rc, "Spilling measurements to a file");
+			return -1;
+		}
+#else
+		free(eventset->config.used_events);
+		do_throw(jni, "Spilling measurements to a file is not supported.");
+		return -1;
+#endif
+	} else if (all_threads) {
+		// Records of the individual threads are kept by perfevents.c.
+		eventset->config.data_size = 0;
+	} else {
+		eventset->config.data = calloc(eventset->config.data_size * eventset->config.layout.size, sizeof(ubench_snapshot_slot_t));
+		if (eventset->config.data == NULL) {
+			free(eventset->config.used_events);
+			THROW_OOM(jni, "allocating place for measurements");
+			return -1;
+		}
+	}
 
+#ifdef HAS_PAPI
 	if ((eventset->config.used_backends & UBENCH_EVENT_BACKEND_PAPI) > 0) {
 		int rc = PAPI_create_eventset(&eventset->config.papi_eventset);
 		if (rc != PAPI_OK) {
-			(*jni)->ReleaseIntArrayElements(jni, joptions, options, JNI_ABORT);
 			free(eventset->config.used_events);
-			free(eventset->config.data);
+			free_eventset_data(eventset);
 			do_papi_error_throw(jni, rc, "PAPI_create_eventset");
 			return -1;
 		}
@@ -296,80 +834,172 @@ Java_cz_cuni_mff_d3s_perf_Measurement_createEventSet(
 		// *before* adding the individual events work
 		rc = PAPI_assign_eventset_component(eventset->config.papi_eventset, eventset->config.papi_component);
 		if (rc != PAPI_OK) {
-			(*jni)->ReleaseIntArrayElements(jni, joptions, options, JNI_ABORT);
 			free(eventset->config.used_events);
-			free(eventset->config.data);
+			free_eventset_data(eventset);
 			do_papi_error_throw(jni, rc, "PAPI_assign_eventset_component");
 			return -1;
 		}
 
-		for (size_t i = 0; i < option_count; i++) {
-			if (options[i] == cz_cuni_mff_d3s_perf_Measurement_THREAD_INHERIT) {
-				PAPI_option_t opt;
-				memset(&opt, 0, sizeof(opt));
-				opt.inherit.inherit = PAPI_INHERIT_ALL;
-				opt.inherit.eventset = eventset->config.papi_eventset;
-				rc = PAPI_set_opt(PAPI_INHERIT, &opt);
-				if (rc != PAPI_OK) {
-					(*jni)->ReleaseIntArrayElements(jni, joptions, options, JNI_ABORT);
-					free(eventset->config.used_events);
-					free(eventset->config.data);
-					do_papi_error_throw(jni, rc, "PAPI_set_opt(PAPI_INHERIT)");
-					return -1;
-				}
+		if (inherit) {
+			PAPI_option_t opt;
+			memset(&opt, 0, sizeof(opt));
+			opt.inherit.inherit = PAPI_INHERIT_ALL;
+			opt.inherit.eventset = eventset->config.papi_eventset;
+			rc = PAPI_set_opt(PAPI_INHERIT, &opt);
+			if (rc != PAPI_OK) {
+				free(eventset->config.used_events);
+				free_eventset_data(eventset);
+				do_papi_error_throw(jni, rc, "PAPI_set_opt(PAPI_INHERIT)");
+				return -1;
 			}
 		}
 
 		for (size_t i = 0; i < eventset->config.used_papi_events_count; i++) {
 			rc = PAPI_add_event(eventset->config.papi_eventset, eventset->config.used_papi_events[i]);
 			if (rc != PAPI_OK) {
-				(*jni)->ReleaseIntArrayElements(jni, joptions, options, JNI_ABORT);
 				free(eventset->config.used_events);
-				free(eventset->config.data);
+				free_eventset_data(eventset);
 				do_papi_error_throw(jni, rc, "PAPI_add_event");
 				return -1;
 			}
 		}
 	}
-
-	(*jni)->ReleaseIntArrayElements(jni, joptions, options, JNI_ABORT);
-
 #endif
-	eventset->valid = 1;
-
-	return eventset_id;
-}
 
-JNIEXPORT jint JNICALL
-Java_cz_cuni_mff_d3s_perf_Measurement_createAttachedEventSetWithJavaThread(
+#ifdef HAS_PERF_EVENTS
+	if (all_threads) {
+		int rc = ubench_perf_process_create(&eventset->config, &eventset->process);
+		if (rc != 0) {
+			free(eventset->config.used_events);
+			free_eventset_data(eventset);
+			do_errno_throw(jni, rc, "perf_event_open");
+			return -1;
+		}
+	} else if ((eventset->config.used_backends & UBENCH_EVENT_BACKEND_LINUX) > 0) {
+		int rc = ubench_perf_event_open(&eventset->config, 0, inherit, allow_rdpmc);
+		if (rc != 0) {
+			free(eventset->config.used_events);
+			free_eventset_data(eventset);
+			do_errno_throw(jni, rc, "perf_event_open");
+			return -1;
+		}
+	}
+#else
+	UNUSED_VARIABLE(inherit);
+	UNUSED_VARIABLE(allow_rdpmc);
+#endif
+
+	return eventset_id;
+}
+
+JNIEXPORT jint JNICALL
+Java_cz_cuni_mff_d3s_perf_Measurement_createEventSet(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class),
+	jint jmeasurements, jobjectArray jeventNames, jintArray joptions
+) {
+	// FIXME: where to properly compute this number
+	jmeasurements *= 2;
+
+	if (jmeasurements <= 0) {
+		do_throw(jni, "Number of measurements has to be positive.");
+		return -1;
+	}
+
+	size_t event_count = (*jni)->GetArrayLength(jni, jeventNames);
+	if (event_count == 0) {
+		do_throw(jni, "List of events cannot be empty.");
+		return -1;
+	}
+
+	jint eventset_id = reserve_eventset(jni);
+	if (eventset_id < 0) {
+		return -1;
+	}
+
+	eventset_t* eventset = get_eventset_entry(eventset_id);
+	jint result = init_eventset(jni, eventset, eventset_id, jmeasurements, event_count, jeventNames, joptions);
+	set_eventset_state(eventset, (result < 0) ? EVENTSET_FREE : EVENTSET_VALID);
+
+	return result;
+}
+
+#ifdef HAS_PERF_EVENTS
+/*
+ * Re-opens the LINUX counters of a freshly created event set so that they
+ * count events of the given thread instead of the calling one.
+ */
+static bool
+attach_linux_events(JNIEnv* jni, jclass measurement_class, jint eventset_index, native_tid_t native_id) {
+	benchmark_configuration_t* config = &get_eventset(eventset_index)->config;
+	bool inherit = !config->linux_grouped;
+
+	if (get_eventset(eventset_index)->process != NULL) {
+		Java_cz_cuni_mff_d3s_perf_Measurement_destroyEventSet(jni, measurement_class, eventset_index);
+		do_throw(jni, "Event sets measuring all threads cannot be attached.");
+		return false;
+	}
+
+	DEBUG_PRINTF("Trying to attach LINUX events of %d to %" PRId_NATIVE_TID ".", eventset_index, native_id);
+
+	ubench_perf_event_close(config);
+	int rc = ubench_perf_event_open(config, native_id, inherit, false);
+	if (rc != 0) {
+		Java_cz_cuni_mff_d3s_perf_Measurement_destroyEventSet(jni, measurement_class, eventset_index);
+		do_errno_throw(jni, rc, "perf_event_open");
+		return false;
+	}
+
+	return true;
+}
+#endif
+
+JNIEXPORT jint JNICALL
+Java_cz_cuni_mff_d3s_perf_Measurement_createAttachedEventSetWithJavaThread(
 	JNIEnv* jni, jclass measurement_class,
 	java_tid_t java_thread_id, jint jmeasurements, jobjectArray jeventNames, jintArray joptions
 ) {
 	jint eventset_index = Java_cz_cuni_mff_d3s_perf_Measurement_createEventSet(jni, measurement_class, jmeasurements, jeventNames, joptions);
+	if (eventset_index < 0) {
+		return -1;
+	}
 
-#ifdef HAS_PAPI
-	if ((all_eventsets[eventset_index].config.used_backends & UBENCH_EVENT_BACKEND_PAPI) > 0) {
-		native_tid_t native_id = ubench_threads_get_native_id(java_thread_id);
+#if defined(HAS_PAPI) || defined(HAS_PERF_EVENTS)
+	unsigned int attached_backends = UBENCH_EVENT_BACKEND_PAPI | UBENCH_EVENT_BACKEND_LINUX;
+	if ((get_eventset(eventset_index)->config.used_backends & attached_backends) == 0) {
+		return eventset_index;
+	}
 
-		if (native_id == UBENCH_THREAD_ID_INVALID) {
-			Java_cz_cuni_mff_d3s_perf_Measurement_destroyEventSet(jni, measurement_class, eventset_index);
-			do_throw(jni, "Unknown thread (not registered with PAPI).");
-			return -1;
-		}
+	native_tid_t native_id = ubench_threads_get_native_id(jni, java_thread_id);
+
+	if (native_id == UBENCH_THREAD_ID_INVALID) {
+		Java_cz_cuni_mff_d3s_perf_Measurement_destroyEventSet(jni, measurement_class, eventset_index);
+		do_throw(jni, "Unknown thread (not registered with PAPI).");
+		return -1;
+	}
+#else
+	UNUSED_VARIABLE(java_thread_id);
+#endif
 
+#ifdef HAS_PAPI
+	if ((get_eventset(eventset_index)->config.used_backends & UBENCH_EVENT_BACKEND_PAPI) > 0) {
 		DEBUG_PRINTF("Trying to attach %d to %" PRId_NATIVE_TID " (%" PRId_JAVA_TID ").", eventset_index, native_id, java_thread_id);
 
-		int rc = PAPI_attach(all_eventsets[eventset_index].config.papi_eventset, (unsigned long) native_id);
+		int rc = PAPI_attach(get_eventset(eventset_index)->config.papi_eventset, (unsigned long) native_id);
 		if (rc != PAPI_OK) {
 			Java_cz_cuni_mff_d3s_perf_Measurement_destroyEventSet(jni, measurement_class, eventset_index);
 			do_papi_error_throw(jni, rc, "PAPI_attach");
 			return -1;
 		}
-		DEBUG_PRINTF("Attached %d to %" PRId_NATIVE_TID " (%" PRId_JAVA_TID").", all_eventsets[eventset_index].config.papi_eventset, native_id, java_thread_id);
+		DEBUG_PRINTF("Attached %d to %" PRId_NATIVE_TID " (%" PRId_JAVA_TID").", get_eventset(eventset_index)->config.papi_eventset, native_id, java_thread_id);
+	}
+#endif
+
+#ifdef HAS_PERF_EVENTS
+	if ((get_eventset(eventset_index)->config.used_backends & UBENCH_EVENT_BACKEND_LINUX) > 0) {
+		if (!attach_linux_events(jni, measurement_class, eventset_index, native_id)) {
+			return -1;
+		}
 	}
-#else
-	UNUSED_VARIABLE(joptions);
-	UNUSED_VARIABLE(java_thread_id);
 #endif
 
 	return eventset_index;
@@ -381,44 +1011,544 @@ Java_cz_cuni_mff_d3s_perf_Measurement_createAttachedEventSetWithNativeThread(
 	java_tid_t jnative_thread_id, jint jmeasurements, jobjectArray jeventNames, jintArray joptions
 ) {
 	jint eventset_index = Java_cz_cuni_mff_d3s_perf_Measurement_createEventSet(jni, measurement_class, jmeasurements, jeventNames, joptions);
+	if (eventset_index < 0) {
+		return -1;
+	}
 
 #ifdef HAS_PAPI
-	if ((all_eventsets[eventset_index].config.used_backends & UBENCH_EVENT_BACKEND_PAPI) > 0) {
+	if ((get_eventset(eventset_index)->config.used_backends & UBENCH_EVENT_BACKEND_PAPI) > 0) {
 		native_tid_t native_thread_id = (native_tid_t) jnative_thread_id;
 		DEBUG_PRINTF("Trying to attach %d to %" PRId_NATIVE_TID ".", eventset_index, native_thread_id);
 
-		int rc = PAPI_attach(all_eventsets[eventset_index].config.papi_eventset, native_thread_id);
+		int rc = PAPI_attach(get_eventset(eventset_index)->config.papi_eventset, native_thread_id);
 		if (rc != PAPI_OK) {
 			Java_cz_cuni_mff_d3s_perf_Measurement_destroyEventSet(jni, measurement_class, eventset_index);
 			do_papi_error_throw(jni, rc, "PAPI_attach");
 			return -1;
 		}
-		DEBUG_PRINTF("Attached %d to %" PRId_NATIVE_TID ".", all_eventsets[eventset_index].config.papi_eventset, native_thread_id);
+		DEBUG_PRINTF("Attached %d to %" PRId_NATIVE_TID ".", get_eventset(eventset_index)->config.papi_eventset, native_thread_id);
+	}
+#endif
+
+#ifdef HAS_PERF_EVENTS
+	if ((get_eventset(eventset_index)->config.used_backends & UBENCH_EVENT_BACKEND_LINUX) > 0) {
+		if (!attach_linux_events(jni, measurement_class, eventset_index, (native_tid_t) jnative_thread_id)) {
+			return -1;
+		}
+	}
+#endif
+
+#if !defined(HAS_PAPI) && !defined(HAS_PERF_EVENTS)
+	UNUSED_VARIABLE(jnative_thread_id);
+#endif
+
+	return eventset_index;
+}
+
+JNIEXPORT void JNICALL
+Java_cz_cuni_mff_d3s_perf_Measurement_destroyEventSet(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jint jid
+) {
+	eventset_t* eventset = get_eventset(jid);
+	if (eventset == NULL) {
+		do_throw(jni, "Invalid event set id.");
+		return;
+	}
+
+#ifdef HAS_PERF_EVENTS
+	ubench_perf_event_close(&eventset->config);
+	if (eventset->process != NULL) {
+		ubench_perf_process_destroy(eventset->process);
+		eventset->process = NULL;
+	}
+#endif
+
+	free(eventset->config.used_events);
+	free_eventset_data(eventset);
+
+	ubench_spinlock_lock(&all_eventsets_lock);
+	eventset->generation++;
+	eventset->state = EVENTSET_FREE;
+	ubench_spinlock_unlock(&all_eventsets_lock);
+}
+
+/*
+ * Summary event sets keep the start record of the calling thread and fold
+ * the values into the running statistics when the measurement is stopped.
+ * The buffer index tells whether there is a pending start record.
+ */
+static void
+start_summary(eventset_t* eventset) {
+	thread_buffer_t* buffer = get_thread_buffer(eventset, ubench_measure_get_thread_id());
+	if (buffer == NULL) {
+		ubench_atomic_size_inc(&eventset->unbuffered_records);
+		return;
+	}
+
+	ubench_measure_start(&eventset->config, get_thread_buffer_data(buffer));
+	buffer->index = 1;
+}
+
+static void
+stop_summary(eventset_t* eventset) {
+	const benchmark_configuration_t* config = &eventset->config;
+
+	thread_buffer_t* buffer = get_thread_buffer(eventset, ubench_measure_get_thread_id());
+	if (buffer == NULL) {
+		ubench_atomic_size_inc(&eventset->unbuffered_records);
+		return;
+	}
+	if (buffer->index != 1) {
+		return;
+	}
+
+	const ubench_snapshot_slot_t* start = get_thread_buffer_data(buffer);
+	ubench_snapshot_slot_t* end = get_thread_buffer_data(buffer) + config->layout.size;
+	ubench_measure_stop(config, end);
+
+	ubench_summary_t* summaries = get_thread_buffer_summaries(config, buffer);
+	ubench_histogram_t* histograms = get_thread_buffer_histograms(config, buffer);
+	for (size_t i = 0; i < config->used_events_count; i++) {
+		const ubench_event_info_t* event = &config->used_events[i];
+		int64_t value = (int64_t) event->op_get(start, end, event);
+
+		ubench_summary_add(&summaries[i], value);
+		if (eventset->histogram) {
+			ubench_histogram_record(&histograms[i], value);
+		}
+	}
+	buffer->index = 0;
+}
+
+static inline void
+start_eventset(eventset_t* eventset) {
+#ifdef HAS_PERF_EVENTS
+	if (eventset->process != NULL) {
+		ubench_perf_process_start(eventset->process);
+		return;
+	}
+#endif
+	if (eventset->summary) {
+		start_summary(eventset);
+		return;
+	}
+
+	ubench_snapshot_slot_t* record = claim_record(eventset);
+	if (record != NULL) {
+		ubench_measure_start(&eventset->config, record);
+	}
+}
+
+static inline void
+stop_eventset(eventset_t* eventset) {
+#ifdef HAS_PERF_EVENTS
+	if (eventset->process != NULL) {
+		ubench_perf_process_stop(eventset->process);
+		return;
+	}
+#endif
+	if (eventset->summary) {
+		stop_summary(eventset);
+		return;
+	}
+
+	ubench_snapshot_slot_t* record = claim_record(eventset);
+	if (record != NULL) {
+		ubench_measure_stop(&eventset->config, record);
+	}
+}
+
+static inline void
+sample_eventset(eventset_t* eventset, int user_id) {
+	// Samples are not part of the summary (nor of process-wide sets).
+	if (eventset->summary) {
+		return;
+	}
+#ifdef HAS_PERF_EVENTS
+	if (eventset->process != NULL) {
+		return;
+	}
+#endif
+
+	ubench_snapshot_slot_t* record = claim_record(eventset);
+	if (record != NULL) {
+		ubench_measure_sample(&eventset->config, record, user_id);
+	}
+}
+
+/*
+ * Entry points for a single event set, used by MeasurementEntryPoints.
+ *
+ * The JavaCritical_ variants (of the critical* natives) are picked up
+ * automatically by HotSpot (up to JDK 17) for compiled callers, skipping
+ * the JNIEnv setup. The downcall_ variants are targets of java.lang.foreign
+ * downcalls on newer JDKs. As they cannot throw, they return -1 for an
+ * invalid event set id and the exception is thrown in Java instead.
+ *
+ * Critical natives and downcalls keep the thread in Java state, so event
+ * sets that call into the JVM or may block (see needs_jni) are refused
+ * there with NEEDS_JNI and Java retries through the plain JNI natives.
+ */
+
+static inline jint
+entry_point_start(jint jid, bool critical) {
+	eventset_t* eventset = get_eventset(jid);
+	if (eventset == NULL) {
+		return -1;
+	}
+	if (critical && eventset->needs_jni) {
+		return cz_cuni_mff_d3s_perf_MeasurementEntryPoints_NEEDS_JNI;
+	}
+
+	start_eventset(eventset);
+	return 0;
+}
+
+static inline jint
+entry_point_stop(jint jid, bool critical) {
+	eventset_t* eventset = get_eventset(jid);
+	if (eventset == NULL) {
+		return -1;
+	}
+	if (critical && eventset->needs_jni) {
+		return cz_cuni_mff_d3s_perf_MeasurementEntryPoints_NEEDS_JNI;
+	}
+
+	stop_eventset(eventset);
+	return 0;
+}
+
+static inline jint
+entry_point_sample(jint juser_id, jint jid, bool critical) {
+	eventset_t* eventset = get_eventset(jid);
+	if (eventset == NULL) {
+		return -1;
+	}
+	if (critical && eventset->needs_jni) {
+		return cz_cuni_mff_d3s_perf_MeasurementEntryPoints_NEEDS_JNI;
+	}
+
+	sample_eventset(eventset, (int) juser_id);
+	return 0;
+}
+
+JNIEXPORT jint JNICALL
+JavaCritical_cz_cuni_mff_d3s_perf_MeasurementEntryPoints_criticalStart(jint jid) {
+	return entry_point_start(jid, true);
+}
+
+JNIEXPORT jint JNICALL
+JavaCritical_cz_cuni_mff_d3s_perf_MeasurementEntryPoints_criticalStop(jint jid) {
+	return entry_point_stop(jid, true);
+}
+
+JNIEXPORT jint JNICALL
+JavaCritical_cz_cuni_mff_d3s_perf_MeasurementEntryPoints_criticalSample(jint juser_id, jint jid) {
+	return entry_point_sample(juser_id, jid, true);
+}
+
+static jint
+downcall_start(jint jid) {
+	return entry_point_start(jid, true);
+}
+
+static jint
+downcall_stop(jint jid) {
+	return entry_point_stop(jid, true);
+}
+
+static jint
+downcall_sample(jint juser_id, jint jid) {
+	return entry_point_sample(juser_id, jid, true);
+}
+
+/* Without a critical variant in use (e.g. interpreted callers). */
+JNIEXPORT jint JNICALL
+Java_cz_cuni_mff_d3s_perf_MeasurementEntryPoints_criticalStart(
+	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(entry_points_class), jint jid
+) {
+	return entry_point_start(jid, false);
+}
+
+JNIEXPORT jint JNICALL
+Java_cz_cuni_mff_d3s_perf_MeasurementEntryPoints_criticalStop(
+	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(entry_points_class), jint jid
+) {
+	return entry_point_stop(jid, false);
+}
+
+JNIEXPORT jint JNICALL
+Java_cz_cuni_mff_d3s_perf_MeasurementEntryPoints_criticalSample(
+	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(entry_points_class), jint juser_id, jint jid
+) {
+	return entry_point_sample(juser_id, jid, false);
+}
+
+JNIEXPORT jint JNICALL
+Java_cz_cuni_mff_d3s_perf_MeasurementEntryPoints_nativeStart(
+	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(entry_points_class), jint jid
+) {
+	return entry_point_start(jid, false);
+}
+
+JNIEXPORT jint JNICALL
+Java_cz_cuni_mff_d3s_perf_MeasurementEntryPoints_nativeStop(
+	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(entry_points_class), jint jid
+) {
+	return entry_point_stop(jid, false);
+}
+
+JNIEXPORT jint JNICALL
+Java_cz_cuni_mff_d3s_perf_MeasurementEntryPoints_nativeSample(
+	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(entry_points_class), jint juser_id, jint jid
+) {
+	return entry_point_sample(juser_id, jid, false);
+}
+
+JNIEXPORT jlong JNICALL
+Java_cz_cuni_mff_d3s_perf_MeasurementEntryPoints_getDowncallAddress(
+	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(entry_points_class), jint jentry_point
+) {
+	switch (jentry_point) {
+	case cz_cuni_mff_d3s_perf_MeasurementEntryPoints_START:
+		return (jlong) (intptr_t) downcall_start;
+	case cz_cuni_mff_d3s_perf_MeasurementEntryPoints_STOP:
+		return (jlong) (intptr_t) downcall_stop;
+	case cz_cuni_mff_d3s_perf_MeasurementEntryPoints_SAMPLE:
+		return (jlong) (intptr_t) downcall_sample;
+	default:
+		return 0;
+	}
+}
+
+JNIEXPORT void JNICALL
+Java_cz_cuni_mff_d3s_perf_Measurement_start___3I(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jintArray jids
+) {
+	size_t jids_count = (*jni)->GetArrayLength(jni, jids);
+	if (jids_count == 0) {
+		return;
+	}
+
+	jint* ids = (*jni)->GetIntArrayElements(jni, jids, NULL);
+	for (size_t i = 0; i < jids_count; i++) {
+		eventset_t* eventset = get_eventset(ids[i]);
+		if (eventset == NULL) {
+			do_throw(jni, "Invalid event set id.");
+			break;
+		}
+
+		start_eventset(eventset);
+	}
+
+	(*jni)->ReleaseIntArrayElements(jni, jids, ids, JNI_ABORT);
+}
+
+JNIEXPORT void JNICALL
+Java_cz_cuni_mff_d3s_perf_Measurement_stop___3I(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jintArray jids
+) {
+	size_t jids_count = (*jni)->GetArrayLength(jni, jids);
+	if (jids_count == 0) {
+		return;
+	}
+
+	jint* ids = (*jni)->GetIntArrayElements(jni, jids, NULL);
+	for (size_t i = 0; i < jids_count; i++) {
+		eventset_t* eventset = get_eventset(ids[i]);
+		if (eventset == NULL) {
+			do_throw(jni, "Invalid event set id.");
+			break;
+		}
+
+		stop_eventset(eventset);
+	}
+
+	(*jni)->ReleaseIntArrayElements(jni, jids, ids, JNI_ABORT);
+}
+
+JNIEXPORT void JNICALL
+Java_cz_cuni_mff_d3s_perf_Measurement_sample__I_3I(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jint juser_id, jintArray jids
+) {
+	size_t jids_count = (*jni)->GetArrayLength(jni, jids);
+	if (jids_count == 0) {
+		return;
+	}
+
+	jint* ids = (*jni)->GetIntArrayElements(jni, jids, NULL);
+	for (size_t i = 0; i < jids_count; i++) {
+		eventset_t* eventset = get_eventset(ids[i]);
+		if (eventset == NULL) {
+			do_throw(jni, "Invalid event set id.");
+			break;
+		}
+
+		sample_eventset(eventset, (int) juser_id);
+	}
+
+	(*jni)->ReleaseIntArrayElements(jni, jids, ids, JNI_ABORT);
+}
+
+/*
+ * Event set groups are arrays of event sets resolved (and validated) once
+ * when the group is created, so that starting or stopping all of them is a
+ * single native call that does not touch any Java array.
+ *
+ * As with event sets, destroying a group must not race with its start,
+ * stop or sample (the group is freed immediately).
+ */
+#define EVENTSET_GROUPS_MAX 1024
+
+typedef struct {
+	eventset_t* eventset;
+	// Generation of the event set when the group was created.
+	unsigned int generation;
+} eventset_group_member_t;
+
+typedef struct {
+	size_t count;
+	eventset_group_member_t* members;
+} eventset_group_t;
+
+static eventset_group_t* volatile all_eventset_groups[EVENTSET_GROUPS_MAX];
+
+static inline eventset_group_t*
+get_eventset_group(jint id) {
+	if ((id < 0) || (id >= EVENTSET_GROUPS_MAX)) {
+		return NULL;
+	}
+	return all_eventset_groups[id];
+}
+
+/*
+ * Checks that no event set of the group was destroyed in the meantime
+ * (even if its slot was reused by a new event set).
+ */
+static inline bool
+is_eventset_group_valid(const eventset_group_t* group) {
+	for (size_t i = 0; i < group->count; i++) {
+		const eventset_group_member_t* member = &group->members[i];
+		if ((member->eventset->state != EVENTSET_VALID) || (member->eventset->generation != member->generation)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+JNIEXPORT jint JNICALL
+Java_cz_cuni_mff_d3s_perf_Measurement_createEventSetGroup(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jintArray jids
+) {
+	size_t jids_count = (*jni)->GetArrayLength(jni, jids);
+	if (jids_count == 0) {
+		do_throw(jni, "List of event sets cannot be empty.");
+		return -1;
+	}
+
+	eventset_group_t* group = malloc(sizeof(eventset_group_t) + jids_count * sizeof(eventset_group_member_t));
+	if (group == NULL) {
+		THROW_OOM(jni, "allocating an event set group");
+		return -1;
+	}
+	group->count = jids_count;
+	group->members = (eventset_group_member_t*) (group + 1);
+
+	jint* ids = (*jni)->GetIntArrayElements(jni, jids, NULL);
+	for (size_t i = 0; i < jids_count; i++) {
+		eventset_t* eventset = get_eventset(ids[i]);
+		group->members[i].eventset = eventset;
+		if (eventset == NULL) {
+			(*jni)->ReleaseIntArrayElements(jni, jids, ids, JNI_ABORT);
+			free(group);
+			do_throw(jni, "Invalid event set id.");
+			return -1;
+		}
+		group->members[i].generation = eventset->generation;
+	}
+	(*jni)->ReleaseIntArrayElements(jni, jids, ids, JNI_ABORT);
+
+	ubench_spinlock_lock(&all_eventsets_lock);
+	for (jint id = 0; id < EVENTSET_GROUPS_MAX; id++) {
+		if (all_eventset_groups[id] == NULL) {
+			all_eventset_groups[id] = group;
+			ubench_spinlock_unlock(&all_eventsets_lock);
+			return id;
+		}
+	}
+	ubench_spinlock_unlock(&all_eventsets_lock);
+
+	free(group);
+	do_throw(jni, "Too many event set groups.");
+	return -1;
+}
+
+JNIEXPORT void JNICALL
+Java_cz_cuni_mff_d3s_perf_Measurement_destroyEventSetGroup(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jint jid
+) {
+	ubench_spinlock_lock(&all_eventsets_lock);
+	eventset_group_t* group = get_eventset_group(jid);
+	if (group != NULL) {
+		all_eventset_groups[jid] = NULL;
+	}
+	ubench_spinlock_unlock(&all_eventsets_lock);
+
+	if (group == NULL) {
+		do_throw(jni, "Invalid event set group id.");
+		return;
+	}
+
+	free(group);
+}
+
+JNIEXPORT void JNICALL
+Java_cz_cuni_mff_d3s_perf_Measurement_startGroup(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jint jid
+) {
+	eventset_group_t* group = get_eventset_group(jid);
+	if ((group == NULL) || !is_eventset_group_valid(group)) {
+		do_throw(jni, "Invalid event set group id.");
+		return;
 	}
-#else
-	UNUSED_VARIABLE(joptions);
-	UNUSED_VARIABLE(jnative_thread_id);
-#endif
 
-	return eventset_index;
+	for (size_t i = 0; i < group->count; i++) {
+		start_eventset(group->members[i].eventset);
+	}
 }
 
 JNIEXPORT void JNICALL
-Java_cz_cuni_mff_d3s_perf_Measurement_destroyEventSet(
+Java_cz_cuni_mff_d3s_perf_Measurement_stopGroup(
 	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jint jid
 ) {
-	if ((jid < 0) || (jid >= all_eventset_count) || !all_eventsets[jid].valid) {
-		do_throw(jni, "Invalid event set id.");
+	eventset_group_t* group = get_eventset_group(jid);
+	if ((group == NULL) || !is_eventset_group_valid(group)) {
+		do_throw(jni, "Invalid event set group id.");
+		return;
+	}
+
+	for (size_t i = 0; i < group->count; i++) {
+		stop_eventset(group->members[i].eventset);
+	}
+}
+
+JNIEXPORT void JNICALL
+Java_cz_cuni_mff_d3s_perf_Measurement_sampleGroup(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jint juser_id, jint jid
+) {
+	eventset_group_t* group = get_eventset_group(jid);
+	if ((group == NULL) || !is_eventset_group_valid(group)) {
+		do_throw(jni, "Invalid event set group id.");
 		return;
 	}
 
-	free(all_eventsets[jid].config.used_events);
-	free(all_eventsets[jid].config.data);
-	all_eventsets[jid].valid = 0;
+	for (size_t i = 0; i < group->count; i++) {
+		sample_eventset(group->members[i].eventset, (int) juser_id);
+	}
 }
 
 JNIEXPORT void JNICALL
-Java_cz_cuni_mff_d3s_perf_Measurement_start(
+Java_cz_cuni_mff_d3s_perf_Measurement_reset(
 	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jintArray jids
 ) {
 	size_t jids_count = (*jni)->GetArrayLength(jni, jids);
@@ -428,271 +1558,585 @@ Java_cz_cuni_mff_d3s_perf_Measurement_start(
 
 	jint* ids = (*jni)->GetIntArrayElements(jni, jids, NULL);
 	for (size_t i = 0; i < jids_count; i++) {
-		jint id = ids[i];
-
-		if ((id < 0) || (id >= all_eventset_count) || !all_eventsets[id].valid) {
+		eventset_t* eventset = get_eventset(ids[i]);
+		if (eventset == NULL) {
 			do_throw(jni, "Invalid event set id.");
-			return;
+			break;
 		}
 
-		if (all_eventsets[id].config.data_size == 0) {
-			continue;
+		ubench_atomic_size_set(&eventset->config.data_index, 0);
+		ubench_atomic_size_set(&eventset->unbuffered_records, 0);
+		if (eventset->thread_buffers != NULL) {
+			reset_thread_buffers(eventset);
 		}
-
-		if (all_eventsets[id].config.data_index >= all_eventsets[id].config.data_size) {
-			all_eventsets[id].config.data_index -= 2;
+#ifdef HAS_PERF_EVENTS
+		if (eventset->process != NULL) {
+			ubench_perf_process_reset(eventset->process);
 		}
-
-		ubench_events_snapshot_t* snapshot = &all_eventsets[id].config.data[all_eventsets[id].config.data_index];
-
-		ubench_measure_start(&all_eventsets[id].config, snapshot);
-		all_eventsets[id].config.data_index++;
+#endif
+#ifdef HAS_MMAP
+		if (eventset->config.spill != NULL) {
+			ubench_spill_reset(&eventset->config);
+		}
+#endif
 	}
 
 	(*jni)->ReleaseIntArrayElements(jni, jids, ids, JNI_ABORT);
 }
 
-JNIEXPORT void JNICALL
-Java_cz_cuni_mff_d3s_perf_Measurement_stop(
-	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jintArray jids
-) {
-	size_t jids_count = (*jni)->GetArrayLength(jni, jids);
-	if (jids_count == 0) {
+/*
+ * Number of records written so far (claimed records that did not fit
+ * into the buffer overwrote the last ones).
+ */
+static size_t
+get_record_count(const benchmark_configuration_t* config) {
+	size_t count = ubench_atomic_size_get(&config->data_index);
+	return (count < config->data_size) ? count : config->data_size;
+}
+
+typedef void (*record_buffer_callback_t)(const benchmark_configuration_t*, const ubench_snapshot_slot_t*, size_t, void*);
+
+/*
+ * Calls the callback with records of every buffer of the event set, i.e.
+ * either with the shared buffer or with buffers of the individual threads
+ * (ordered by their thread ids).
+ */
+static void
+iterate_record_buffers(const eventset_t* eventset, record_buffer_callback_t callback, void* arg) {
+	const benchmark_configuration_t* config = &eventset->config;
+
+#ifdef HAS_PERF_EVENTS
+	if (eventset->process != NULL) {
+		size_t count;
+		const ubench_snapshot_slot_t* records = ubench_perf_process_get_records(eventset->process, &count);
+		callback(config, records, count, arg);
 		return;
 	}
+#endif
 
-	jint* ids = (*jni)->GetIntArrayElements(jni, jids, NULL);
-	for (size_t i = 0; i < jids_count; i++) {
-		jint id = ids[i];
+	if (eventset->thread_buffers == NULL) {
+		callback(config, config->data, get_record_count(config), arg);
+		return;
+	}
 
-		if ((id < 0) || (id >= all_eventset_count) || !all_eventsets[id].valid) {
-			do_throw(jni, "Invalid event set id.");
-			return;
+	for (size_t i = 0; i < THREAD_BUFFER_MAX_CHUNKS; i++) {
+		thread_buffer_chunk_t* chunk = eventset->thread_buffers[i];
+		if (chunk == NULL) {
+			continue;
+		}
+		for (size_t j = 0; j < THREAD_BUFFER_CHUNK_SIZE; j++) {
+			thread_buffer_t* buffer = chunk->buffers[j];
+			if (buffer == NULL) {
+				continue;
+			}
+			size_t count = (buffer->index < config->data_size) ? buffer->index : config->data_size;
+			callback(config, get_thread_buffer_data(buffer), count, arg);
 		}
+	}
+}
+
+static size_t
+count_overflowing_records(size_t claimed, size_t size) {
+	return (claimed > size) ? claimed - size : 0;
+}
 
-		ubench_events_snapshot_t* snapshot = &all_eventsets[id].config.data[all_eventsets[id].config.data_index];
+/*
+ * Number of records lost because they did not fit into the buffer (of the
+ * event set or of any of its threads) or because the thread got no buffer.
+ */
+static size_t
+get_dropped_record_count(const eventset_t* eventset) {
+	const benchmark_configuration_t* config = &eventset->config;
+
+#ifdef HAS_PERF_EVENTS
+	if (eventset->process != NULL) {
+		return 0;
+	}
+#endif
 
-		ubench_measure_stop(&all_eventsets[id].config, snapshot);
+	if (eventset->thread_buffers == NULL) {
+		return count_overflowing_records(ubench_atomic_size_get(&config->data_index), config->data_size);
+	}
 
-		all_eventsets[id].config.data_index++;
+	size_t dropped = ubench_atomic_size_get(&eventset->unbuffered_records);
+	if (eventset->summary) {
+		// Only the pending measurement is kept, nothing overflows.
+		return dropped;
 	}
 
-	(*jni)->ReleaseIntArrayElements(jni, jids, ids, JNI_ABORT);
+	for (size_t i = 0; i < THREAD_BUFFER_MAX_CHUNKS; i++) {
+		thread_buffer_chunk_t* chunk = eventset->thread_buffers[i];
+		if (chunk == NULL) {
+			continue;
+		}
+		for (size_t j = 0; j < THREAD_BUFFER_CHUNK_SIZE; j++) {
+			if (chunk->buffers[j] != NULL) {
+				dropped += count_overflowing_records(chunk->buffers[j]->index, config->data_size);
+			}
+		}
+	}
+
+	return dropped;
 }
 
-JNIEXPORT void JNICALL
-Java_cz_cuni_mff_d3s_perf_Measurement_sample(
-	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jint juser_id, jintArray jids
+static inline const ubench_snapshot_slot_t*
+get_record(const benchmark_configuration_t* config, const ubench_snapshot_slot_t* records, size_t index) {
+	return records + index * config->layout.size;
+}
+
+/*
+ * Finds the end record matching the start record with the given index,
+ * i.e., the next end record of the same thread. Returns (size_t) -1 when
+ * the thread started another measurement first or did not stop yet.
+ */
+static size_t
+find_matching_end_snapshot(
+	const benchmark_configuration_t* config, const ubench_snapshot_slot_t* records,
+	size_t start_index, size_t max_index
 ) {
-	size_t jids_count = (*jni)->GetArrayLength(jni, jids);
-	if (jids_count == 0) {
-		return;
+	ubench_snapshot_slot_t thread = get_record(config, records, start_index)[UBENCH_SNAPSHOT_SLOT_THREAD];
+	for (size_t i = start_index + 1; i < max_index; i++) {
+		const ubench_snapshot_slot_t* record = get_record(config, records, i);
+		if (record[UBENCH_SNAPSHOT_SLOT_THREAD] != thread) {
+			continue;
+		}
+		if (record[UBENCH_SNAPSHOT_SLOT_TYPE] == UBENCH_SNAPSHOT_TYPE_END) {
+			return i;
+		}
+		if (record[UBENCH_SNAPSHOT_SLOT_TYPE] == UBENCH_SNAPSHOT_TYPE_START) {
+			break;
+		}
 	}
+	return (size_t) -1;
+}
 
-	jint* ids = (*jni)->GetIntArrayElements(jni, jids, NULL);
-	for (size_t i = 0; i < jids_count; i++) {
-		jint id = ids[i];
+/*
+ * Rows of the results, collected first so that the number of rows is known
+ * before the values are exported column by column. Measurements are pairs
+ * of start and end records, raw results use only the start record.
+ */
+typedef struct {
+	ubench_snapshot_pair_t* rows;
+	size_t count;
+	size_t capacity;
+	bool failed;
+} result_rows_t;
+
+static bool
+add_result_row(result_rows_t* rows, const ubench_snapshot_slot_t* start, const ubench_snapshot_slot_t* end) {
+	if (rows->count == rows->capacity) {
+		size_t capacity = (rows->capacity == 0) ? 1024 : 2 * rows->capacity;
+		ubench_snapshot_pair_t* grown = realloc(rows->rows, capacity * sizeof(ubench_snapshot_pair_t));
+		if (grown == NULL) {
+			rows->failed = true;
+			return false;
+		}
+		rows->rows = grown;
+		rows->capacity = capacity;
+	}
 
-		if ((id < 0) || (id >= all_eventset_count) || !all_eventsets[id].valid) {
-			do_throw(jni, "Invalid event set id.");
-			return;
+	rows->rows[rows->count].start = start;
+	rows->rows[rows->count].end = end;
+	rows->count++;
+	return true;
+}
+
+static void
+collect_measurement_rows(
+	const benchmark_configuration_t* config, const ubench_snapshot_slot_t* records,
+	size_t count, void* arg
+) {
+	result_rows_t* rows = arg;
+
+	for (size_t i = 0; i < count; i++) {
+		const ubench_snapshot_slot_t* start = get_record(config, records, i);
+		if (start[UBENCH_SNAPSHOT_SLOT_TYPE] != UBENCH_SNAPSHOT_TYPE_START) {
+			continue;
 		}
 
-		if (all_eventsets[id].config.data_size == 0) {
+		size_t end_index = find_matching_end_snapshot(config, records, i, count);
+		if (end_index == (size_t) -1) {
 			continue;
 		}
 
-		if (all_eventsets[id].config.data_index >= all_eventsets[id].config.data_size) {
-			all_eventsets[id].config.data_index -= 2;
+		if (!add_result_row(rows, start, get_record(config, records, end_index))) {
+			return;
 		}
+	}
+}
 
-		ubench_events_snapshot_t* snapshot = &all_eventsets[id].config.data[all_eventsets[id].config.data_index];
+static void
+collect_raw_rows(
+	const benchmark_configuration_t* config, const ubench_snapshot_slot_t* records,
+	size_t count, void* arg
+) {
+	result_rows_t* rows = arg;
 
-		ubench_measure_sample(&all_eventsets[id].config, snapshot, (int) juser_id);
-		all_eventsets[id].config.data_index++;
+	for (size_t i = 0; i < count; i++) {
+		if (!add_result_row(rows, get_record(config, records, i), NULL)) {
+			return;
+		}
 	}
-
-	(*jni)->ReleaseIntArrayElements(jni, jids, ids, JNI_ABORT);
 }
 
-JNIEXPORT void JNICALL
-Java_cz_cuni_mff_d3s_perf_Measurement_reset(
-	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jintArray jids
+/*
+ * Creates BenchmarkResultsImpl with the given rows. Columns are the events
+ * of the event set (differences of start and end records or raw values of
+ * start records only) followed by extra columns that copy the given slots
+ * of the start records.
+ *
+ * All the values are passed in a single Java array, column after column.
+ * Each column is computed into a native buffer and copied with one call.
+ * Event columns of measurements are computed by the column getters that
+ * process the whole column at once (see kernels.c).
+ */
+static jobject
+export_results(
+	JNIEnv* jni, const benchmark_configuration_t* config, const result_rows_t* rows, bool raw,
+	const char** extra_columns, const size_t* extra_slots, size_t extra_column_count
 ) {
-	size_t jids_count = (*jni)->GetArrayLength(jni, jids);
-	if (jids_count == 0) {
-		return;
+	jclass results_class = (*jni)->FindClass(jni, "cz/cuni/mff/d3s/perf/BenchmarkResultsImpl");
+	if (results_class == NULL) {
+		return NULL;
+	}
+	jclass string_class = (*jni)->FindClass(jni, "java/lang/String");
+	if (string_class == NULL) {
+		return NULL;
+	}
+	jmethodID constructor = (*jni)->GetMethodID(jni, results_class, "<init>", "([Ljava/lang/String;I[J)V");
+	if (constructor == NULL) {
+		return NULL;
 	}
 
-	jint* ids = (*jni)->GetIntArrayElements(jni, jids, NULL);
-	for (size_t i = 0; i < jids_count; i++) {
-		jint id = ids[i];
-
-		if ((id < 0) || (id >= all_eventset_count) || !all_eventsets[id].valid) {
-			do_throw(jni, "Invalid event set id.");
-			return;
-		}
+	size_t column_count = config->used_events_count + extra_column_count;
+	if ((rows->count > 0) && (column_count > (size_t) INT32_MAX / rows->count)) {
+		do_throw(jni, "Too many results to export.");
+		return NULL;
+	}
 
-		all_eventsets[id].config.data_index = 0;
+	jobjectArray jevent_names = (jobjectArray) (*jni)->NewObjectArray(jni, (jsize) column_count, string_class, NULL);
+	if (jevent_names == NULL) {
+		return NULL;
+	}
+	for (size_t i = 0; i < config->used_events_count; i++) {
+		(*jni)->SetObjectArrayElement(jni, jevent_names, (jsize) i, (*jni)->NewStringUTF(jni, config->used_events[i].name));
+	}
+	for (size_t i = 0; i < extra_column_count; i++) {
+		(*jni)->SetObjectArrayElement(jni, jevent_names, (jsize) (config->used_events_count + i), (*jni)->NewStringUTF(jni, extra_columns[i]));
 	}
 
-	(*jni)->ReleaseIntArrayElements(jni, jids, ids, JNI_ABORT);
-}
+	jlongArray jvalues = (*jni)->NewLongArray(jni, (jsize) (column_count * rows->count));
+	if (jvalues == NULL) {
+		return NULL;
+	}
 
-static size_t
-find_first_matching_snapshot_type(ubench_events_snapshot_t* snapshots, size_t start_index, size_t max_index, int type) {
-	if (start_index == (size_t) -1) {
-		return (size_t) -1;
+	int64_t* column = malloc((rows->count > 0 ? rows->count : 1) * sizeof(int64_t));
+	if (column == NULL) {
+		THROW_OOM(jni, "exporting results");
+		return NULL;
 	}
-	size_t i = start_index;
-	while (i < max_index) {
-		if (snapshots[i].type == type) {
-			return i;
+
+	for (size_t c = 0; c < column_count; c++) {
+		if (c < config->used_events_count) {
+			const ubench_event_info_t* event = &config->used_events[c];
+			// FIXME: report PAPI errors etc.
+			if (raw) {
+				for (size_t r = 0; r < rows->count; r++) {
+					column[r] = (int64_t) event->op_get_raw(rows->rows[r].start, event);
+				}
+			} else {
+				event->op_get_column(rows->rows, rows->count, column, event);
+			}
+		} else {
+			size_t slot = extra_slots[c - config->used_events_count];
+			for (size_t r = 0; r < rows->count; r++) {
+				column[r] = (int64_t) rows->rows[r].start[slot];
+			}
 		}
-		i++;
+
+		(*jni)->SetLongArrayRegion(jni, jvalues, (jsize) (c * rows->count), (jsize) rows->count, (const jlong*) column);
 	}
-	return (size_t) -1;
+
+	free(column);
+
+	return (*jni)->NewObject(jni, results_class, constructor, jevent_names, (jint) rows->count, jvalues);
 }
 
 JNIEXPORT jobject JNICALL
 Java_cz_cuni_mff_d3s_perf_Measurement_getResults(
 	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jint jid
 ) {
-	if ((jid < 0) || (jid >= all_eventset_count) || !all_eventsets[jid].valid) {
+	eventset_t* eventset = get_eventset(jid);
+	if (eventset == NULL) {
 		do_throw(jni, "Invalid event set id.");
 		return NULL;
 	}
 
-	jmethodID constructor;
-	jclass results_class = (*jni)->FindClass(jni, "cz/cuni/mff/d3s/perf/BenchmarkResultsImpl");
-	if (results_class == NULL) {
-		return NULL;
-	}
-	jclass string_class = (*jni)->FindClass(jni, "java/lang/String");
-	if (string_class == NULL) {
+	result_rows_t rows = { NULL, 0, 0, false };
+	iterate_record_buffers(eventset, collect_measurement_rows, &rows);
+	if (rows.failed) {
+		free(rows.rows);
+		THROW_OOM(jni, "collecting results");
 		return NULL;
 	}
 
-	jobjectArray jevent_names = (jobjectArray) (*jni)->NewObjectArray(jni, (jsize) all_eventsets[jid].config.used_events_count, string_class, NULL);
-	size_t i;
-	for (i = 0; i < all_eventsets[jid].config.used_events_count; i++) {
-		(*jni)->SetObjectArrayElement(jni, jevent_names, (jsize) i, (*jni)->NewStringUTF(jni, all_eventsets[jid].config.used_events[i].name));
+	// Per-thread buffers are merged, every row tells its thread (process-wide
+	// event sets report native thread ids).
+	const char* extra_columns[] = { "THREAD" };
+	const size_t extra_slots[] = { UBENCH_SNAPSHOT_SLOT_THREAD };
+	size_t extra_column_count = (eventset->thread_buffers != NULL) ? 1 : 0;
+#ifdef HAS_PERF_EVENTS
+	if (eventset->process != NULL) {
+		extra_column_count = 1;
 	}
+#endif
 
+	jobject jresults = export_results(jni, &eventset->config, &rows, false, extra_columns, extra_slots, extra_column_count);
+	free(rows.rows);
 
-	constructor = (*jni)->GetMethodID(jni, results_class, "<init>", "([Ljava/lang/String;)V");
-	if (constructor == NULL) {
+	return jresults;
+}
+
+JNIEXPORT jobject JNICALL
+Java_cz_cuni_mff_d3s_perf_Measurement_getRawResults(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jint jid
+) {
+	eventset_t* eventset = get_eventset(jid);
+	if (eventset == NULL) {
+		do_throw(jni, "Invalid event set id.");
 		return NULL;
 	}
 
-	jobject jresults = (*jni)->NewObject(jni, results_class, constructor, jevent_names);
-	if (jresults == NULL) {
+	result_rows_t rows = { NULL, 0, 0, false };
+	iterate_record_buffers(eventset, collect_raw_rows, &rows);
+	if (rows.failed) {
+		free(rows.rows);
+		THROW_OOM(jni, "collecting results");
 		return NULL;
 	}
 
-	jlongArray event_values = (*jni)->NewLongArray(jni, (jsize) all_eventsets[jid].config.used_events_count);
-	if (event_values == NULL) {
-		return NULL;
+	const char* extra_columns[] = { "THREAD", "TYPE" };
+	const size_t extra_slots[] = { UBENCH_SNAPSHOT_SLOT_THREAD, UBENCH_SNAPSHOT_SLOT_TYPE };
+
+	jobject jresults = export_results(jni, &eventset->config, &rows, true, extra_columns, extra_slots, 2);
+	free(rows.rows);
+
+	return jresults;
+}
+
+JNIEXPORT jlong JNICALL
+Java_cz_cuni_mff_d3s_perf_Measurement_getDroppedRecordCount(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jint jid
+) {
+	eventset_t* eventset = get_eventset(jid);
+	if (eventset == NULL) {
+		do_throw(jni, "Invalid event set id.");
+		return 0;
 	}
-	jmethodID add_data_method = (*jni)->GetMethodID(jni, results_class, "addDataRow", "([J)V");
-	if (add_data_method == NULL) {
+
+	return (jlong) get_dropped_record_count(eventset);
+}
+
+JNIEXPORT jobject JNICALL
+Java_cz_cuni_mff_d3s_perf_Measurement_getAllocationSamples(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jint jid
+) {
+	eventset_t* eventset = get_eventset(jid);
+	if (eventset == NULL) {
+		do_throw(jni, "Invalid event set id.");
 		return NULL;
 	}
 
-	i = 0;
-	size_t i_max = all_eventsets[jid].config.data_index;
-	while (i < i_max) {
-		ubench_events_snapshot_t* snapshots = all_eventsets[jid].config.data;
-		size_t start_index = find_first_matching_snapshot_type(snapshots, i, i_max, UBENCH_SNAPSHOT_TYPE_START);
-		size_t end_index = find_first_matching_snapshot_type(snapshots, start_index, i_max, UBENCH_SNAPSHOT_TYPE_END);
+	const benchmark_configuration_t* config = &eventset->config;
+	if ((config->used_backends & UBENCH_EVENT_BACKEND_JVM_ALLOC_SAMPLES) == 0) {
+		do_throw(jni, "Event set does not contain JVM:alloc-samples.");
+		return NULL;
+	}
 
-		if (end_index == (size_t) -1) {
-			break;
-		}
+	// Rows are in the same order as in getResults.
+	result_rows_t rows = { NULL, 0, 0, false };
+	iterate_record_buffers(eventset, collect_measurement_rows, &rows);
+	if (rows.failed) {
+		free(rows.rows);
+		THROW_OOM(jni, "collecting results");
+		return NULL;
+	}
 
-		i = end_index + 1;
+	ubench_interval_t* intervals = malloc((rows.count > 0 ? rows.count : 1) * sizeof(ubench_interval_t));
+	if (intervals == NULL) {
+		free(rows.rows);
+		THROW_OOM(jni, "collecting measured intervals");
+		return NULL;
+	}
 
-		size_t ei;
-		for (ei = 0; ei < all_eventsets[jid].config.used_events_count; ei++) {
-			ubench_event_info_t* event = &all_eventsets[jid].config.used_events[ei];
-			long long value = event->op_get(&snapshots[start_index], &snapshots[end_index], event);
-			jlong jvalue = (jlong) value;
-			// FIXME: report PAPI errors etc.
-			(*jni)->SetLongArrayRegion(jni, event_values, (jsize) ei, 1, &jvalue);
-		}
+	size_t timestamp_slot = config->layout.alloc_samples + 1;
+	for (size_t i = 0; i < rows.count; i++) {
+		intervals[i].thread = rows.rows[i].start[UBENCH_SNAPSHOT_SLOT_THREAD];
+		intervals[i].start = rows.rows[i].start[timestamp_slot];
+		intervals[i].end = rows.rows[i].end[timestamp_slot];
+		intervals[i].index = (int64_t) i;
+	}
+	free(rows.rows);
 
-		(*jni)->CallVoidMethod(jni, jresults, add_data_method, event_values);
+	jobject jsamples = ubench_alloc_samples_export(jni, intervals, rows.count);
+	free(intervals);
+	if ((jsamples == NULL) && !(*jni)->ExceptionCheck(jni)) {
+		THROW_OOM(jni, "copying allocation samples");
 	}
 
-	return jresults;
+	return jsamples;
 }
 
 JNIEXPORT jobject JNICALL
-Java_cz_cuni_mff_d3s_perf_Measurement_getRawResults(
+Java_cz_cuni_mff_d3s_perf_Measurement_getSummary(
 	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jint jid
 ) {
-	if ((jid < 0) || (jid >= all_eventset_count) || !all_eventsets[jid].valid) {
+	eventset_t* eventset = get_eventset(jid);
+	if (eventset == NULL) {
 		do_throw(jni, "Invalid event set id.");
 		return NULL;
 	}
+	if (!eventset->summary) {
+		do_throw(jni, "Event set was not created with SUMMARY.");
+		return NULL;
+	}
 
-	jmethodID constructor;
-	jclass results_class = (*jni)->FindClass(jni, "cz/cuni/mff/d3s/perf/BenchmarkResultsImpl");
-	if (results_class == NULL) {
+	const benchmark_configuration_t* config = &eventset->config;
+	jsize event_count = (jsize) config->used_events_count;
+
+	jclass summary_class = (*jni)->FindClass(jni, "cz/cuni/mff/d3s/perf/BenchmarkSummary");
+	if (summary_class == NULL) {
 		return NULL;
 	}
 	jclass string_class = (*jni)->FindClass(jni, "java/lang/String");
 	if (string_class == NULL) {
 		return NULL;
 	}
+	jmethodID constructor = (*jni)->GetMethodID(jni, summary_class, "<init>", "([Ljava/lang/String;[J[D[D[J[J[J)V");
+	if (constructor == NULL) {
+		return NULL;
+	}
+
+	ubench_summary_t* totals = malloc(config->used_events_count * sizeof(ubench_summary_t));
+	if (totals == NULL) {
+		THROW_OOM(jni, "merging summaries");
+		return NULL;
+	}
+	for (size_t i = 0; i < config->used_events_count; i++) {
+		ubench_summary_reset(&totals[i]);
+	}
+
+	for (size_t i = 0; i < THREAD_BUFFER_MAX_CHUNKS; i++) {
+		thread_buffer_chunk_t* chunk = eventset->thread_buffers[i];
+		if (chunk == NULL) {
+			continue;
+		}
+		for (size_t j = 0; j < THREAD_BUFFER_CHUNK_SIZE; j++) {
+			if (chunk->buffers[j] == NULL) {
+				continue;
+			}
+			ubench_summary_t* summaries = get_thread_buffer_summaries(config, chunk->buffers[j]);
+			for (size_t k = 0; k < config->used_events_count; k++) {
+				ubench_summary_merge(&totals[k], &summaries[k]);
+			}
+		}
+	}
+
+	jobjectArray jevent_names = (jobjectArray) (*jni)->NewObjectArray(jni, event_count, string_class, NULL);
+	jlongArray jcounts = (*jni)->NewLongArray(jni, event_count);
+	jdoubleArray jmeans = (*jni)->NewDoubleArray(jni, event_count);
+	jdoubleArray jm2s = (*jni)->NewDoubleArray(jni, event_count);
+	jlongArray jmins = (*jni)->NewLongArray(jni, event_count);
+	jlongArray jmaxs = (*jni)->NewLongArray(jni, event_count);
+	jlongArray jfailed = (*jni)->NewLongArray(jni, event_count);
+	if ((jevent_names == NULL) || (jcounts == NULL) || (jmeans == NULL)
+		|| (jm2s == NULL) || (jmins == NULL) || (jmaxs == NULL) || (jfailed == NULL)) {
+		free(totals);
+		return NULL;
+	}
 
-	jobjectArray jevent_names = (jobjectArray) (*jni)->NewObjectArray(jni, (jsize) all_eventsets[jid].config.used_events_count + 1, string_class, NULL);
-	size_t i;
-	for (i = 0; i < all_eventsets[jid].config.used_events_count; i++) {
-		(*jni)->SetObjectArrayElement(jni, jevent_names, (jsize) i, (*jni)->NewStringUTF(jni, all_eventsets[jid].config.used_events[i].name));
+	for (jsize i = 0; i < event_count; i++) {
+		jlong count = (jlong) totals[i].count;
+		jdouble mean = (jdouble) totals[i].mean;
+		jdouble m2 = (jdouble) totals[i].m2;
+		jlong min = (jlong) totals[i].min;
+		jlong max = (jlong) totals[i].max;
+		jlong failed = (jlong) totals[i].failed_count;
+
+		(*jni)->SetObjectArrayElement(jni, jevent_names, i, (*jni)->NewStringUTF(jni, config->used_events[i].name));
+		(*jni)->SetLongArrayRegion(jni, jcounts, i, 1, &count);
+		(*jni)->SetDoubleArrayRegion(jni, jmeans, i, 1, &mean);
+		(*jni)->SetDoubleArrayRegion(jni, jm2s, i, 1, &m2);
+		(*jni)->SetLongArrayRegion(jni, jmins, i, 1, &min);
+		(*jni)->SetLongArrayRegion(jni, jmaxs, i, 1, &max);
+		(*jni)->SetLongArrayRegion(jni, jfailed, i, 1, &failed);
 	}
-	(*jni)->SetObjectArrayElement(jni, jevent_names, (jsize) all_eventsets[jid].config.used_events_count, (*jni)->NewStringUTF(jni, "TYPE"));
+	free(totals);
 
+	return (*jni)->NewObject(jni, summary_class, constructor, jevent_names, jcounts, jmeans, jm2s, jmins, jmaxs, jfailed);
+}
 
-	constructor = (*jni)->GetMethodID(jni, results_class, "<init>", "([Ljava/lang/String;)V");
-	if (constructor == NULL) {
+JNIEXPORT jobject JNICALL
+Java_cz_cuni_mff_d3s_perf_Measurement_getHistogram(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(measurement_class), jint jid, jint jevent
+) {
+	eventset_t* eventset = get_eventset(jid);
+	if (eventset == NULL) {
+		do_throw(jni, "Invalid event set id.");
+		return NULL;
+	}
+	if (!eventset->histogram) {
+		do_throw(jni, "Event set was not created with HISTOGRAM.");
 		return NULL;
 	}
 
-	jobject jresults = (*jni)->NewObject(jni, results_class, constructor, jevent_names);
-	if (jresults == NULL) {
+	const benchmark_configuration_t* config = &eventset->config;
+	if ((jevent < 0) || ((size_t) jevent >= config->used_events_count)) {
+		do_throw(jni, "Invalid event index.");
 		return NULL;
 	}
 
-	jlongArray event_values = (*jni)->NewLongArray(jni, (jsize) all_eventsets[jid].config.used_events_count + 1);
-	if (event_values == NULL) {
+	jclass histogram_class = (*jni)->FindClass(jni, "cz/cuni/mff/d3s/perf/LatencyHistogram");
+	if (histogram_class == NULL) {
 		return NULL;
 	}
-	jmethodID add_data_method = (*jni)->GetMethodID(jni, results_class, "addDataRow", "([J)V");
-	if (add_data_method == NULL) {
+	jmethodID constructor = (*jni)->GetMethodID(jni, histogram_class, "<init>", "(I[JJ)V");
+	if (constructor == NULL) {
 		return NULL;
 	}
 
-	i = 0;
-	size_t i_max = all_eventsets[jid].config.data_index;
-	while (i < i_max) {
-		size_t ei;
-		for (ei = 0; ei < all_eventsets[jid].config.used_events_count; ei++) {
-			ubench_event_info_t* event = &all_eventsets[jid].config.used_events[ei];
-			long long value = event->op_get_raw(&all_eventsets[jid].config.data[i], event);
-			jlong jvalue = (jlong) value;
-			// FIXME: report PAPI errors etc.
-			(*jni)->SetLongArrayRegion(jni, event_values, (jsize) ei, 1, &jvalue);
-		}
-		jlong type = (long) all_eventsets[jid].config.data[i].type;
-		(*jni)->SetLongArrayRegion(jni, event_values, (jsize) all_eventsets[jid].config.used_events_count, 1, &type);
+	ubench_histogram_t* total = malloc(sizeof(ubench_histogram_t));
+	if (total == NULL) {
+		THROW_OOM(jni, "merging histograms");
+		return NULL;
+	}
+	ubench_histogram_reset(total);
 
-		(*jni)->CallVoidMethod(jni, jresults, add_data_method, event_values);
+	for (size_t i = 0; i < THREAD_BUFFER_MAX_CHUNKS; i++) {
+		thread_buffer_chunk_t* chunk = eventset->thread_buffers[i];
+		if (chunk == NULL) {
+			continue;
+		}
+		for (size_t j = 0; j < THREAD_BUFFER_CHUNK_SIZE; j++) {
+			if (chunk->buffers[j] != NULL) {
+				ubench_histogram_merge(total, &get_thread_buffer_histograms(config, chunk->buffers[j])[jevent]);
+			}
+		}
+	}
 
-		i++;
+	jlongArray jcounts = (*jni)->NewLongArray(jni, UBENCH_HISTOGRAM_COUNTS_LENGTH);
+	if (jcounts == NULL) {
+		free(total);
+		return NULL;
 	}
+	(*jni)->SetLongArrayRegion(jni, jcounts, 0, UBENCH_HISTOGRAM_COUNTS_LENGTH, (const jlong*) total->counts);
+	jlong dropped_count = (jlong) total->dropped_count;
+	free(total);
 
-	return jresults;
+	return (*jni)->NewObject(
+		jni, histogram_class, constructor,
+		(jint) UBENCH_HISTOGRAM_SUB_BUCKET_HALF_COUNT_MAGNITUDE, jcounts, dropped_count
+	);
 }
 
 JNIEXPORT jboolean JNICALL
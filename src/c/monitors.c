@@ -0,0 +1,135 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Monitor contention (JVM:monitor-contended-enter and JVM:monitor-wait-ns).
+ *
+ * MonitorContendedEnter and MonitorContendedEntered are reported by the
+ * blocked thread itself, so the counters are thread-local and the
+ * callbacks need no atomic operations. The events are enabled only when
+ * the first event set that needs them is created.
+ */
+
+#include "compiler.h"
+#include "jvmutil.h"
+#include "logging.h"
+#include "mylock.h"
+#include "ubench.h"
+
+#pragma warning(push, 0)
+#include <assert.h>
+#include <stdbool.h>
+
+#include <jni.h>
+#include <jvmti.h>
+#pragma warning(pop)
+
+typedef struct {
+	int64_t contended_count;
+	// Total time spent blocked (in wall clock units).
+	int64_t blocked_time;
+	int64_t enter_timestamp;
+} monitor_counters_t;
+
+static THREAD_LOCAL monitor_counters_t current_counters = { 0, 0, -1 };
+
+static void JNICALL
+jvmti_callback_on_monitor_contended_enter(
+	jvmtiEnv* UNUSED_PARAMETER(jvmti), JNIEnv* UNUSED_PARAMETER(jni),
+	jthread UNUSED_PARAMETER(thread), jobject UNUSED_PARAMETER(object)
+) {
+	current_counters.enter_timestamp = ubench_measure_get_wallclock();
+}
+
+static void JNICALL
+jvmti_callback_on_monitor_contended_entered(
+	jvmtiEnv* UNUSED_PARAMETER(jvmti), JNIEnv* UNUSED_PARAMETER(jni),
+	jthread UNUSED_PARAMETER(thread), jobject UNUSED_PARAMETER(object)
+) {
+	// Events might have been enabled while the thread was blocked.
+	if (current_counters.enter_timestamp < 0) {
+		return;
+	}
+
+	current_counters.blocked_time += ubench_measure_get_wallclock() - current_counters.enter_timestamp;
+	current_counters.contended_count++;
+	current_counters.enter_timestamp = -1;
+}
+
+static jvmti_context_t monitors_context = {
+	.has_capabilities = true,
+	.capabilities = {
+		.can_generate_monitor_events = 1,
+	},
+	.callbacks = {
+		.MonitorContendedEnter = &jvmti_callback_on_monitor_contended_enter,
+		.MonitorContendedEntered = &jvmti_callback_on_monitor_contended_entered,
+	},
+	// Enabled with the first event set using them.
+	.events = {
+		0
+	}
+};
+
+static bool monitors_available = false;
+static ubench_spinlock_t monitors_enable_lock = UBENCH_SPINLOCK_INITIALIZER;
+static volatile bool monitors_enabled = false;
+
+INTERNAL bool
+ubench_monitors_init(JavaVM* jvm) {
+	assert(jvm != NULL);
+	monitors_available = ubench_jvmti_context_init_and_enable(&monitors_context, jvm);
+	return monitors_available;
+}
+
+/*
+ * Enables the monitor events, called when creating an event set with
+ * monitor events.
+ */
+INTERNAL bool
+ubench_monitors_enable(void) {
+	if (!monitors_available) {
+		return false;
+	}
+	if (monitors_enabled) {
+		return true;
+	}
+
+	ubench_spinlock_lock(&monitors_enable_lock);
+	if (!monitors_enabled) {
+		jvmtiEnv* jvmti = monitors_context.jvmti;
+		jvmtiError err_enter = (*jvmti)->SetEventNotificationMode(jvmti, JVMTI_ENABLE, JVMTI_EVENT_MONITOR_CONTENDED_ENTER, NULL);
+		jvmtiError err_entered = (*jvmti)->SetEventNotificationMode(jvmti, JVMTI_ENABLE, JVMTI_EVENT_MONITOR_CONTENDED_ENTERED, NULL);
+		if ((err_enter == JVMTI_ERROR_NONE) && (err_entered == JVMTI_ERROR_NONE)) {
+			monitors_enabled = true;
+		} else {
+			DEBUG_PRINTF("failed to enable monitor events (errors %ld, %ld).", (long) err_enter, (long) err_entered);
+		}
+	}
+	ubench_spinlock_unlock(&monitors_enable_lock);
+
+	return monitors_enabled;
+}
+
+/*
+ * Stores number of contended monitor enters of the current thread and the
+ * time it spent blocked on them.
+ */
+INTERNAL void
+ubench_monitors_store_current_thread(ubench_snapshot_slot_t* slots) {
+	slots[0] = current_counters.contended_count;
+	slots[1] = current_counters.blocked_time;
+}
@@ -20,12 +20,32 @@
 
 #include "compiler.h"
 
+#pragma warning(push, 0)
+#include <stddef.h>
+#include <stdint.h>
+#pragma warning(pop)
+
 #ifdef _MSC_VER
 #pragma warning(push, 0)
 #include <Windows.h>
 #pragma warning(pop)
 #endif
 
+/*
+ * Full memory barrier, e.g., to publish data before updating an index that
+ * tells other threads the data are ready.
+ */
+static inline void
+ubench_memory_barrier(void) {
+#if defined(_MSC_VER)
+	MemoryBarrier();
+#elif defined(__GNUC__)
+	__sync_synchronize();
+#else
+#error "Atomic operations not supported on this platform/compiler."
+#endif
+}
+
 typedef struct {
 #ifdef _MSC_VER
 	LONG atomic_value;
@@ -66,4 +86,81 @@ ubench_atomic_int_reset(ubench_atomic_int_t* atomic) {
 #endif
 }
 
+typedef struct {
+#ifdef _MSC_VER
+	volatile LONG64 atomic_value;
+#else
+	volatile size_t atomic_value;
+#endif
+} ubench_atomic_size_t;
+
+static inline size_t
+ubench_atomic_size_get(const ubench_atomic_size_t* atomic) {
+	return (size_t) atomic->atomic_value;
+}
+
+// return old value
+static inline size_t
+ubench_atomic_size_inc(ubench_atomic_size_t* atomic) {
+#if defined(_MSC_VER)
+	return (size_t) InterlockedExchangeAdd64(&atomic->atomic_value, 1);
+#elif defined(__GNUC__)
+	return __sync_fetch_and_add(&atomic->atomic_value, 1);
+#else
+#error "Atomic operations not supported on this platform/compiler."
+	return atomic->atomic_value++;
+#endif
+}
+
+static inline void
+ubench_atomic_size_set(ubench_atomic_size_t* atomic, size_t value) {
+#if defined(_MSC_VER)
+	InterlockedExchange64(&atomic->atomic_value, (LONG64) value);
+#elif defined(__GNUC__)
+	__sync_lock_test_and_set(&atomic->atomic_value, value);
+	__sync_synchronize();
+#else
+#error "Atomic operations not supported on this platform/compiler."
+	atomic->atomic_value = value;
+#endif
+}
+
+typedef struct {
+#ifdef _MSC_VER
+	volatile LONG64 atomic_value;
+#else
+	volatile int64_t atomic_value;
+#endif
+} ubench_atomic_int64_t;
+
+static inline int64_t
+ubench_atomic_int64_get(ubench_atomic_int64_t* atomic) {
+#if defined(_WIN64) || defined(__LP64__)
+	// Aligned 64-bit loads are atomic on 64-bit platforms.
+	return atomic->atomic_value;
+#elif defined(_MSC_VER)
+	return InterlockedCompareExchange64(&atomic->atomic_value, 0, 0);
+#elif defined(__GNUC__)
+	return __sync_fetch_and_add(&atomic->atomic_value, 0);
+#else
+#error "Atomic operations not supported on this platform/compiler."
+	return atomic->atomic_value;
+#endif
+}
+
+// return old value
+static inline int64_t
+ubench_atomic_int64_add(ubench_atomic_int64_t* atomic, int64_t value) {
+#if defined(_MSC_VER)
+	return InterlockedExchangeAdd64(&atomic->atomic_value, value);
+#elif defined(__GNUC__)
+	return __sync_fetch_and_add(&atomic->atomic_value, value);
+#else
+#error "Atomic operations not supported on this platform/compiler."
+	int64_t result = atomic->atomic_value;
+	atomic->atomic_value += value;
+	return result;
+#endif
+}
+
 #endif
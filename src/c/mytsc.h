@@ -0,0 +1,84 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MYTSC_H_GUARD
+#define MYTSC_H_GUARD
+
+#include "compiler.h"
+
+#pragma warning(push, 0)
+#include <stdbool.h>
+#include <stdint.h>
+#pragma warning(pop)
+
+/*
+ * Time stamp counter is available only on x86.
+ */
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define HAS_TSC
+#pragma warning(push, 0)
+#include <intrin.h>
+#pragma warning(pop)
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAS_TSC
+#pragma warning(push, 0)
+#include <cpuid.h>
+#include <x86intrin.h>
+#pragma warning(pop)
+#endif
+
+#ifdef HAS_TSC
+
+/*
+ * Reads the time stamp counter. RDTSCP waits until all previous
+ * instructions have executed, so the measured code cannot leak past
+ * the snapshot.
+ */
+static inline uint64_t
+ubench_tsc_read(void) {
+	unsigned int aux;
+	return (uint64_t) __rdtscp(&aux);
+}
+
+/*
+ * Checks that the CPU advertises invariant TSC, i.e., that the counter
+ * runs at a constant rate regardless of frequency scaling and C-states.
+ * Without it, TSC ticks cannot be converted to time reliably.
+ */
+static inline bool
+ubench_tsc_is_invariant(void) {
+	unsigned int regs[4] = { 0, 0, 0, 0 };
+
+#ifdef _MSC_VER
+	__cpuid((int*) regs, 0x80000000);
+	if (regs[0] < 0x80000007) {
+		return false;
+	}
+	__cpuid((int*) regs, 0x80000007);
+#else
+	if (__get_cpuid_max(0x80000000, NULL) < 0x80000007) {
+		return false;
+	}
+	__get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+
+	// EDX bit 8: invariant TSC.
+	return (regs[3] & (1 << 8)) != 0;
+}
+
+#endif
+
+#endif
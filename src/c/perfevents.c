@@ -0,0 +1,754 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Hardware and software counters collected directly through the Linux
+ * perf_event_open(2) interface (the LINUX backend).
+ *
+ * All counters of an event set are opened as a single counter group
+ * with the first counter being the group leader. That allows reading
+ * all of them with a single read() call on the leader. The counters
+ * are enabled once when the event set is created and are never stopped,
+ * the measurement itself is always a difference of two snapshots.
+ *
+ * When the counters measure the calling thread and the kernel allows it,
+ * the counter pages are also mapped into memory so that the snapshots can
+ * read the counters with the rdpmc instruction, without any syscall.
+ */
+
+#define _GNU_SOURCE
+
+#include "compiler.h"
+#include "logging.h"
+#include "mylock.h"
+#include "ubench.h"
+
+#ifdef HAS_PERF_EVENTS
+
+#pragma warning(push, 0)
+#include <dirent.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#pragma warning(pop)
+
+static int
+perf_event_open(struct perf_event_attr* attr, pid_t pid, int cpu, int group_fd, unsigned long flags) {
+	return (int) syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+static void
+perf_event_init_attr(struct perf_event_attr* attr, uint32_t type, uint64_t config) {
+	memset(attr, 0, sizeof(*attr));
+	attr->size = sizeof(*attr);
+	attr->type = type;
+	attr->config = config;
+
+	// Count only the user-space part of the workload. This also allows
+	// using the counters with the default 'perf_event_paranoid' setting.
+	// Context switches and migrations happen only in the kernel, so they
+	// would always read zero (and need 'perf_event_paranoid' of 1 or less).
+	bool kernel_only = (type == PERF_TYPE_SOFTWARE)
+		&& ((config == PERF_COUNT_SW_CONTEXT_SWITCHES) || (config == PERF_COUNT_SW_CPU_MIGRATIONS));
+	attr->exclude_kernel = kernel_only ? 0 : 1;
+	attr->exclude_hv = 1;
+}
+
+INTERNAL bool
+ubench_perf_event_probe(uint32_t type, uint64_t config) {
+	struct perf_event_attr attr;
+	perf_event_init_attr(&attr, type, config);
+	attr.disabled = 1;
+
+	int fd = perf_event_open(&attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	if (fd < 0) {
+		DEBUG_PRINTF("perf event %" PRIu32 ":0x%" PRIx64 " not available (errno %d).", type, config, errno);
+		return false;
+	}
+
+	close(fd);
+	return true;
+}
+
+#ifdef HAS_PERF_EVENTS_RDPMC
+/*
+ * Maps the counter pages so that the counters can be read from userspace.
+ *
+ * This is possible only for hardware counters (software events are never
+ * scheduled on a PMU) and only if the kernel grants the rdpmc capability
+ * (see /sys/bus/event_source/devices/cpu/rdpmc).
+ */
+static bool
+perf_event_map_pages(benchmark_configuration_t* config) {
+	for (size_t i = 0; i < config->used_linux_events_count; i++) {
+		uint32_t type = config->used_linux_event_types[i];
+		if ((type != PERF_TYPE_HARDWARE) && (type != PERF_TYPE_HW_CACHE) && (type != PERF_TYPE_RAW)) {
+			return false;
+		}
+	}
+
+	size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+	for (size_t i = 0; i < config->used_linux_events_count; i++) {
+		void* page = mmap(NULL, page_size, PROT_READ, MAP_SHARED, config->linux_fds[i], 0);
+		if (page == MAP_FAILED) {
+			DEBUG_PRINTF("failed to map perf event page %zu (errno %d).", i, errno);
+			return false;
+		}
+
+		config->linux_pages[i] = page;
+		if (!config->linux_pages[i]->cap_user_rdpmc) {
+			DEBUG_PRINTF("rdpmc not allowed for perf event %zu.", i);
+			return false;
+		}
+	}
+
+	return true;
+}
+#endif
+
+static void
+perf_event_unmap_pages(benchmark_configuration_t* config) {
+	size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+	for (size_t i = 0; i < UBENCH_MAX_LINUX_EVENTS; i++) {
+		if (config->linux_pages[i] != NULL) {
+			munmap((void*) config->linux_pages[i], page_size);
+			config->linux_pages[i] = NULL;
+		}
+	}
+
+	config->linux_rdpmc = false;
+}
+
+static void
+perf_event_close_fds(int* fds) {
+	// Close the group members before the leader.
+	for (size_t i = UBENCH_MAX_LINUX_EVENTS; i > 0; i--) {
+		if (fds[i - 1] >= 0) {
+			close(fds[i - 1]);
+			fds[i - 1] = -1;
+		}
+	}
+}
+
+/*
+ * Opens and enables counters of all LINUX events of the configuration for
+ * the given thread, storing their descriptors into fds (the leader first).
+ *
+ * Returns 0 on success or errno of the failed call.
+ */
+static int
+perf_event_open_fds(const benchmark_configuration_t* config, native_tid_t thread, bool grouped, bool inherit, int* fds) {
+	for (size_t i = 0; i < UBENCH_MAX_LINUX_EVENTS; i++) {
+		fds[i] = -1;
+	}
+
+	for (size_t i = 0; i < config->used_linux_events_count; i++) {
+		bool is_leader = (i == 0) || !grouped;
+
+		struct perf_event_attr attr;
+		perf_event_init_attr(&attr, config->used_linux_event_types[i], config->used_linux_event_configs[i]);
+		attr.disabled = is_leader ? 1 : 0;
+		attr.inherit = inherit ? 1 : 0;
+		attr.read_format = grouped ? PERF_FORMAT_GROUP : 0;
+
+		int group_fd = is_leader ? -1 : fds[0];
+		int fd = perf_event_open(&attr, (pid_t) thread, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+		if (fd < 0) {
+			int rc = errno;
+			DEBUG_PRINTF("perf_event_open(%zu, %" PRId_NATIVE_TID ") failed (errno %d).", i, thread, rc);
+			perf_event_close_fds(fds);
+			return rc;
+		}
+
+		fds[i] = fd;
+	}
+
+	for (size_t i = 0; i < config->used_linux_events_count; i++) {
+		int fd = fds[i];
+		if (grouped) {
+			if (i > 0) {
+				break;
+			}
+			ioctl(fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		} else {
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Opens counters for all LINUX events of the configuration.
+ *
+ * The counters are attached to the given thread (0 stands for the calling
+ * thread). When the counters shall be inherited by newly created threads,
+ * they cannot be read as a group (the kernel refuses that combination) and
+ * every counter is opened as a standalone one instead.
+ *
+ * Reading the counters with rdpmc is attempted only if allowed by the
+ * caller and if the counters measure the calling thread (rdpmc reads
+ * the PMU of the current CPU, i.e., the counters of the running thread).
+ *
+ * Returns 0 on success or errno of the failed call.
+ */
+INTERNAL int
+ubench_perf_event_open(benchmark_configuration_t* config, native_tid_t thread, bool inherit, bool allow_rdpmc) {
+	for (size_t i = 0; i < UBENCH_MAX_LINUX_EVENTS; i++) {
+		config->linux_pages[i] = NULL;
+	}
+
+	config->linux_rdpmc = false;
+
+	config->linux_grouped = !inherit;
+
+	int rc = perf_event_open_fds(config, thread, config->linux_grouped, inherit, config->linux_fds);
+	if (rc != 0) {
+		return rc;
+	}
+
+#ifdef HAS_PERF_EVENTS_RDPMC
+	if (allow_rdpmc && !inherit && (thread == 0)) {
+		if (perf_event_map_pages(config)) {
+			config->linux_rdpmc = true;
+			config->linux_rdpmc_thread = pthread_self();
+		} else {
+			perf_event_unmap_pages(config);
+		}
+	}
+#else
+	UNUSED_VARIABLE(allow_rdpmc);
+#endif
+
+	return 0;
+}
+
+INTERNAL void
+ubench_perf_event_close(benchmark_configuration_t* config) {
+	perf_event_unmap_pages(config);
+	perf_event_close_fds(config->linux_fds);
+}
+
+/*
+ * Process-wide event sets (Measurement.ALL_THREADS).
+ *
+ * Every thread of the process gets a counter group of its own. Java threads
+ * are attached from the 'Thread Start' callback as they start. Other
+ * threads (JIT and GC threads that JVMTI does not report) are found in
+ * /proc/self/task when the event set is created or reset and after every
+ * stop, so that the scan is never part of the measured interval. Such
+ * threads started during a measurement are thus measured from the next
+ * one. Starting and stopping a measurement reads all the groups and every
+ * thread adds a pair of start and end records (with its native id in the
+ * thread slot) to the results.
+ *
+ * Reading a group is a read() call, hence starting and stopping takes
+ * time proportional to the number of threads. The calling thread is read
+ * last on start and first on stop so that reading the other threads is
+ * not counted in its own measurement.
+ *
+ * The process lock only guards the list of threads and the records:
+ * counters are opened (and /proc/self/task is listed) without any lock
+ * held and the new descriptors are then published under the lock.
+ */
+typedef struct {
+	native_tid_t thread;
+	int fds[UBENCH_MAX_LINUX_EVENTS];
+	// Listed in /proc/self/task (or attached) since the last scan started.
+	bool alive;
+	// Start record of the running measurement (if started).
+	bool started;
+	ubench_snapshot_slot_t* start;
+} perf_thread_counters_t;
+
+struct ubench_perf_process {
+	const benchmark_configuration_t* config;
+	ubench_spinlock_t lock;
+	bool running;
+
+	perf_thread_counters_t* threads;
+	size_t thread_count;
+	size_t thread_capacity;
+	// Index of the thread that started the running measurement.
+	size_t starter_index;
+
+	// Pairs of start and end records of all the threads.
+	ubench_snapshot_slot_t* records;
+	size_t record_count;
+	size_t record_capacity;
+
+	struct ubench_perf_process* volatile next;
+};
+
+/*
+ * Process-wide event sets the new threads are attached to. Threads being
+ * attached walk the list without the lock, hence destroyed event sets are
+ * freed only when no thread is being attached.
+ */
+static ubench_spinlock_t process_sets_lock = UBENCH_SPINLOCK_INITIALIZER;
+static ubench_perf_process_t* volatile process_sets = NULL;
+static int attaching_threads = 0;
+
+static THREAD_LOCAL native_tid_t current_thread = 0;
+
+static native_tid_t
+get_current_thread(void) {
+	if (current_thread == 0) {
+		current_thread = (native_tid_t) syscall(__NR_gettid);
+	}
+	return current_thread;
+}
+
+/*
+ * Stores the counter group of the thread into the record, returns false
+ * when the thread cannot be read any more.
+ */
+static bool
+store_thread_record(const ubench_perf_process_t* process, const perf_thread_counters_t* counters, ubench_snapshot_slot_t* record, int type) {
+	const benchmark_configuration_t* config = process->config;
+	size_t status_slot = config->layout.linux_events;
+
+	record[UBENCH_SNAPSHOT_SLOT_TYPE] = type;
+	record[UBENCH_SNAPSHOT_SLOT_THREAD] = (ubench_snapshot_slot_t) counters->thread;
+
+	size_t size = (1 + config->used_linux_events_count) * sizeof(uint64_t);
+	ssize_t rc = read(counters->fds[0], &record[status_slot + 1], size);
+	record[status_slot] = (rc == (ssize_t) size) ? 0 : ((rc < 0) ? -errno : -EIO);
+	return rc == (ssize_t) size;
+}
+
+static perf_thread_counters_t*
+find_thread_counters(ubench_perf_process_t* process, native_tid_t thread) {
+	for (size_t i = 0; i < process->thread_count; i++) {
+		if (process->threads[i].thread == thread) {
+			return &process->threads[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Opens counters for the thread (no lock is needed), returns false when
+ * that failed (e.g., the thread has terminated in the meantime).
+ */
+static bool
+open_thread_counters(const benchmark_configuration_t* config, native_tid_t thread, perf_thread_counters_t* counters) {
+	counters->thread = thread;
+	counters->alive = true;
+	counters->started = false;
+	counters->start = calloc(config->layout.size, sizeof(ubench_snapshot_slot_t));
+	if (counters->start == NULL) {
+		return false;
+	}
+
+	if (perf_event_open_fds(config, thread, true, false, counters->fds) != 0) {
+		free(counters->start);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+close_thread_counters(perf_thread_counters_t* counters) {
+	perf_event_close_fds(counters->fds);
+	free(counters->start);
+}
+
+/*
+ * Adds opened counters to the list of threads. Must be called with the
+ * process lock held, returns false when the counters were not added (and
+ * are to be closed by the caller).
+ */
+static bool
+publish_thread_counters(ubench_perf_process_t* process, const perf_thread_counters_t* counters) {
+	// Attached concurrently by the thread itself or by another scan.
+	perf_thread_counters_t* existing = find_thread_counters(process, counters->thread);
+	if (existing != NULL) {
+		existing->alive = true;
+		return false;
+	}
+
+	if (process->thread_count == process->thread_capacity) {
+		size_t capacity = (process->thread_capacity == 0) ? 64 : 2 * process->thread_capacity;
+		perf_thread_counters_t* grown = realloc(process->threads, capacity * sizeof(perf_thread_counters_t));
+		if (grown == NULL) {
+			DEBUG_PRINTF("failed to grow the list of threads of a process-wide event set.");
+			return false;
+		}
+		process->threads = grown;
+		process->thread_capacity = capacity;
+	}
+
+	perf_thread_counters_t* added = &process->threads[process->thread_count];
+	*added = *counters;
+
+	// Attached during a measurement, the counters started at zero.
+	if (process->running) {
+		ubench_snapshot_slot_t* record = added->start;
+		record[UBENCH_SNAPSHOT_SLOT_TYPE] = UBENCH_SNAPSHOT_TYPE_START;
+		record[UBENCH_SNAPSHOT_SLOT_THREAD] = (ubench_snapshot_slot_t) added->thread;
+		record[process->config->layout.linux_events + 1] = (ubench_snapshot_slot_t) process->config->used_linux_events_count;
+		added->started = true;
+	}
+
+	process->thread_count++;
+	return true;
+}
+
+/*
+ * Opens counters for the thread unless it already has them. Must be called
+ * without the process lock held.
+ */
+static void
+attach_thread(ubench_perf_process_t* process, native_tid_t thread) {
+	ubench_spinlock_lock(&process->lock);
+	perf_thread_counters_t* existing = find_thread_counters(process, thread);
+	if (existing != NULL) {
+		existing->alive = true;
+	}
+	ubench_spinlock_unlock(&process->lock);
+	if (existing != NULL) {
+		return;
+	}
+
+	perf_thread_counters_t counters;
+	if (!open_thread_counters(process->config, thread, &counters)) {
+		return;
+	}
+
+	ubench_spinlock_lock(&process->lock);
+	bool published = publish_thread_counters(process, &counters);
+	ubench_spinlock_unlock(&process->lock);
+
+	if (!published) {
+		close_thread_counters(&counters);
+	}
+}
+
+/*
+ * Lists native ids of all threads in /proc/self/task. The array is to be
+ * freed by the caller, returns NULL on failure.
+ */
+static native_tid_t*
+list_threads(size_t* count_out) {
+	DIR* dir = opendir("/proc/self/task");
+	if (dir == NULL) {
+		DEBUG_PRINTF("failed to list /proc/self/task (errno %d).", errno);
+		return NULL;
+	}
+
+	size_t count = 0;
+	size_t capacity = 64;
+	native_tid_t* threads = malloc(capacity * sizeof(native_tid_t));
+
+	struct dirent* entry;
+	while ((threads != NULL) && ((entry = readdir(dir)) != NULL)) {
+		char* end;
+		long thread = strtol(entry->d_name, &end, 10);
+		if ((end == entry->d_name) || (*end != 0)) {
+			continue;
+		}
+
+		if (count == capacity) {
+			capacity *= 2;
+			native_tid_t* grown = realloc(threads, capacity * sizeof(native_tid_t));
+			if (grown == NULL) {
+				free(threads);
+				threads = NULL;
+				break;
+			}
+			threads = grown;
+		}
+		threads[count++] = (native_tid_t) thread;
+	}
+
+	closedir(dir);
+
+	*count_out = count;
+	return threads;
+}
+
+/*
+ * Attaches all threads listed in /proc/self/task and drops the threads
+ * that have terminated. Must be called without the process lock held.
+ */
+static void
+scan_threads(ubench_perf_process_t* process) {
+	// Threads attached from now on (by the scan or as they start) are
+	// marked alive again, the others have terminated.
+	ubench_spinlock_lock(&process->lock);
+	for (size_t i = 0; i < process->thread_count; i++) {
+		process->threads[i].alive = false;
+	}
+	ubench_spinlock_unlock(&process->lock);
+
+	size_t count;
+	native_tid_t* threads = list_threads(&count);
+	if (threads == NULL) {
+		return;
+	}
+	for (size_t i = 0; i < count; i++) {
+		attach_thread(process, threads[i]);
+	}
+	free(threads);
+
+	// Detach in batches so that the descriptors are closed without the lock.
+	for (;;) {
+		perf_thread_counters_t dropped[16];
+		size_t dropped_count = 0;
+
+		ubench_spinlock_lock(&process->lock);
+		for (size_t i = process->thread_count; (i > 0) && (dropped_count < 16); i--) {
+			if (!process->threads[i - 1].alive) {
+				dropped[dropped_count++] = process->threads[i - 1];
+				process->thread_count--;
+				process->threads[i - 1] = process->threads[process->thread_count];
+			}
+		}
+		ubench_spinlock_unlock(&process->lock);
+
+		for (size_t i = 0; i < dropped_count; i++) {
+			close_thread_counters(&dropped[i]);
+		}
+		if (dropped_count < 16) {
+			break;
+		}
+	}
+}
+
+/*
+ * Creates a process-wide event set measuring the LINUX events of the
+ * configuration, returns 0 or errno.
+ */
+INTERNAL int
+ubench_perf_process_create(benchmark_configuration_t* config, ubench_perf_process_t** result) {
+	// The configuration itself has no counters.
+	for (size_t i = 0; i < UBENCH_MAX_LINUX_EVENTS; i++) {
+		config->linux_fds[i] = -1;
+		config->linux_pages[i] = NULL;
+	}
+	config->linux_rdpmc = false;
+	config->linux_grouped = true;
+
+	ubench_perf_process_t* process = calloc(1, sizeof(ubench_perf_process_t));
+	if (process == NULL) {
+		return ENOMEM;
+	}
+
+	process->config = config;
+	process->lock = (ubench_spinlock_t) UBENCH_SPINLOCK_INITIALIZER;
+
+	scan_threads(process);
+	if (process->thread_count == 0) {
+		free(process->threads);
+		free(process);
+		return ENOENT;
+	}
+
+	ubench_spinlock_lock(&process_sets_lock);
+	process->next = process_sets;
+	process_sets = process;
+	ubench_spinlock_unlock(&process_sets_lock);
+
+	*result = process;
+	return 0;
+}
+
+INTERNAL void
+ubench_perf_process_destroy(ubench_perf_process_t* process) {
+	ubench_spinlock_lock(&process_sets_lock);
+	ubench_perf_process_t* volatile* link = &process_sets;
+	while (*link != process) {
+		link = &(*link)->next;
+	}
+	*link = process->next;
+	ubench_spinlock_unlock(&process_sets_lock);
+
+	// Wait for threads that might still be attaching to this event set.
+	for (;;) {
+		ubench_spinlock_lock(&process_sets_lock);
+		bool idle = attaching_threads == 0;
+		ubench_spinlock_unlock(&process_sets_lock);
+		if (idle) {
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < process->thread_count; i++) {
+		close_thread_counters(&process->threads[i]);
+	}
+
+	free(process->threads);
+	free(process->records);
+	free(process);
+}
+
+/*
+ * Attaches a newly started thread to all process-wide event sets, called
+ * from the 'Thread Start' callback (i.e. by the thread itself).
+ */
+INTERNAL void
+ubench_perf_process_attach_thread(native_tid_t thread) {
+	if (process_sets == NULL) {
+		return;
+	}
+
+	ubench_spinlock_lock(&process_sets_lock);
+	attaching_threads++;
+	ubench_perf_process_t* process = process_sets;
+	ubench_spinlock_unlock(&process_sets_lock);
+
+	for (; process != NULL; process = process->next) {
+		attach_thread(process, thread);
+	}
+
+	ubench_spinlock_lock(&process_sets_lock);
+	attaching_threads--;
+	ubench_spinlock_unlock(&process_sets_lock);
+}
+
+/*
+ * Appends start and end record of the thread to the results, returns false
+ * when out of memory.
+ */
+static bool
+add_thread_records(ubench_perf_process_t* process, perf_thread_counters_t* counters) {
+	size_t record_size = process->config->layout.size;
+
+	if (process->record_count + 2 > process->record_capacity) {
+		size_t capacity = (process->record_capacity == 0) ? 1024 : 2 * process->record_capacity;
+		ubench_snapshot_slot_t* grown = realloc(process->records, capacity * record_size * sizeof(ubench_snapshot_slot_t));
+		if (grown == NULL) {
+			DEBUG_PRINTF("failed to grow records of a process-wide event set.");
+			return false;
+		}
+		process->records = grown;
+		process->record_capacity = capacity;
+	}
+
+	ubench_snapshot_slot_t* start = &process->records[process->record_count * record_size];
+	ubench_snapshot_slot_t* end = start + record_size;
+	memcpy(start, counters->start, record_size * sizeof(ubench_snapshot_slot_t));
+	store_thread_record(process, counters, end, UBENCH_SNAPSHOT_TYPE_END);
+	process->record_count += 2;
+
+	return true;
+}
+
+INTERNAL void
+ubench_perf_process_start(ubench_perf_process_t* process) {
+	native_tid_t self = get_current_thread();
+
+	ubench_spinlock_lock(&process->lock);
+
+	// Make room for the records now so that stop does not need to.
+	size_t record_size = process->config->layout.size;
+	size_t needed = process->record_count + 2 * process->thread_count;
+	if (needed > process->record_capacity) {
+		ubench_snapshot_slot_t* grown = realloc(process->records, needed * record_size * sizeof(ubench_snapshot_slot_t));
+		if (grown != NULL) {
+			process->records = grown;
+			process->record_capacity = needed;
+		}
+	}
+
+	process->starter_index = process->thread_count;
+	for (size_t i = 0; i < process->thread_count; i++) {
+		perf_thread_counters_t* counters = &process->threads[i];
+		if (counters->thread == self) {
+			process->starter_index = i;
+			continue;
+		}
+		counters->started = store_thread_record(process, counters, counters->start, UBENCH_SNAPSHOT_TYPE_START);
+	}
+	process->running = true;
+
+	if (process->starter_index < process->thread_count) {
+		perf_thread_counters_t* counters = &process->threads[process->starter_index];
+		counters->started = store_thread_record(process, counters, counters->start, UBENCH_SNAPSHOT_TYPE_START);
+	}
+
+	ubench_spinlock_unlock(&process->lock);
+}
+
+INTERNAL void
+ubench_perf_process_stop(ubench_perf_process_t* process) {
+	native_tid_t self = get_current_thread();
+
+	ubench_spinlock_lock(&process->lock);
+
+	// A concurrent reset may have moved the calling thread in the list.
+	perf_thread_counters_t* own = NULL;
+	if ((process->starter_index < process->thread_count) && (process->threads[process->starter_index].thread == self)) {
+		own = &process->threads[process->starter_index];
+	} else {
+		own = find_thread_counters(process, self);
+	}
+	if ((own != NULL) && own->started) {
+		own->started = false;
+		add_thread_records(process, own);
+	}
+
+	for (size_t i = 0; i < process->thread_count; i++) {
+		perf_thread_counters_t* counters = &process->threads[i];
+		if (!counters->started) {
+			continue;
+		}
+		counters->started = false;
+
+		if (!add_thread_records(process, counters)) {
+			break;
+		}
+	}
+	process->running = false;
+
+	ubench_spinlock_unlock(&process->lock);
+
+	// Prepare the threads for the next measurement (and drop ended ones).
+	scan_threads(process);
+}
+
+INTERNAL void
+ubench_perf_process_reset(ubench_perf_process_t* process) {
+	ubench_spinlock_lock(&process->lock);
+	process->record_count = 0;
+	ubench_spinlock_unlock(&process->lock);
+
+	scan_threads(process);
+}
+
+/*
+ * Returns records of all the finished measurements (pairs of start and end
+ * records of every thread). The records move when more are added, hence
+ * they must not be read while measuring.
+ */
+INTERNAL const ubench_snapshot_slot_t*
+ubench_perf_process_get_records(ubench_perf_process_t* process, size_t* count) {
+	*count = process->record_count;
+	return process->records;
+}
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "compiler.h"
+#include "logging.h"
+#include "myatomic.h"
+#include "mylock.h"
+#include "ring.h"
+
+#pragma warning(push, 0)
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#pragma warning(pop)
+
+/*
+ * Returns a ring for the current thread: a released one or a new one
+ * (NULL when out of memory).
+ */
+INTERNAL ubench_ring_t*
+ubench_ring_acquire(ubench_ring_list_t* list, int thread_id) {
+	assert(list->entry_size % sizeof(int64_t) == 0);
+
+	ubench_spinlock_lock(&list->lock);
+	for (ubench_ring_t* ring = list->all; ring != NULL; ring = ring->next) {
+		if (!ring->released) {
+			continue;
+		}
+
+		// Entries of the previous owner are gone. Readers check the thread
+		// id after copying, thus it has to change only after clearing.
+		ring->released = false;
+		ring->cleared = ring->head;
+		ubench_memory_barrier();
+		ring->thread_id = thread_id;
+
+		ubench_spinlock_unlock(&list->lock);
+		return ring;
+	}
+	ubench_spinlock_unlock(&list->lock);
+
+	ubench_ring_t* ring = calloc(1, sizeof(ubench_ring_t) + list->capacity * list->entry_size);
+	if (ring == NULL) {
+		DEBUG_PRINTF("failed to allocate ring of %zu entries.", list->capacity);
+		return NULL;
+	}
+	ring->thread_id = thread_id;
+
+	ubench_spinlock_lock(&list->lock);
+	ring->next = list->all;
+	list->all = ring;
+	ubench_spinlock_unlock(&list->lock);
+
+	return ring;
+}
+
+/*
+ * Marks ring of an ended thread for reuse. Its entries are kept until
+ * another thread acquires the ring.
+ */
+INTERNAL void
+ubench_ring_release(ubench_ring_list_t* list, ubench_ring_t* ring) {
+	ubench_spinlock_lock(&list->lock);
+	ring->released = true;
+	ubench_spinlock_unlock(&list->lock);
+}
+
+INTERNAL void
+ubench_ring_list_clear(ubench_ring_list_t* list) {
+	for (ubench_ring_t* ring = list->all; ring != NULL; ring = ring->next) {
+		ring->cleared = ring->head;
+	}
+}
+
+static bool
+ensure_copy_room(
+	const ubench_ring_list_t* list, char** entries, int** thread_ids, size_t* capacity, size_t needed
+) {
+	if (needed <= *capacity) {
+		return true;
+	}
+
+	size_t new_capacity = (*capacity > 0) ? *capacity : 64;
+	while (new_capacity < needed) {
+		new_capacity *= 2;
+	}
+
+	char* new_entries = realloc(*entries, new_capacity * list->entry_size);
+	if (new_entries == NULL) {
+		return false;
+	}
+	*entries = new_entries;
+
+	int* new_thread_ids = realloc(*thread_ids, new_capacity * sizeof(int));
+	if (new_thread_ids == NULL) {
+		return false;
+	}
+	*thread_ids = new_thread_ids;
+
+	*capacity = new_capacity;
+	return true;
+}
+
+/*
+ * Copies entries of all rings into a new array (thread id of each entry is
+ * stored into a parallel array). Both arrays are to be freed by the caller,
+ * returns NULL when out of memory.
+ */
+INTERNAL void*
+ubench_ring_list_copy(ubench_ring_list_t* list, int** thread_ids_out, size_t* count_out) {
+	char* entries = NULL;
+	int* thread_ids = NULL;
+	size_t capacity = 0;
+
+	// Always return a valid (possibly empty) array.
+	if (!ensure_copy_room(list, &entries, &thread_ids, &capacity, 1)) {
+		free(entries);
+		free(thread_ids);
+		return NULL;
+	}
+
+	size_t count = 0;
+	for (ubench_ring_t* ring = list->all; ring != NULL; ring = ring->next) {
+		int thread_id = ring->thread_id;
+		ubench_memory_barrier();
+
+		size_t head = ring->head;
+		size_t first = (head > list->capacity) ? head - list->capacity : 0;
+		if (first < ring->cleared) {
+			first = ring->cleared;
+		}
+		ubench_memory_barrier();
+
+		if (!ensure_copy_room(list, &entries, &thread_ids, &capacity, count + (head - first))) {
+			free(entries);
+			free(thread_ids);
+			return NULL;
+		}
+
+		size_t ring_start = count;
+		for (size_t i = first; i < head; i++) {
+			memcpy(
+				entries + count * list->entry_size,
+				(const char*) ring->entries + (i % list->capacity) * list->entry_size,
+				list->entry_size
+			);
+			thread_ids[count] = thread_id;
+			count++;
+		}
+
+		// Entries overwritten while copying are dropped (including the one
+		// that might be just being written). When the ring was reused
+		// meanwhile, all of them are dropped.
+		ubench_memory_barrier();
+		size_t head_after = ring->head + 1;
+		size_t valid_first = (head_after > list->capacity) ? head_after - list->capacity : 0;
+		size_t overwritten = (valid_first > first) ? valid_first - first : 0;
+		if ((overwritten > count - ring_start) || (ring->thread_id != thread_id)) {
+			overwritten = count - ring_start;
+		}
+		if (overwritten > 0) {
+			memmove(
+				entries + ring_start * list->entry_size,
+				entries + (ring_start + overwritten) * list->entry_size,
+				(count - ring_start - overwritten) * list->entry_size
+			);
+			count -= overwritten;
+		}
+	}
+
+	*thread_ids_out = thread_ids;
+	*count_out = count;
+	return entries;
+}
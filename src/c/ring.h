@@ -0,0 +1,87 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Per-thread rings of fixed-size entries (used by the compilation journal
+ * and by allocation sampling).
+ *
+ * Only the owning thread writes into its ring and it publishes the entries
+ * by advancing the head, so writers take no locks. Older entries are
+ * overwritten when the ring is full. Readers copy the entries and drop
+ * those that might have been overwritten meanwhile.
+ *
+ * Rings are never freed so that readers can walk the list without locking.
+ * Instead, a thread that ends releases its ring and the ring is then
+ * reused by the next thread that needs one.
+ */
+
+#ifndef RING_H_GUARD
+#define RING_H_GUARD
+
+#include "compiler.h"
+#include "myatomic.h"
+#include "mylock.h"
+
+#pragma warning(push, 0)
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#pragma warning(pop)
+
+typedef struct ubench_ring {
+	struct ubench_ring* volatile next;
+	// Measurement id of the owning thread (changes when the ring is reused).
+	volatile int thread_id;
+	// Set when the owning thread ended (protected by the list lock).
+	bool released;
+	// Number of entries ever written (only updated by the owning thread).
+	volatile size_t head;
+	// Entries before this one were cleared.
+	volatile size_t cleared;
+	int64_t entries[];
+} ubench_ring_t;
+
+typedef struct {
+	// Entries per ring and size of each entry (multiple of 8 bytes).
+	size_t capacity;
+	size_t entry_size;
+	ubench_ring_t* volatile all;
+	ubench_spinlock_t lock;
+} ubench_ring_list_t;
+
+#define UBENCH_RING_LIST_INITIALIZER(capacity, entry_type) \
+	{ (capacity), sizeof(entry_type), NULL, UBENCH_SPINLOCK_INITIALIZER }
+
+/*
+ * Returns the entry to be written next (published by ubench_ring_publish).
+ */
+static inline void*
+ubench_ring_next_entry(const ubench_ring_list_t* list, ubench_ring_t* ring) {
+	return (char*) ring->entries + (ring->head % list->capacity) * list->entry_size;
+}
+
+static inline void
+ubench_ring_publish(ubench_ring_t* ring) {
+	ubench_memory_barrier();
+	ring->head++;
+}
+
+extern ubench_ring_t* ubench_ring_acquire(ubench_ring_list_t*, int);
+extern void ubench_ring_release(ubench_ring_list_t*, ubench_ring_t*);
+extern void ubench_ring_list_clear(ubench_ring_list_t*);
+extern void* ubench_ring_list_copy(ubench_ring_list_t*, int**, size_t*);
+
+#endif
@@ -0,0 +1,322 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Snapshot storage backed by a memory-mapped file (see SPILL_TO_FILE).
+ *
+ * A large range of address space is reserved up front and the file is
+ * mapped into it in segments as the measurement progresses, so the
+ * records stay contiguous and can be indexed as usual. A background
+ * thread writes completed parts of the file back and drops them from
+ * memory, and it also maps the next segment ahead of time so that the
+ * measuring thread does not need to do that itself.
+ */
+
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+
+#include "compiler.h"
+#include "logging.h"
+#include "ubench.h"
+
+#ifdef HAS_MMAP
+
+#pragma warning(push, 0)
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+#pragma warning(pop)
+
+/* Address space reserved for a single event set. */
+#define SPILL_RESERVED_BYTES (sizeof(void*) >= 8 ? ((size_t) 64 << 30) : ((size_t) 256 << 20))
+
+struct ubench_spill {
+	int fd;
+	char* path;
+
+	size_t record_bytes;
+	size_t segment_bytes;
+	size_t reserved_bytes;
+
+	/* Guarded by the lock. */
+	pthread_mutex_t lock;
+	pthread_cond_t wakeup;
+	size_t mapped_bytes;
+	size_t flush_limit;
+	bool terminate;
+
+	/* Used only by the flusher thread. */
+	size_t flushed_bytes;
+
+	pthread_t flusher;
+	bool has_flusher;
+};
+
+static size_t
+round_up(size_t value, size_t alignment) {
+	return ((value + alignment - 1) / alignment) * alignment;
+}
+
+/*
+ * Extends the file and maps another segment at the end of the mapped part.
+ * Must be called with the lock held. Returns 0 or errno.
+ */
+static int
+map_next_segment(ubench_snapshot_slot_t* base, struct ubench_spill* spill) {
+	size_t offset = spill->mapped_bytes;
+	if (offset + spill->segment_bytes > spill->reserved_bytes) {
+		return ENOSPC;
+	}
+
+	if (ftruncate(spill->fd, (off_t) (offset + spill->segment_bytes)) != 0) {
+		return errno;
+	}
+
+	void* segment = mmap(
+		(char*) base + offset, spill->segment_bytes,
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, spill->fd, (off_t) offset
+	);
+	if (segment == MAP_FAILED) {
+		return errno;
+	}
+
+	spill->mapped_bytes += spill->segment_bytes;
+	return 0;
+}
+
+/*
+ * Number of whole records in the mapped part. Kept even so that a start
+ * record is always followed by space for its stop record.
+ */
+static size_t
+mapped_records(const struct ubench_spill* spill) {
+	return (spill->mapped_bytes / spill->record_bytes) & ~((size_t) 1);
+}
+
+typedef struct {
+	ubench_snapshot_slot_t* base;
+	struct ubench_spill* spill;
+} flusher_args_t;
+
+static void*
+flusher_thread(void* arg) {
+	flusher_args_t* args = arg;
+	ubench_snapshot_slot_t* base = args->base;
+	struct ubench_spill* spill = args->spill;
+	free(args);
+
+	pthread_mutex_lock(&spill->lock);
+	while (!spill->terminate) {
+		size_t limit = spill->flush_limit;
+		if (limit < spill->flushed_bytes) {
+			// The event set was reset, start from the beginning again.
+			spill->flushed_bytes = 0;
+		}
+
+		if (limit > spill->flushed_bytes) {
+			pthread_mutex_unlock(&spill->lock);
+
+			char* start = (char*) base + spill->flushed_bytes;
+			size_t length = limit - spill->flushed_bytes;
+			if (msync(start, length, MS_SYNC) == 0) {
+				// The pages are backed by the file, drop them from memory.
+				madvise(start, length, MADV_DONTNEED);
+			} else {
+				DEBUG_PRINTF("msync of %s failed (errno %d).", spill->path, errno);
+			}
+			spill->flushed_bytes = limit;
+
+			pthread_mutex_lock(&spill->lock);
+			continue;
+		}
+
+		// Keep one spare segment mapped ahead of the writer.
+		if (spill->mapped_bytes - limit < 2 * spill->segment_bytes) {
+			int rc = map_next_segment(base, spill);
+			if (rc == 0) {
+				continue;
+			}
+			DEBUG_PRINTF("failed to map next segment of %s (errno %d).", spill->path, rc);
+		}
+
+		pthread_cond_wait(&spill->wakeup, &spill->lock);
+	}
+	pthread_mutex_unlock(&spill->lock);
+
+	return NULL;
+}
+
+/*
+ * Backs the snapshot storage of the configuration by the given file.
+ *
+ * The current data size (number of records) of the configuration is used
+ * as the size of a single segment. Returns 0 or errno of the failed call.
+ */
+INTERNAL int
+ubench_spill_open(benchmark_configuration_t* config, const char* path) {
+	struct ubench_spill* spill = calloc(1, sizeof(*spill));
+	if (spill == NULL) {
+		return ENOMEM;
+	}
+
+	size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+	spill->record_bytes = config->layout.size * sizeof(ubench_snapshot_slot_t);
+	spill->segment_bytes = round_up(config->data_size * spill->record_bytes, page_size);
+	spill->reserved_bytes = SPILL_RESERVED_BYTES - (SPILL_RESERVED_BYTES % spill->segment_bytes);
+	if (spill->reserved_bytes < 2 * spill->segment_bytes) {
+		free(spill);
+		return EINVAL;
+	}
+
+	spill->path = strdup(path);
+	spill->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if ((spill->path == NULL) || (spill->fd < 0)) {
+		int rc = (spill->path == NULL) ? ENOMEM : errno;
+		free(spill->path);
+		free(spill);
+		return rc;
+	}
+
+	void* base = mmap(NULL, spill->reserved_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED) {
+		int rc = errno;
+		close(spill->fd);
+		unlink(path);
+		free(spill->path);
+		free(spill);
+		return rc;
+	}
+
+	pthread_mutex_init(&spill->lock, NULL);
+	pthread_cond_init(&spill->wakeup, NULL);
+
+	config->spill = spill;
+	config->data = base;
+
+	int rc = map_next_segment(config->data, spill);
+	if (rc != 0) {
+		ubench_spill_close(config);
+		return rc;
+	}
+	config->data_size = mapped_records(spill);
+
+	flusher_args_t* args = malloc(sizeof(*args));
+	if (args == NULL) {
+		ubench_spill_close(config);
+		return ENOMEM;
+	}
+	args->base = config->data;
+	args->spill = spill;
+
+	rc = pthread_create(&spill->flusher, NULL, flusher_thread, args);
+	if (rc != 0) {
+		free(args);
+		ubench_spill_close(config);
+		return rc;
+	}
+	spill->has_flusher = true;
+
+	return 0;
+}
+
+/*
+ * Makes room for the record with the given index once the mapped part
+ * is full.
+ *
+ * Normally the flusher thread has already mapped a spare segment and the
+ * data size is only updated. Otherwise the segment is mapped here. Also
+ * lets the flusher thread know that the part before the record is
+ * complete (pages still being written by other threads are flushed again
+ * later, dropping them from memory does not lose data of a shared file
+ * mapping). Returns false when no more space can be added.
+ */
+INTERNAL bool
+ubench_spill_grow(benchmark_configuration_t* config, size_t index) {
+	struct ubench_spill* spill = config->spill;
+	size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+
+	pthread_mutex_lock(&spill->lock);
+
+	size_t written_bytes = index * spill->record_bytes;
+	if (written_bytes > spill->flush_limit) {
+		spill->flush_limit = written_bytes - (written_bytes % page_size);
+	}
+
+	if (mapped_records(spill) <= index) {
+		int rc = map_next_segment(config->data, spill);
+		if (rc != 0) {
+			DEBUG_PRINTF("failed to grow %s (errno %d).", spill->path, rc);
+		}
+	}
+
+	config->data_size = mapped_records(spill);
+	bool grown = index < config->data_size;
+
+	pthread_cond_signal(&spill->wakeup);
+	pthread_mutex_unlock(&spill->lock);
+
+	return grown;
+}
+
+/*
+ * Lets the flusher thread know that the records are written from
+ * the beginning again.
+ */
+INTERNAL void
+ubench_spill_reset(benchmark_configuration_t* config) {
+	struct ubench_spill* spill = config->spill;
+
+	pthread_mutex_lock(&spill->lock);
+	spill->flush_limit = 0;
+	pthread_mutex_unlock(&spill->lock);
+}
+
+INTERNAL void
+ubench_spill_close(benchmark_configuration_t* config) {
+	struct ubench_spill* spill = config->spill;
+	if (spill == NULL) {
+		return;
+	}
+
+	if (spill->has_flusher) {
+		pthread_mutex_lock(&spill->lock);
+		spill->terminate = true;
+		pthread_cond_signal(&spill->wakeup);
+		pthread_mutex_unlock(&spill->lock);
+
+		pthread_join(spill->flusher, NULL);
+	}
+
+	munmap(config->data, spill->reserved_bytes);
+	close(spill->fd);
+	unlink(spill->path);
+
+	pthread_cond_destroy(&spill->wakeup);
+	pthread_mutex_destroy(&spill->lock);
+	free(spill->path);
+	free(spill);
+
+	config->spill = NULL;
+	config->data = NULL;
+	config->data_size = 0;
+}
+
+#endif
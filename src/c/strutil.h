@@ -61,4 +61,21 @@ ubench_str_starts_with_icase(const char* str, const char* prefix) {
 #endif
 }
 
+/*
+ * Appends class name converted from its JVM signature (e.g.
+ * Ljava/lang/String; becomes java.lang.String) to the buffer.
+ */
+static inline void
+ubench_str_append_class_name(char* buffer, size_t buffer_size, const char* signature) {
+	size_t length = strlen(buffer);
+	if ((signature[0] == 'L') && (signature[1] != 0)) {
+		signature++;
+	}
+
+	for (; (*signature != 0) && (*signature != ';') && (length + 1 < buffer_size); signature++) {
+		buffer[length++] = (*signature == '/') ? '.' : *signature;
+	}
+	buffer[length] = 0;
+}
+
 #endif
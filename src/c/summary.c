@@ -0,0 +1,87 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Running statistics of event values (see SUMMARY event sets).
+ *
+ * Mean and variance are updated with Welford's method, which avoids the
+ * cancellation of the naive sum of squares. Statistics collected by
+ * different threads are combined with the pairwise formula of Chan et al.
+ */
+
+#include "compiler.h"
+#include "ubench.h"
+
+INTERNAL void
+ubench_summary_reset(ubench_summary_t* summary) {
+	summary->count = 0;
+	summary->mean = 0.0;
+	summary->m2 = 0.0;
+	summary->min = INT64_MAX;
+	summary->max = INT64_MIN;
+	summary->failed_count = 0;
+}
+
+/*
+ * Adds a single value. Negative values (i.e., backend errors) are only
+ * counted as failed.
+ */
+INTERNAL void
+ubench_summary_add(ubench_summary_t* summary, int64_t value) {
+	if (value < 0) {
+		summary->failed_count++;
+		return;
+	}
+
+	summary->count++;
+
+	double delta = (double) value - summary->mean;
+	summary->mean += delta / (double) summary->count;
+	summary->m2 += delta * ((double) value - summary->mean);
+
+	if (value < summary->min) {
+		summary->min = value;
+	}
+	if (value > summary->max) {
+		summary->max = value;
+	}
+}
+
+/*
+ * Adds statistics of other values to the summary.
+ */
+INTERNAL void
+ubench_summary_merge(ubench_summary_t* summary, const ubench_summary_t* other) {
+	summary->failed_count += other->failed_count;
+	if (other->count == 0) {
+		return;
+	}
+
+	int64_t count = summary->count + other->count;
+	double delta = other->mean - summary->mean;
+	double other_weight = (double) other->count / (double) count;
+
+	summary->mean += delta * other_weight;
+	summary->m2 += other->m2 + delta * delta * (double) summary->count * other_weight;
+	summary->count = count;
+
+	if (other->min < summary->min) {
+		summary->min = other->min;
+	}
+	if (other->max > summary->max) {
+		summary->max = other->max;
+	}
+}
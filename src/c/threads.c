@@ -33,7 +33,9 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <jni.h>
 #include <jvmti.h>
@@ -47,6 +49,13 @@
 #pragma warning(pop)
 #endif
 
+#ifdef __linux__
+#pragma warning(push, 0)
+#include <dirent.h>
+#include <stdio.h>
+#pragma warning(pop)
+#endif
+
 #ifdef __APPLE__
 #pragma warning(push, 0)
 #include <pthread.h>
@@ -60,37 +69,97 @@
 #pragma warning(pop)
 #endif
 
+/*
+ * Java id of threads registered by the 'Thread Start' callback that nobody
+ * asked for yet.
+ */
+#define THREAD_MAP_JAVA_ID_UNRESOLVED ((java_tid_t) INT64_MIN)
+
 typedef struct {
 	native_tid_t native_id;
 	java_tid_t java_id;
+	// Weak reference to the thread while its Java id is unresolved.
+	jweak thread;
+	// Whether the entry is present in the table keyed by Java id.
+	bool indexed;
 } thread_map_entry_t;
 
+/*
+ * The map keeps two open-addressing tables with linear probing, one keyed
+ * by the native thread id (holding all entries) and one keyed by the Java
+ * thread id (holding the entries with a known Java id).
+ *
+ * Threads started by the JVM are registered with their native id only,
+ * because asking for the Java id means calling into Java for every new
+ * thread. The Java ids are resolved when somebody looks up a thread that
+ * is not yet in the Java id table.
+ *
+ * Writers are serialized by a spinlock. Readers do not lock at all: the
+ * map is guarded by a sequence counter that writers make odd for the time
+ * of the update and readers retry when the counter changed under them.
+ * Because the readers can still be probing a table that is being grown,
+ * the old tables are never freed (their total size is bounded by the size
+ * of the current table as the capacity always doubles).
+ */
+#define THREAD_MAP_SLOT_EMPTY 0
+#define THREAD_MAP_SLOT_USED 1
+#define THREAD_MAP_SLOT_REMOVED 2
+
+#define THREAD_MAP_MIN_CAPACITY 64
+
+typedef struct {
+	int state;
+	thread_map_entry_t entry;
+} thread_map_slot_t;
+
+typedef struct thread_map_table {
+	// Always a power of two.
+	size_t capacity;
+	thread_map_slot_t* by_java_id;
+	thread_map_slot_t* by_native_id;
+	struct thread_map_table* retired;
+} thread_map_table_t;
+
 typedef struct {
-	int length;
-	int capacity;
-	thread_map_entry_t* entries;
+	volatile unsigned int sequence;
+	thread_map_table_t* volatile table;
+	size_t length;
+	// Used and removed slots in each table.
+	size_t occupied_by_java_id;
+	size_t occupied_by_native_id;
+	// Entries waiting for their Java id to be resolved.
+	volatile size_t unresolved;
 } thread_map_t;
 
-typedef bool (*predicate_func_t)(const void* arg, const thread_map_entry_t* entry);
+/*
+ * Cached identifier of 'java.lang.Thread.threadId()' (or 'getId()' on JDKs
+ * older than 19) used to resolve the Java thread identifiers.
+ */
+static jmethodID thread_id_method;
 
 #ifdef UBENCH_DEBUG
 static void
 debug_thread_map_print_entries(const thread_map_t* map, const char* prefix) {
 	assert(map != NULL);
 
+	const thread_map_table_t* table = map->table;
 	DEBUG_PRINTF("%sthread_map_t(%p) = {", (prefix != NULL) ? prefix : "", map);
-	DEBUG_PRINTF("    .length = %d", map->length);
-	DEBUG_PRINTF("    .capacity = %d", map->capacity);
+	DEBUG_PRINTF("    .length = %zu", map->length);
+	DEBUG_PRINTF("    .unresolved = %zu", map->unresolved);
+	DEBUG_PRINTF("    .capacity = %zu", (table != NULL) ? table->capacity : 0);
 
 	if (map->length > 0) {
 		DEBUG_PRINTF("    .entries = {");
 
-		for (int i = 0; i < map->length; i++) {
-			thread_map_entry_t* entry = &map->entries[i];
+		for (size_t i = 0; i < table->capacity; i++) {
+			const thread_map_slot_t* slot = &table->by_native_id[i];
+			if (slot->state != THREAD_MAP_SLOT_USED) {
+				continue;
+			}
 
 			DEBUG_PRINTF(
-				"       .[%d] = { .java_id = %" PRId_JAVA_TID ", .native_id = %" PRId_NATIVE_TID " }",
-				i, entry->java_id, entry->native_id
+				"       .[%zu] = { .java_id = %" PRId_JAVA_TID ", .native_id = %" PRId_NATIVE_TID " }",
+				i, slot->entry.java_id, slot->entry.native_id
 			);
 		};
 
@@ -107,67 +176,185 @@ debug_thread_map_print_entries(const thread_map_t* map, const char* prefix) {
 
 //
 
-static inline int
-thread_map_index_of(const thread_map_t* map, predicate_func_t predicate, void* arg) {
-	//
-	// We assume that the sequence of valid entries is contiguous.
-	// Once we find an invalid entry, it means that the given thread
-	// is is not present.
-	//
+static inline size_t
+thread_map_hash(int64_t key) {
+	// Finalizer of MurmurHash3, thread ids are often consecutive numbers.
+	uint64_t hash = (uint64_t) key;
+	hash ^= hash >> 33;
+	hash *= UINT64_C(0xff51afd7ed558ccd);
+	hash ^= hash >> 33;
+	hash *= UINT64_C(0xc4ceb9fe1a85ec53);
+	hash ^= hash >> 33;
+	return (size_t) hash;
+}
 
-	for (int i = 0; i < map->length; i++) {
-		thread_map_entry_t* entry = &map->entries[i];
-		if (predicate(arg, entry)) {
-			return i;
+static thread_map_slot_t*
+thread_map_find_java_thread(const thread_map_table_t* table, java_tid_t java_thread_id) {
+	size_t mask = table->capacity - 1;
+	size_t index = thread_map_hash(java_thread_id) & mask;
+
+	// Bounded by the capacity as readers may see a table being modified.
+	for (size_t i = 0; i < table->capacity; i++) {
+		thread_map_slot_t* slot = &table->by_java_id[index];
+		if (slot->state == THREAD_MAP_SLOT_EMPTY) {
+			return NULL;
+		}
+		if ((slot->state == THREAD_MAP_SLOT_USED) && (slot->entry.java_id == java_thread_id)) {
+			return slot;
 		}
+		index = (index + 1) & mask;
 	}
 
-	return -1;
+	return NULL;
 }
 
-//
+static thread_map_slot_t*
+thread_map_find_native_thread(const thread_map_table_t* table, native_tid_t native_thread_id) {
+	size_t mask = table->capacity - 1;
+	size_t index = thread_map_hash(native_thread_id) & mask;
 
-static bool
-predicate_java_id_match(const java_tid_t* java_id_arg, const thread_map_entry_t* entry) {
-	java_tid_t java_thread_id = *java_id_arg;
-	return entry->java_id == java_thread_id;
+	for (size_t i = 0; i < table->capacity; i++) {
+		thread_map_slot_t* slot = &table->by_native_id[index];
+		if (slot->state == THREAD_MAP_SLOT_EMPTY) {
+			return NULL;
+		}
+		if ((slot->state == THREAD_MAP_SLOT_USED) && (slot->entry.native_id == native_thread_id)) {
+			return slot;
+		}
+		index = (index + 1) & mask;
+	}
+
+	return NULL;
 }
 
-static int
-thread_map_index_of_java_thread(const thread_map_t* map, java_tid_t java_thread_id) {
-	return thread_map_index_of(map, (predicate_func_t) predicate_java_id_match, &java_thread_id);
+/*
+ * Inserts the entry into an empty slot, removed slots are not reused so
+ * that the occupancy only changes on rehashing.
+ */
+static thread_map_slot_t*
+thread_map_table_insert(thread_map_slot_t* slots, size_t capacity, int64_t key, const thread_map_entry_t* entry) {
+	size_t mask = capacity - 1;
+
+	size_t index = thread_map_hash(key) & mask;
+	while (slots[index].state != THREAD_MAP_SLOT_EMPTY) {
+		index = (index + 1) & mask;
+	}
+
+	slots[index].entry = *entry;
+	slots[index].state = THREAD_MAP_SLOT_USED;
+	return &slots[index];
+}
+
+static thread_map_table_t*
+thread_map_table_create(size_t capacity) {
+	thread_map_table_t* table = malloc(sizeof(thread_map_table_t));
+	thread_map_slot_t* slots = calloc(2 * capacity, sizeof(thread_map_slot_t));
+	if ((table == NULL) || (slots == NULL)) {
+		DEBUG_PRINTF("failed to allocate memory for thread map with capacity %zu.", capacity);
+		free(table);
+		free(slots);
+		return NULL;
+	}
+
+	table->capacity = capacity;
+	table->by_java_id = slots;
+	table->by_native_id = slots + capacity;
+	table->retired = NULL;
+	return table;
 }
 
 //
 
-static bool
-predicate_native_id_match(const native_tid_t* native_id_arg, const thread_map_entry_t* entry) {
-	native_tid_t native_thread_id = *native_id_arg;
-	return entry->native_id == native_thread_id;
+static inline void
+thread_map_write_begin(thread_map_t* map) {
+	map->sequence++;
+	ubench_memory_barrier();
 }
 
-static int
-thread_map_index_of_native_thread(const thread_map_t* map, native_tid_t native_thread_id) {
-	return thread_map_index_of(map, (predicate_func_t) predicate_native_id_match, &native_thread_id);
+static inline void
+thread_map_write_end(thread_map_t* map) {
+	ubench_memory_barrier();
+	map->sequence++;
 }
 
-//
+static inline bool
+thread_map_has_room(const thread_map_t* map, size_t added) {
+	const thread_map_table_t* table = map->table;
+	if (table == NULL) {
+		return false;
+	}
+
+	size_t limit = table->capacity * 3;
+	return ((map->occupied_by_native_id + added) * 4 <= limit)
+		&& ((map->occupied_by_java_id + added) * 4 <= limit);
+}
 
+/*
+ * Makes room for more entries, either by dropping the removed slots or by
+ * growing the tables. Rehashing also indexes the entries that have their
+ * Java id resolved but are not indexed yet. Must be called within a write
+ * section.
+ */
 static bool
-thread_map_ensure_capacity(thread_map_t* map, int required_capacity) {
+thread_map_ensure_room(thread_map_t* map, size_t added) {
 	assert(map != NULL);
 
-	if (map->capacity < required_capacity) {
-		thread_map_entry_t* new_entries = realloc(map->entries, required_capacity * sizeof(thread_map_entry_t));
-		if (new_entries == NULL) {
-			DEBUG_PRINTF("failed to reallocate memory for thread map entries.");
+	if (thread_map_has_room(map, added)) {
+		return true;
+	}
+
+	thread_map_table_t* table = map->table;
+	size_t capacity = (table != NULL) ? table->capacity : THREAD_MAP_MIN_CAPACITY;
+	while ((map->length + added) * 2 > capacity) {
+		capacity *= 2;
+	}
+
+	// Collect the live entries first, the table may be reused.
+	thread_map_entry_t* entries = malloc((map->length + 1) * sizeof(thread_map_entry_t));
+	if (entries == NULL) {
+		DEBUG_PRINTF("failed to allocate memory for rehashing thread map.");
+		return false;
+	}
+
+	size_t count = 0;
+	if (table != NULL) {
+		for (size_t i = 0; i < table->capacity; i++) {
+			if (table->by_native_id[i].state == THREAD_MAP_SLOT_USED) {
+				entries[count++] = table->by_native_id[i].entry;
+			}
+		}
+	}
+	assert(count == map->length);
+
+	thread_map_table_t* target = table;
+	if ((table == NULL) || (capacity != table->capacity)) {
+		target = thread_map_table_create(capacity);
+		if (target == NULL) {
+			free(entries);
 			return false;
 		}
+		target->retired = table;
+	} else {
+		memset(table->by_java_id, 0, 2 * capacity * sizeof(thread_map_slot_t));
+	}
 
-		map->entries = new_entries;
-		map->capacity = required_capacity;
+	size_t indexed = 0;
+	for (size_t i = 0; i < count; i++) {
+		thread_map_entry_t* entry = &entries[i];
+		entry->indexed = (entry->java_id != THREAD_MAP_JAVA_ID_UNRESOLVED);
+		if (entry->indexed) {
+			thread_map_table_insert(target->by_java_id, capacity, entry->java_id, entry);
+			indexed++;
+		}
+		thread_map_table_insert(target->by_native_id, capacity, entry->native_id, entry);
 	}
+	free(entries);
 
+	// Readers must see the filled table before they can find it.
+	ubench_memory_barrier();
+	map->table = target;
+	map->occupied_by_java_id = indexed;
+	map->occupied_by_native_id = count;
 	return true;
 }
 
@@ -176,62 +363,322 @@ thread_map_put_java_thread(thread_map_t* map, java_tid_t java_thread_id, native_
 	assert(map != NULL);
 
 	// Lookup the entry and if it exists, indicate that nothing was added.
-	int index = thread_map_index_of_java_thread(map, java_thread_id);
-	if (index >= 0) {
+	if ((map->table != NULL) && (thread_map_find_java_thread(map->table, java_thread_id) != NULL)) {
 		return EEXIST;
 	}
 
+	thread_map_write_begin(map);
+
 	// Ensure there is enough room to add a new entry.
-	if (!thread_map_ensure_capacity(map, map->length + 1)) {
+	if (!thread_map_ensure_room(map, 1)) {
+		thread_map_write_end(map);
 		DEBUG_PRINTF("failed to expand thread map capacity.");
 		return ENOMEM;
 	}
 
 	// Fill the entry and indicate that a new entry was added.
-	map->entries[map->length] = (thread_map_entry_t) {
+	thread_map_entry_t entry = {
 		.java_id = java_thread_id,
 		.native_id = native_thread_id,
+		.thread = NULL,
+		.indexed = true,
+	};
+
+	thread_map_table_t* table = map->table;
+	thread_map_table_insert(table->by_java_id, table->capacity, java_thread_id, &entry);
+	thread_map_table_insert(table->by_native_id, table->capacity, native_thread_id, &entry);
+	map->length++;
+	map->occupied_by_java_id++;
+	map->occupied_by_native_id++;
+
+	thread_map_write_end(map);
+	return 0;
+}
+
+static int
+thread_map_put_native_thread(thread_map_t* map, native_tid_t native_thread_id, jweak thread) {
+	assert(map != NULL);
+
+	thread_map_write_begin(map);
+
+	if (!thread_map_ensure_room(map, 1)) {
+		thread_map_write_end(map);
+		DEBUG_PRINTF("failed to expand thread map capacity.");
+		return ENOMEM;
+	}
+
+	thread_map_entry_t entry = {
+		.java_id = THREAD_MAP_JAVA_ID_UNRESOLVED,
+		.native_id = native_thread_id,
+		.thread = thread,
+		.indexed = false,
 	};
 
+	thread_map_table_t* table = map->table;
+	thread_map_table_insert(table->by_native_id, table->capacity, native_thread_id, &entry);
 	map->length++;
+	map->occupied_by_native_id++;
+	map->unresolved++;
+
+	thread_map_write_end(map);
 	return 0;
 }
 
 //
 
+/*
+ * Removes the entry, returns the weak reference to the thread (if still
+ * held) for the caller to delete.
+ */
 static int
-thread_map_remove_native_thread(thread_map_t* map, native_tid_t native_thread_id) {
+thread_map_remove_native_thread(thread_map_t* map, native_tid_t native_thread_id, jweak* thread) {
 	assert(map != NULL);
+	assert(thread != NULL);
 
-	//
-	// If the entry exists, replace it with the last entry and shrink the map by one.
-	//
-	int index = thread_map_index_of_native_thread(map, native_thread_id);
-	if (index < 0) {
+	thread_map_table_t* table = map->table;
+	thread_map_slot_t* native_slot = (table != NULL) ? thread_map_find_native_thread(table, native_thread_id) : NULL;
+	if (native_slot == NULL) {
 		DEBUG_PRINTF("native thread with id %" PRId_NATIVE_TID " does not exist.", native_thread_id);
 		return ENOENT;
 	}
 
-	// The entry exists, so the map must have a non-zero length.
-	assert(map->length > 0);
+	thread_map_slot_t* java_slot = NULL;
+	if (native_slot->entry.indexed) {
+		// The same entry must be present in the other table.
+		java_slot = thread_map_find_java_thread(table, native_slot->entry.java_id);
+		assert(java_slot != NULL);
+	}
+
+	thread_map_write_begin(map);
+	native_slot->state = THREAD_MAP_SLOT_REMOVED;
+	if (java_slot != NULL) {
+		java_slot->state = THREAD_MAP_SLOT_REMOVED;
+	}
+	if (native_slot->entry.thread != NULL) {
+		map->unresolved--;
+	}
 	map->length--;
+	thread_map_write_end(map);
 
-	// The new length is the index of the last element.
-	map->entries[index] = map->entries[map->length];
+	*thread = native_slot->entry.thread;
 	return 0;
 }
 
+/* Thread waiting for its Java id while being resolved without the lock. */
+typedef struct {
+	native_tid_t native_id;
+	// The weak reference in the entry and a local one for the upcall.
+	jweak weak_thread;
+	jobject thread;
+	java_tid_t java_id;
+} thread_map_pending_t;
+
+/*
+ * Copies the threads registered by their native id only, so that their
+ * Java ids can be resolved outside of the lock (the upcalls may block or
+ * trigger a GC). Returns NULL when there are none or when out of memory.
+ */
+static thread_map_pending_t*
+thread_map_collect_unresolved(thread_map_t* map, JNIEnv* jni, size_t* count) {
+	assert(map != NULL);
+
+	*count = 0;
+
+	thread_map_table_t* table = map->table;
+	if ((map->unresolved == 0) || (table == NULL)) {
+		return NULL;
+	}
+
+	thread_map_pending_t* pending = malloc(map->unresolved * sizeof(thread_map_pending_t));
+	if (pending == NULL) {
+		DEBUG_PRINTF("failed to allocate memory for resolving Java thread ids.");
+		return NULL;
+	}
+
+	for (size_t i = 0; i < table->capacity; i++) {
+		const thread_map_entry_t* entry = &table->by_native_id[i].entry;
+		if ((table->by_native_id[i].state != THREAD_MAP_SLOT_USED) || (entry->thread == NULL)) {
+			continue;
+		}
+
+		assert(*count < map->unresolved);
+		pending[*count].native_id = entry->native_id;
+		pending[*count].weak_thread = entry->thread;
+		pending[*count].thread = (*jni)->NewLocalRef(jni, entry->thread);
+		pending[*count].java_id = THREAD_MAP_JAVA_ID_UNRESOLVED;
+		(*count)++;
+	}
+
+	return pending;
+}
+
+/*
+ * Stores the Java ids resolved outside of the lock and adds the threads
+ * to the Java id table. Threads that ended or were resolved by somebody
+ * else meanwhile are skipped.
+ */
+static int
+thread_map_add_resolved(thread_map_t* map, JNIEnv* jni, const thread_map_pending_t* pending, size_t count) {
+	assert(map != NULL);
+
+	//
+	// Readers only look at the Java id table, so we can fill in the ids
+	// in the native id table outside of the write section.
+	//
+	size_t resolved = 0;
+	thread_map_table_t* table = map->table;
+	for (size_t i = 0; i < count; i++) {
+		thread_map_slot_t* slot = thread_map_find_native_thread(table, pending[i].native_id);
+		if ((slot == NULL) || (slot->entry.thread != pending[i].weak_thread)
+			|| !(*jni)->IsSameObject(jni, slot->entry.thread, pending[i].thread)) {
+			continue;
+		}
+
+		if (pending[i].java_id != THREAD_MAP_JAVA_ID_UNRESOLVED) {
+			slot->entry.java_id = pending[i].java_id;
+			resolved++;
+		}
+
+		// Threads that cannot be resolved will not be tried again.
+		(*jni)->DeleteWeakGlobalRef(jni, slot->entry.thread);
+		slot->entry.thread = NULL;
+		map->unresolved--;
+	}
+
+	if (resolved == 0) {
+		return 0;
+	}
+
+	thread_map_write_begin(map);
+
+	if (!thread_map_ensure_room(map, resolved)) {
+		thread_map_write_end(map);
+		DEBUG_PRINTF("failed to expand thread map capacity.");
+		return ENOMEM;
+	}
+
+	// Index the entries unless rehashing has already done so.
+	table = map->table;
+	for (size_t i = 0; i < table->capacity; i++) {
+		thread_map_entry_t* entry = &table->by_native_id[i].entry;
+		if ((table->by_native_id[i].state != THREAD_MAP_SLOT_USED)
+			|| entry->indexed || (entry->java_id == THREAD_MAP_JAVA_ID_UNRESOLVED)) {
+			continue;
+		}
+
+		entry->indexed = true;
+		thread_map_table_insert(table->by_java_id, table->capacity, entry->java_id, entry);
+		map->occupied_by_java_id++;
+	}
+
+	thread_map_write_end(map);
+	return 0;
+}
+
+/*
+ * Looks up the native id without locking, retrying when a writer modified
+ * the map in the meantime.
+ */
+static native_tid_t
+thread_map_get_native_id(const thread_map_t* map, java_tid_t java_thread_id) {
+	while (true) {
+		unsigned int sequence = map->sequence;
+		if ((sequence & 1) != 0) {
+			continue;
+		}
+		ubench_memory_barrier();
+
+		native_tid_t result = UBENCH_THREAD_ID_INVALID;
+		const thread_map_table_t* table = map->table;
+		// Pairs with the barrier before publishing the table.
+		ubench_memory_barrier();
+		if (table != NULL) {
+			const thread_map_slot_t* slot = thread_map_find_java_thread(table, java_thread_id);
+			if (slot != NULL) {
+				result = slot->entry.native_id;
+			}
+		}
+
+		ubench_memory_barrier();
+		if (map->sequence == sequence) {
+			return result;
+		}
+	}
+}
+
 //
 
 static thread_map_t thread_map;
 static ubench_spinlock_t thread_map_lock = UBENCH_SPINLOCK_INITIALIZER;
 
-static bool
-ubench_register_java_thread(java_tid_t java_thread_id, native_tid_t native_thread_id) {
+/*
+ * Resolves the Java ids of all threads registered by their native id only
+ * and adds them to the Java id table. Must be called without holding the
+ * thread map lock, the lock is only taken around the map updates.
+ */
+static int
+ubench_resolve_java_threads(JNIEnv* jni) {
+	if (thread_map.unresolved == 0) {
+		return 0;
+	}
+
 	ubench_spinlock_lock(&thread_map_lock);
+	size_t count;
+	thread_map_pending_t* pending = thread_map_collect_unresolved(&thread_map, jni, &count);
+	bool out_of_memory = (pending == NULL) && (thread_map.unresolved > 0);
+	ubench_spinlock_unlock(&thread_map_lock);
+
+	if (pending == NULL) {
+		return out_of_memory ? ENOMEM : 0;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (pending[i].thread == NULL) {
+			continue;
+		}
+
+		java_tid_t java_id = (*jni)->CallLongMethod(jni, pending[i].thread, thread_id_method);
+		if ((*jni)->ExceptionCheck(jni)) {
+			(*jni)->ExceptionClear(jni);
+		} else {
+			pending[i].java_id = java_id;
+		}
+	}
+
+	ubench_spinlock_lock(&thread_map_lock);
+	int result = thread_map_add_resolved(&thread_map, jni, pending, count);
+	ubench_spinlock_unlock(&thread_map_lock);
+
+	for (size_t i = 0; i < count; i++) {
+		if (pending[i].thread != NULL) {
+			(*jni)->DeleteLocalRef(jni, pending[i].thread);
+		}
+	}
+	free(pending);
+
+	return result;
+}
+
+static bool
+ubench_register_java_thread(JNIEnv* jni, java_tid_t java_thread_id, native_tid_t native_thread_id) {
+	// Pending threads must be resolved to detect duplicate registration,
+	// including those started while resolving without the lock.
+	int result;
+	while (true) {
+		result = ubench_resolve_java_threads(jni);
+		ubench_spinlock_lock(&thread_map_lock);
+		if ((result != 0) || (thread_map.unresolved == 0)) {
+			break;
+		}
+		ubench_spinlock_unlock(&thread_map_lock);
+	}
 
 	debug_thread_map_print_entries(&thread_map, "before adding: ");
-	int result = thread_map_put_java_thread(&thread_map, java_thread_id, native_thread_id);
+
+	if (result == 0) {
+		result = thread_map_put_java_thread(&thread_map, java_thread_id, native_thread_id);
+	}
+
 	debug_thread_map_print_entries(&thread_map, "after adding: ");
 
 	ubench_spinlock_unlock(&thread_map_lock);
@@ -246,14 +693,44 @@ ubench_register_java_thread(java_tid_t java_thread_id, native_tid_t native_threa
 }
 
 static bool
-ubench_unregister_native_thread(native_tid_t native_thread_id) {
+ubench_register_native_thread(JNIEnv* jni, native_tid_t native_thread_id, jthread thread) {
+	jweak thread_ref = (*jni)->NewWeakGlobalRef(jni, thread);
+	if (thread_ref == NULL) {
+		DEBUG_PRINTF("failed to create weak reference to thread.");
+		return false;
+	}
+
+	ubench_spinlock_lock(&thread_map_lock);
+
+	debug_thread_map_print_entries(&thread_map, "before adding: ");
+	int result = thread_map_put_native_thread(&thread_map, native_thread_id, thread_ref);
+	debug_thread_map_print_entries(&thread_map, "after adding: ");
+
+	ubench_spinlock_unlock(&thread_map_lock);
+
+	if (result == ENOMEM) {
+		FATAL_PRINTF("failed to register native thread, aborting!");
+		exit(1);
+	}
+
+	return (result == 0);
+}
+
+static bool
+ubench_unregister_native_thread(JNIEnv* jni, native_tid_t native_thread_id) {
 	ubench_spinlock_lock(&thread_map_lock);
 
 	debug_thread_map_print_entries(&thread_map, "before removal: ");
-	int result = thread_map_remove_native_thread(&thread_map, native_thread_id);
+	jweak thread_ref = NULL;
+	int result = thread_map_remove_native_thread(&thread_map, native_thread_id, &thread_ref);
 	debug_thread_map_print_entries(&thread_map, "after removal: ");
 
 	ubench_spinlock_unlock(&thread_map_lock);
+
+	if (thread_ref != NULL) {
+		(*jni)->DeleteWeakGlobalRef(jni, thread_ref);
+	}
+
 	return (result == 0);
 }
 
@@ -277,13 +754,6 @@ ubench_get_current_thread_native_id(void) {
 
 //
 
-/*
- * Cached identifier of 'java.lang.Thread.getId()' method. Used by the
- * 'Thread Start' and 'Thread End' callbacks get the Java thread identifier.
- * Must be initialized before enabling the thread lifecycle JVMTI events.
- */
-static jmethodID thread_get_id_method;
-
 static void JNICALL
 jvmti_callback_on_thread_start(
 	jvmtiEnv* UNUSED_PARAMETER(jvmti), JNIEnv* jni, jthread thread
@@ -297,14 +767,18 @@ jvmti_callback_on_thread_start(
 
 	DEBUG_PRINTF("thread %p [%s] started.", thread, thread_info.name);
 
-	java_tid_t java_id = (*jni)->CallLongMethod(jni, thread, thread_get_id_method);
+	// The Java id is resolved only when needed to avoid calling into Java.
 	native_tid_t native_id = ubench_get_current_thread_native_id();
-	bool registered = ubench_register_java_thread(java_id, native_id);
+	bool registered = ubench_register_native_thread(jni, native_id, thread);
+
+#ifdef HAS_PERF_EVENTS
+	ubench_perf_process_attach_thread(native_id);
+#endif
 
 	DEBUG_PRINTF(
-		"%s thread %p [%s, %" PRId_JAVA_TID "] with native id [%" PRId_NATIVE_TID "].",
+		"%s thread %p [%s] with native id [%" PRId_NATIVE_TID "].",
 		registered ? "registered" : "failed to register",
-		thread, thread_info.name, java_id, native_id
+		thread, thread_info.name, native_id
 	);
 
 	UNUSED_VARIABLE(registered);
@@ -319,7 +793,7 @@ jvmti_callback_on_thread_start(
 
 static void JNICALL
 jvmti_callback_on_thread_end(
-	jvmtiEnv* UNUSED_PARAMETER(jvmti), JNIEnv* UNUSED_PARAMETER(jni),
+	jvmtiEnv* UNUSED_PARAMETER(jvmti), JNIEnv* jni,
 	jthread UNUSED_PARAMETER(thread)
 ) {
 #ifdef UBENCH_DEBUG
@@ -332,7 +806,10 @@ jvmti_callback_on_thread_end(
 	DEBUG_PRINTF("thread %p [%s] finished.", thread, thread_info.name);
 
 	native_tid_t native_id = ubench_get_current_thread_native_id();
-	bool unregistered = ubench_unregister_native_thread(native_id);
+	bool unregistered = ubench_unregister_native_thread(jni, native_id);
+
+	// Its buffers in event sets are reused by the next new thread.
+	ubench_measure_release_current_thread_id();
 
 	DEBUG_PRINTF(
 		"%s thread %p [%s] with native id [%" PRId_NATIVE_TID "].",
@@ -357,8 +834,8 @@ enable_automatic_threads_registration(JavaVM* jvm, JNIEnv* jni) {
 	assert (jni != NULL);
 
 	//
-	// Initialize the 'thread_get_id_method' variable for the thread
-	// registration callbacks. The error paths should not really happen.
+	// Initialize the 'thread_id_method' variable for resolving the Java
+	// thread ids. The error paths should not really happen.
 	//
 	jclass thread_class = (*jni)->FindClass(jni, "java/lang/Thread");
 	if (thread_class == NULL) {
@@ -366,8 +843,13 @@ enable_automatic_threads_registration(JavaVM* jvm, JNIEnv* jni) {
 		return false;
 	}
 
-	thread_get_id_method = (*jni)->GetMethodID(jni, thread_class, "getId", "()J");
-	if (thread_get_id_method == NULL) {
+	// Thread.getId() is deprecated since JDK 19.
+	thread_id_method = (*jni)->GetMethodID(jni, thread_class, "threadId", "()J");
+	if (thread_id_method == NULL) {
+		(*jni)->ExceptionClear(jni);
+		thread_id_method = (*jni)->GetMethodID(jni, thread_class, "getId", "()J");
+	}
+	if (thread_id_method == NULL) {
 		ERROR_PRINTF("failed to find 'java.lang.Thread.getId()' method!");
 		return false;
 	}
@@ -375,7 +857,7 @@ enable_automatic_threads_registration(JavaVM* jvm, JNIEnv* jni) {
 	//
 	// Enable thread lifecycle JVMTI events to automatically register newly
 	// created threads. This ensures that the thread registration methods
-	// will be called only after initializing the 'getId' method identifier.
+	// will be called only after initializing the method identifier.
 	//
 	static jvmti_context_t threads_context = {
 		.callbacks = {
@@ -461,27 +943,333 @@ ubench_threads_init(JavaVM* jvm) {
 	return true;
 }
 
+/*
+ * Returns the native id of the given Java thread, resolving the Java ids of
+ * newly started threads when the thread is not found at first.
+ */
 INTERNAL native_tid_t
-ubench_threads_get_native_id(java_tid_t java_thread_id) {
-	ubench_spinlock_lock(&thread_map_lock);
+ubench_threads_get_native_id(JNIEnv* jni, java_tid_t java_thread_id) {
+	native_tid_t result = thread_map_get_native_id(&thread_map, java_thread_id);
+	if ((result != UBENCH_THREAD_ID_INVALID) || (thread_map.unresolved == 0)) {
+		return result;
+	}
 
-	int index = thread_map_index_of_java_thread(&thread_map, java_thread_id);
-	native_tid_t result = (index >= 0) ? thread_map.entries[index].native_id : UBENCH_THREAD_ID_INVALID;
+	int rc = ubench_resolve_java_threads(jni);
+
+	if (rc != 0) {
+		DEBUG_PRINTF("failed to resolve Java thread ids.");
+		return UBENCH_THREAD_ID_INVALID;
+	}
+
+	return thread_map_get_native_id(&thread_map, java_thread_id);
+}
+
+/*
+ * List of all threads of the process (NativeThreads.listThreads()).
+ *
+ * The threads are found in /proc/self/task and JVMTI tells us which of them
+ * are Java threads (the ones in the thread map), the rest is classified by
+ * name. Names are read only once for every new thread: each listing walks
+ * the directory, drops the threads that have terminated and keeps the
+ * cached names of the others. Kinds are recomputed on every listing as
+ * a thread may appear in the directory before its 'Thread Start' callback
+ * registers it.
+ */
+#ifdef __linux__
+
+// Kernel limit on thread names (TASK_COMM_LEN) including the terminator.
+#define THREAD_LIST_NAME_LENGTH 16
+
+typedef enum {
+	THREAD_KIND_JAVA,
+	THREAD_KIND_JIT,
+	THREAD_KIND_GC,
+	THREAD_KIND_VM,
+	THREAD_KIND_COUNT
+} thread_kind_t;
+
+/* Names of the NativeThreadInfo.Kind constants (indexed by thread_kind_t). */
+static const char* thread_kind_names[THREAD_KIND_COUNT] = { "JAVA", "JIT", "GC", "VM" };
+
+/* Name prefixes of HotSpot and OpenJ9 compiler threads. */
+static const char* jit_thread_prefixes[] = {
+	"C1 CompilerThre", "C2 CompilerThre", "JVMCI CompilerT", "JVMCI-native Co",
+	"JIT Compilation", "JIT-SamplerThre", NULL
+};
+
+/* Name prefixes of garbage collector threads (Serial GC runs in the VM thread). */
+static const char* gc_thread_prefixes[] = {
+	"GC Thread", "G1 ", "ZDirector", "ZDriver", "ZStat", "ZUncommitter", "ZWorker",
+	"Shenandoah", "GC Worker", "GC Slave", NULL
+};
+
+typedef struct {
+	native_tid_t id;
+	char name[THREAD_LIST_NAME_LENGTH];
+	// Kind by name, threads in the thread map are Java threads regardless.
+	thread_kind_t kind;
+	// Still listed in /proc/self/task during the last walk.
+	bool alive;
+} thread_list_entry_t;
+
+static thread_list_entry_t* thread_list = NULL;
+static size_t thread_list_length = 0;
+static size_t thread_list_capacity = 0;
+static ubench_spinlock_t thread_list_lock = UBENCH_SPINLOCK_INITIALIZER;
+
+static bool
+has_any_prefix(const char* name, const char** prefixes) {
+	for (size_t i = 0; prefixes[i] != NULL; i++) {
+		if (strncmp(name, prefixes[i], strlen(prefixes[i])) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static thread_kind_t
+classify_thread_by_name(const char* name) {
+	if (has_any_prefix(name, jit_thread_prefixes)) {
+		return THREAD_KIND_JIT;
+	}
+	if (has_any_prefix(name, gc_thread_prefixes)) {
+		return THREAD_KIND_GC;
+	}
+	return THREAD_KIND_VM;
+}
+
+static void
+read_thread_name(native_tid_t id, char* name) {
+	name[0] = 0;
+
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/self/task/%" PRId_NATIVE_TID "/comm", id);
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		return;
+	}
+	if (fgets(name, THREAD_LIST_NAME_LENGTH, file) == NULL) {
+		name[0] = 0;
+	}
+	fclose(file);
+
+	name[strcspn(name, "\n")] = 0;
+}
+
+static thread_list_entry_t*
+thread_list_find(native_tid_t id) {
+	for (size_t i = 0; i < thread_list_length; i++) {
+		if (thread_list[i].id == id) {
+			return &thread_list[i];
+		}
+	}
+	return NULL;
+}
+
+static bool
+thread_list_add(native_tid_t id) {
+	if (thread_list_length == thread_list_capacity) {
+		size_t capacity = (thread_list_capacity == 0) ? 64 : 2 * thread_list_capacity;
+		thread_list_entry_t* grown = realloc(thread_list, capacity * sizeof(thread_list_entry_t));
+		if (grown == NULL) {
+			return false;
+		}
+		thread_list = grown;
+		thread_list_capacity = capacity;
+	}
+
+	thread_list_entry_t* entry = &thread_list[thread_list_length];
+	entry->id = id;
+	entry->alive = true;
+	read_thread_name(id, entry->name);
+	entry->kind = classify_thread_by_name(entry->name);
+	thread_list_length++;
+
+	return true;
+}
+
+/*
+ * Brings the cached list up to date, returns 0 or errno. Must be called
+ * with the list lock held.
+ */
+static int
+thread_list_refresh(void) {
+	DIR* dir = opendir("/proc/self/task");
+	if (dir == NULL) {
+		int rc = errno;
+		DEBUG_PRINTF("failed to list /proc/self/task (errno %d).", rc);
+		return rc;
+	}
+
+	for (size_t i = 0; i < thread_list_length; i++) {
+		thread_list[i].alive = false;
+	}
+
+	int result = 0;
+	struct dirent* dir_entry;
+	while ((dir_entry = readdir(dir)) != NULL) {
+		char* end;
+		long id = strtol(dir_entry->d_name, &end, 10);
+		if ((end == dir_entry->d_name) || (*end != 0)) {
+			continue;
+		}
+
+		thread_list_entry_t* entry = thread_list_find((native_tid_t) id);
+		if (entry != NULL) {
+			entry->alive = true;
+		} else if (!thread_list_add((native_tid_t) id)) {
+			result = ENOMEM;
+			break;
+		}
+	}
+
+	closedir(dir);
+
+	for (size_t i = thread_list_length; i > 0; i--) {
+		if (!thread_list[i - 1].alive) {
+			thread_list_length--;
+			thread_list[i - 1] = thread_list[thread_list_length];
+		}
+	}
 
-	ubench_spinlock_unlock(&thread_map_lock);
 	return result;
 }
 
+/*
+ * Copies the cached list, marking the Java threads (the current thread is
+ * one even when not registered). Returns NULL when out of memory. Must be
+ * called with the list lock held.
+ */
+static thread_list_entry_t*
+thread_list_copy(native_tid_t current_thread) {
+	thread_list_entry_t* copy = malloc((thread_list_length + 1) * sizeof(thread_list_entry_t));
+	if (copy == NULL) {
+		return NULL;
+	}
+
+	ubench_spinlock_lock(&thread_map_lock);
+	const thread_map_table_t* table = thread_map.table;
+	for (size_t i = 0; i < thread_list_length; i++) {
+		copy[i] = thread_list[i];
+
+		bool is_java = (thread_list[i].id == current_thread)
+			|| ((table != NULL) && (thread_map_find_native_thread(table, thread_list[i].id) != NULL));
+		if (is_java) {
+			copy[i].kind = THREAD_KIND_JAVA;
+		}
+	}
+	ubench_spinlock_unlock(&thread_map_lock);
+
+	return copy;
+}
+
+/*
+ * Creates List<NativeThreadInfo> with all threads of the process (or returns
+ * NULL with a pending exception).
+ */
+static jobject
+ubench_threads_export_list(JNIEnv* jni) {
+	jclass array_list_class = (*jni)->FindClass(jni, "java/util/ArrayList");
+	if (array_list_class == NULL) {
+		return NULL;
+	}
+	jmethodID list_constructor = (*jni)->GetMethodID(jni, array_list_class, "<init>", "()V");
+	if (list_constructor == NULL) {
+		return NULL;
+	}
+	jmethodID add_method = (*jni)->GetMethodID(jni, array_list_class, "add", "(Ljava/lang/Object;)Z");
+	if (add_method == NULL) {
+		return NULL;
+	}
+	jclass info_class = (*jni)->FindClass(jni, "cz/cuni/mff/d3s/perf/NativeThreadInfo");
+	if (info_class == NULL) {
+		return NULL;
+	}
+	jmethodID info_constructor = (*jni)->GetMethodID(
+		jni, info_class, "<init>", "(JLjava/lang/String;Lcz/cuni/mff/d3s/perf/NativeThreadInfo$Kind;)V"
+	);
+	if (info_constructor == NULL) {
+		return NULL;
+	}
+	jclass kind_class = (*jni)->FindClass(jni, "cz/cuni/mff/d3s/perf/NativeThreadInfo$Kind");
+	if (kind_class == NULL) {
+		return NULL;
+	}
+	jobject jkinds[THREAD_KIND_COUNT];
+	for (size_t i = 0; i < THREAD_KIND_COUNT; i++) {
+		jfieldID field = (*jni)->GetStaticFieldID(
+			jni, kind_class, thread_kind_names[i], "Lcz/cuni/mff/d3s/perf/NativeThreadInfo$Kind;"
+		);
+		if (field == NULL) {
+			return NULL;
+		}
+		jkinds[i] = (*jni)->GetStaticObjectField(jni, kind_class, field);
+	}
+
+	jobject jthreads = (*jni)->NewObject(jni, array_list_class, list_constructor);
+	if (jthreads == NULL) {
+		return NULL;
+	}
+
+	ubench_spinlock_lock(&thread_list_lock);
+	int rc = thread_list_refresh();
+	size_t count = thread_list_length;
+	thread_list_entry_t* copies = (rc == 0) ? thread_list_copy(ubench_get_current_thread_native_id()) : NULL;
+	ubench_spinlock_unlock(&thread_list_lock);
+
+	if (copies == NULL) {
+		// Without /proc there is nothing to list.
+		bool no_memory = (rc == 0) || (rc == ENOMEM);
+		jclass ex_class = (*jni)->FindClass(
+			jni, no_memory ? "java/lang/OutOfMemoryError" : "java/lang/UnsupportedOperationException"
+		);
+		if (ex_class != NULL) {
+			(*jni)->ThrowNew(jni, ex_class, "failed to list threads of the process");
+		}
+		return NULL;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		jstring jname = (*jni)->NewStringUTF(jni, copies[i].name);
+		if (jname == NULL) {
+			free(copies);
+			return NULL;
+		}
+		jobject jinfo = (*jni)->NewObject(
+			jni, info_class, info_constructor,
+			(jlong) copies[i].id, jname, jkinds[copies[i].kind]
+		);
+		if (jinfo == NULL) {
+			free(copies);
+			return NULL;
+		}
+		(*jni)->CallBooleanMethod(jni, jthreads, add_method, jinfo);
+		if ((*jni)->ExceptionCheck(jni)) {
+			free(copies);
+			return NULL;
+		}
+
+		(*jni)->DeleteLocalRef(jni, jinfo);
+		(*jni)->DeleteLocalRef(jni, jname);
+	}
+
+	free(copies);
+
+	return jthreads;
+}
+
+#endif
+
 //
 
 JNIEXPORT java_tid_t JNICALL
 Java_cz_cuni_mff_d3s_perf_NativeThreads_getNativeId(
-	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(threads_class),
+	JNIEnv* jni, jclass UNUSED_PARAMETER(threads_class),
 	java_tid_t java_thread_id
 ) {
 	DEBUG_PRINTF("NativeThreads.getNativeId(java_thread_id = %" PRId_JAVA_TID ")", java_thread_id);
 
-	native_tid_t native_thread_id = ubench_threads_get_native_id(java_thread_id);
+	native_tid_t native_thread_id = ubench_threads_get_native_id(jni, java_thread_id);
 	if (native_thread_id == UBENCH_THREAD_ID_INVALID) {
 		// TODO Consider throwing an exception (-1 could be a valid id).
 		return (java_tid_t) cz_cuni_mff_d3s_perf_NativeThreads_INVALID_THREAD_ID;
@@ -492,7 +1280,7 @@ Java_cz_cuni_mff_d3s_perf_NativeThreads_getNativeId(
 
 JNIEXPORT jboolean JNICALL
 Java_cz_cuni_mff_d3s_perf_NativeThreads_registerJavaThread(
-	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(threads_class),
+	JNIEnv* jni, jclass UNUSED_PARAMETER(threads_class),
 	java_tid_t java_thread_id, java_tid_t jnative_thread_id
 ) {
 	DEBUG_PRINTF(
@@ -501,16 +1289,33 @@ Java_cz_cuni_mff_d3s_perf_NativeThreads_registerJavaThread(
 	);
 
 	// TODO Consider throwing an exception ('false' really means "already registered").
-	return ubench_register_java_thread(java_thread_id, (native_tid_t) jnative_thread_id);
+	return ubench_register_java_thread(jni, java_thread_id, (native_tid_t) jnative_thread_id);
 }
 
 JNIEXPORT jboolean JNICALL
 Java_cz_cuni_mff_d3s_perf_NativeThreads_registerCurrentJavaThread(
-	JNIEnv* UNUSED_PARAMETER(jni), jclass UNUSED_PARAMETER(threads_class),
+	JNIEnv* jni, jclass UNUSED_PARAMETER(threads_class),
 	java_tid_t java_thread_id
 ) {
 	DEBUG_PRINTF("NativeThreads.registerCurrentJavaThread(java_thread_id = %" PRId_JAVA_TID ")", java_thread_id);
 
 	// TODO Consider throwing an exception ('false' really means "already registered").
-	return ubench_register_java_thread(java_thread_id, ubench_get_current_thread_native_id());
+	return ubench_register_java_thread(jni, java_thread_id, ubench_get_current_thread_native_id());
+}
+
+JNIEXPORT jobject JNICALL
+Java_cz_cuni_mff_d3s_perf_NativeThreads_listThreads(
+	JNIEnv* jni, jclass UNUSED_PARAMETER(threads_class)
+) {
+	DEBUG_PRINTF("NativeThreads.listThreads()");
+
+#ifdef __linux__
+	return ubench_threads_export_list(jni);
+#else
+	jclass ex_class = (*jni)->FindClass(jni, "java/lang/UnsupportedOperationException");
+	if (ex_class != NULL) {
+		(*jni)->ThrowNew(jni, ex_class, "listing threads is supported only on Linux");
+	}
+	return NULL;
+#endif
 }
@@ -64,6 +64,27 @@ ubench_startup(JavaVM* jvm) {
 		WARN_PRINTF("failed to initialize event counter module.");
 	}
 
+	DEBUG_PRINTF("initializing monitors module.");
+	if (!ubench_monitors_init(jvm)) {
+		WARN_PRINTF("monitor contention events not supported.");
+	}
+
+	DEBUG_PRINTF("initializing virtual threads module.");
+	if (!ubench_vthreads_init(jvm)) {
+		// Expected before JDK 21, thread time then covers platform threads only.
+		DEBUG_PRINTF("virtual thread events not supported.");
+	}
+
+	DEBUG_PRINTF("initializing allocation sampling module.");
+	if (!ubench_alloc_samples_init(jvm)) {
+		WARN_PRINTF("allocation sampling not supported.");
+	}
+
+	DEBUG_PRINTF("initializing allocation module.");
+	if (!ubench_allocation_init(jvm)) {
+		WARN_PRINTF("failed to initialize allocation module.");
+	}
+
 	DEBUG_PRINTF("initializing threads module.");
 	if (!ubench_threads_init(jvm)) {
 		WARN_PRINTF("automatic thread registration not supported.");
@@ -20,6 +20,7 @@
 
 #include "compiler.h"
 #include "myatomic.h"
+#include "mytsc.h"
 
 #pragma warning(push, 0)
 #include <inttypes.h>
@@ -36,33 +37,19 @@
 #include <sys/resource.h>
 #endif
 
-#ifdef HAS_TIMESPEC
-typedef struct timespec timestamp_t;
-#elif defined(HAS_QUERY_PERFORMANCE_COUNTER)
-#pragma warning(push, 0)
-#include <windows.h>
-#pragma warning(pop)
-typedef LARGE_INTEGER timestamp_t;
-#else
-typedef int timestamp_t;
-#endif
+#ifdef HAS_PERF_EVENTS
+#include <pthread.h>
 
-#ifdef HAS_TIMESPEC
-typedef struct timespec threadtime_t;
-#elif defined(HAS_GET_THREAD_TIMES)
-#pragma warning(push, 0)
-#include <windows.h>
-#pragma warning(pop)
+/* Userspace counter reads are only possible on x86. */
+#if defined(__x86_64__) || defined(__i386__)
+#define HAS_PERF_EVENTS_RDPMC
+#endif
 
-typedef struct {
-	FILETIME kernel;
-	FILETIME user;
-} threadtime_t;
-#else
-typedef int threadtime_t;
+struct perf_event_mmap_page;
 #endif
 
 #define UBENCH_MAX_PAPI_EVENTS 20
+#define UBENCH_MAX_LINUX_EVENTS 20
 
 
 /*
@@ -97,29 +84,86 @@ typedef int_fast64_t native_tid_t;
 #define UBENCH_EVENT_BACKEND_SYS_WALLCLOCK 8
 #define UBENCH_EVENT_BACKEND_JVM_COMPILATIONS 16
 #define UBENCH_EVENT_BACKEND_SYS_THREADTIME 32
+#define UBENCH_EVENT_BACKEND_SYS_TSC 64
+#define UBENCH_EVENT_BACKEND_JVM_GC 128
+#define UBENCH_EVENT_BACKEND_JVM_ALLOCATIONS 256
+#define UBENCH_EVENT_BACKEND_JVM_ALLOC_SAMPLES 512
+#define UBENCH_EVENT_BACKEND_JVM_MONITORS 1024
+#define UBENCH_EVENT_BACKEND_JVM_SAFEPOINTS 2048
 
 #define UBENCH_SNAPSHOT_TYPE_START (-1)
 #define UBENCH_SNAPSHOT_TYPE_END (-2)
 
-typedef struct ubench_events_snapshot {
-	timestamp_t timestamp;
-	threadtime_t threadtime;
-#ifdef HAS_GETRUSAGE
-	struct rusage resource_usage;
-#endif
-	long compilations;
-	int garbage_collections;
-#ifdef HAS_PAPI
-	long long papi_events[UBENCH_MAX_PAPI_EVENTS];
-	int papi_rc1;
-	int papi_rc2;
-#endif
-	int type;
-} ubench_events_snapshot_t;
+/*
+ * Snapshot records are arrays of 64-bit slots. The first slot always holds
+ * the record type (UBENCH_SNAPSHOT_TYPE_* or user id of a sample) and the
+ * second one identifies the thread that took the snapshot. The rest is
+ * described by ubench_snapshot_layout_t of the event set so that only the
+ * data of the backends actually used are stored.
+ */
+typedef int64_t ubench_snapshot_slot_t;
+
+#define UBENCH_SNAPSHOT_SLOT_TYPE 0
+#define UBENCH_SNAPSHOT_SLOT_THREAD 1
+
+/* Slot index of a backend that is not used by the event set. */
+#define UBENCH_SNAPSHOT_SLOT_NONE ((size_t) -1)
+
+/*
+ * Offsets (in slots) of backend data within a snapshot record.
+ *
+ * Wall clock and thread time are single slots with nanoseconds (or raw
+ * ticks where conversion is not trivial). Resource usage takes two slots:
+ * thread CPU time in microseconds and forced context switches. GC takes
+ * two slots as well: number of collections and their total pause time (in
+ * wall clock units). Allocation samples take the number of samples and
+ * a wall clock timestamp. Monitors take the number of contended enters
+ * and the time spent blocked on them (in wall clock units). Safepoints
+ * take their number and total time (in ticks of the HotSpot clock). PAPI
+ * takes a status slot followed by the counter values. LINUX takes a status
+ * slot followed by the counter group in the layout returned by read() on
+ * the group leader (i.e. the number of counters followed by their values).
+ */
+typedef struct ubench_snapshot_layout {
+	size_t wallclock;
+	size_t tsc;
+	size_t threadtime;
+	size_t resource_usage;
+	size_t compilations;
+	size_t gc;
+	size_t allocations;
+	size_t alloc_samples;
+	size_t monitors;
+	size_t safepoints;
+	size_t papi;
+	size_t linux_events;
+	size_t size;
+} ubench_snapshot_layout_t;
+
+/*
+ * Start and end record of a single measurement.
+ */
+typedef struct ubench_snapshot_pair {
+	const ubench_snapshot_slot_t* start;
+	const ubench_snapshot_slot_t* end;
+} ubench_snapshot_pair_t;
+
+/*
+ * Measured interval of a thread (in wall clock units), index is the index
+ * of the measurement in the results.
+ */
+typedef struct ubench_interval {
+	int64_t thread;
+	int64_t start;
+	int64_t end;
+	int64_t index;
+} ubench_interval_t;
 
 typedef struct ubench_event_info ubench_event_info_t;
-typedef long long (*event_getter_raw_func_t)(const ubench_events_snapshot_t*, const ubench_event_info_t*);
-typedef long long (*event_getter_func_t)(const ubench_events_snapshot_t*, const ubench_events_snapshot_t*, const ubench_event_info_t*);
+typedef long long (*event_getter_raw_func_t)(const ubench_snapshot_slot_t*, const ubench_event_info_t*);
+typedef long long (*event_getter_func_t)(const ubench_snapshot_slot_t*, const ubench_snapshot_slot_t*, const ubench_event_info_t*);
+// Computes values of many measurements at once.
+typedef void (*event_getter_column_func_t)(const ubench_snapshot_pair_t*, size_t, int64_t*, const ubench_event_info_t*);
 typedef int (*event_info_iterator_callback_t)(const char*, void*);
 
 struct ubench_event_info {
@@ -127,11 +171,52 @@ struct ubench_event_info {
 	int id;
 	int papi_component;
 	size_t papi_index;
+	uint32_t linux_type;
+	uint64_t linux_config;
+	size_t linux_index;
+	// Record slots with the event value and the backend status (if any).
+	size_t slot;
+	size_t status_slot;
 	event_getter_raw_func_t op_get_raw;
 	event_getter_func_t op_get;
+	event_getter_column_func_t op_get_column;
 	char* name;
 };
 
+/*
+ * Running statistics of a single event (see summary.c).
+ */
+typedef struct ubench_summary {
+	int64_t count;
+	double mean;
+	// Sum of squared differences from the mean.
+	double m2;
+	int64_t min;
+	int64_t max;
+	// Measurements with backend errors (not part of the statistics).
+	int64_t failed_count;
+} ubench_summary_t;
+
+/*
+ * HDR histogram of a single event (see histogram.c).
+ *
+ * Values are recorded with two significant decimal digits: each power of
+ * two range is split into 128 linear sub-buckets. Covering all
+ * non-negative 64-bit values takes 56 such ranges (the first one also
+ * holds the values below 128).
+ */
+#define UBENCH_HISTOGRAM_SUB_BUCKET_HALF_COUNT_MAGNITUDE 7
+#define UBENCH_HISTOGRAM_BUCKET_COUNT 56
+#define UBENCH_HISTOGRAM_COUNTS_LENGTH \
+	((UBENCH_HISTOGRAM_BUCKET_COUNT + 1) << UBENCH_HISTOGRAM_SUB_BUCKET_HALF_COUNT_MAGNITUDE)
+
+typedef struct ubench_histogram {
+	int64_t dropped_count;
+	int64_t counts[UBENCH_HISTOGRAM_COUNTS_LENGTH];
+} ubench_histogram_t;
+
+struct ubench_spill;
+
 typedef struct benchmark_configuration {
 	unsigned int used_backends;
 
@@ -145,27 +230,120 @@ typedef struct benchmark_configuration {
 	int papi_component;
 #endif
 
-	ubench_events_snapshot_t* data;
-	size_t data_size;
-	size_t data_index;
+#ifdef HAS_PERF_EVENTS
+	uint32_t used_linux_event_types[UBENCH_MAX_LINUX_EVENTS];
+	uint64_t used_linux_event_configs[UBENCH_MAX_LINUX_EVENTS];
+	size_t used_linux_events_count;
+	int linux_fds[UBENCH_MAX_LINUX_EVENTS];
+	bool linux_grouped;
+	// Mapped counter pages for reading the counters via rdpmc (if possible).
+	volatile struct perf_event_mmap_page* linux_pages[UBENCH_MAX_LINUX_EVENTS];
+	bool linux_rdpmc;
+	pthread_t linux_rdpmc_thread;
+#endif
+
+	ubench_snapshot_layout_t layout;
+	ubench_snapshot_slot_t* data;
+	volatile size_t data_size;
+	// Records are claimed atomically, so several threads can record at once.
+	// The index has a cache line of its own, it is the only field written
+	// while recording and the rest is read by all the recording threads.
+	CACHE_ALIGNED ubench_atomic_size_t data_index;
+
+	// File backing the data when spilling (NULL for in-memory data).
+	struct ubench_spill* spill;
 } benchmark_configuration_t;
 
+extern bool ubench_allocation_init(JavaVM*);
+extern bool ubench_allocation_prepare(JNIEnv*);
+extern int64_t ubench_allocation_get_current_thread_bytes(void);
+
+extern bool ubench_alloc_samples_init(JavaVM*);
+extern int64_t ubench_alloc_samples_get_current_thread_count(void);
+extern jobject ubench_alloc_samples_export(JNIEnv*, ubench_interval_t*, size_t);
+
 extern bool ubench_counters_init(JavaVM*);
+
+extern bool ubench_monitors_init(JavaVM*);
+extern bool ubench_monitors_enable(void);
+extern void ubench_monitors_store_current_thread(ubench_snapshot_slot_t*);
+
+extern bool ubench_vthreads_init(JavaVM*);
+extern bool ubench_vthreads_enable(void);
+extern int64_t ubench_vthreads_get_thread_time(int64_t);
+extern int ubench_vthreads_get_current_id(void);
+extern void ubench_journal_init(jvmtiEnv*);
+extern void ubench_journal_record_load(jmethodID, jint, const void*, const void*);
+extern void ubench_journal_record_unload(jmethodID, const void*);
 extern bool ubench_measurement_init(void);
 
 extern bool ubench_threads_init(JavaVM*);
-extern native_tid_t ubench_threads_get_native_id(java_tid_t);
+extern native_tid_t ubench_threads_get_native_id(JNIEnv*, java_tid_t);
 
 extern bool ubench_event_init(void);
 extern int ubench_event_resolve(const char*, ubench_event_info_t*);
 extern void ubench_event_iterate(event_info_iterator_callback_t, void*);
+extern void ubench_event_compute_layout(benchmark_configuration_t*);
 
-extern void ubench_measure_start(const benchmark_configuration_t*, ubench_events_snapshot_t*);
-extern void ubench_measure_sample(const benchmark_configuration_t*, ubench_events_snapshot_t*, int user_id);
-extern void ubench_measure_stop(const benchmark_configuration_t*, ubench_events_snapshot_t*);
+extern void ubench_kernels_init(void);
+extern void ubench_kernel_subtract(int64_t*, const int64_t*, size_t);
+extern void ubench_kernel_multiply(int64_t*, int64_t, size_t);
+
+#ifdef HAS_PERF_EVENTS
+typedef struct ubench_perf_process ubench_perf_process_t;
+
+extern bool ubench_perf_event_probe(uint32_t, uint64_t);
+extern int ubench_perf_event_open(benchmark_configuration_t*, native_tid_t, bool, bool);
+extern void ubench_perf_event_close(benchmark_configuration_t*);
+
+extern int ubench_perf_process_create(benchmark_configuration_t*, ubench_perf_process_t**);
+extern void ubench_perf_process_destroy(ubench_perf_process_t*);
+extern void ubench_perf_process_attach_thread(native_tid_t);
+extern void ubench_perf_process_start(ubench_perf_process_t*);
+extern void ubench_perf_process_stop(ubench_perf_process_t*);
+extern void ubench_perf_process_reset(ubench_perf_process_t*);
+extern const ubench_snapshot_slot_t* ubench_perf_process_get_records(ubench_perf_process_t*, size_t*);
+#endif
+
+#ifdef HAS_MMAP
+extern int ubench_spill_open(benchmark_configuration_t*, const char*);
+extern bool ubench_spill_grow(benchmark_configuration_t*, size_t);
+extern void ubench_spill_reset(benchmark_configuration_t*);
+extern void ubench_spill_close(benchmark_configuration_t*);
+
+extern bool ubench_hsperf_prepare(void);
+extern void ubench_hsperf_store_safepoints(ubench_snapshot_slot_t*);
+extern long long ubench_hsperf_ticks_to_ns(long long);
+#endif
+
+extern void ubench_summary_reset(ubench_summary_t*);
+extern void ubench_summary_add(ubench_summary_t*, int64_t);
+extern void ubench_summary_merge(ubench_summary_t*, const ubench_summary_t*);
+
+extern void ubench_histogram_reset(ubench_histogram_t*);
+extern void ubench_histogram_record(ubench_histogram_t*, int64_t);
+extern void ubench_histogram_merge(ubench_histogram_t*, const ubench_histogram_t*);
+
+extern int ubench_measure_get_thread_id(void);
+extern int ubench_measure_new_thread_id(void);
+extern void ubench_measure_release_thread_id(int);
+extern void ubench_measure_release_current_thread_id(void);
+extern int64_t ubench_measure_get_wallclock(void);
+extern int64_t ubench_measure_get_threadtime(void);
+extern void ubench_measure_start(const benchmark_configuration_t*, ubench_snapshot_slot_t*);
+extern void ubench_measure_sample(const benchmark_configuration_t*, ubench_snapshot_slot_t*, int user_id);
+extern void ubench_measure_stop(const benchmark_configuration_t*, ubench_snapshot_slot_t*);
+
+/*
+ * Returns the snapshot record with the given index.
+ */
+static inline ubench_snapshot_slot_t*
+ubench_snapshot_get(const benchmark_configuration_t* config, size_t index) {
+	return config->data + index * config->layout.size;
+}
 
-extern ubench_atomic_int_t counter_compilation;
-extern ubench_atomic_int_t counter_compilation_total;
+extern int ubench_counters_get_compilation_total(void);
 extern ubench_atomic_int_t counter_gc_total;
+extern ubench_atomic_int64_t counter_gc_pause_time;
 
 #endif
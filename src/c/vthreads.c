@@ -0,0 +1,307 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Thread time of virtual threads (JDK 21 and newer).
+ *
+ * A virtual thread runs on different carrier threads over time, so the
+ * CPU time of the current native thread says nothing about it. HotSpot
+ * reports mounting and unmounting of virtual threads through JVMTI
+ * extension events: on unmount we add the CPU time the carrier spent since
+ * the mount to the virtual thread (kept in its JVMTI thread-local storage)
+ * and SYS:thread-time snapshots taken in a virtual thread read this sum
+ * plus the time since the last mount. The first run of a virtual thread is
+ * reported as VirtualThreadStart (instead of a mount) and the last one ends
+ * with VirtualThreadEnd (instead of an unmount).
+ *
+ * Virtual threads that measure something also get their own measurement
+ * thread id (see ubench_measure_get_thread_id), so that their start and
+ * stop snapshots pair even when taken on different carriers. The id is
+ * returned for reuse when the virtual thread ends.
+ *
+ * The can_support_virtual_threads capability makes every mount and unmount
+ * more expensive, therefore it is added (and the events are enabled) only
+ * when the first event set with SYS:thread-time is created. A virtual
+ * thread that is mounted at that moment is accounted for from its next
+ * mount.
+ */
+
+#include "compiler.h"
+#include "jvmutil.h"
+#include "logging.h"
+#include "mylock.h"
+#include "ubench.h"
+
+#pragma warning(push, 0)
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jni.h>
+#include <jvmti.h>
+#pragma warning(pop)
+
+#ifdef JNI_VERSION_21
+
+#define VTHREAD_MOUNT_EVENT "com.sun.hotspot.events.VirtualThreadMount"
+#define VTHREAD_UNMOUNT_EVENT "com.sun.hotspot.events.VirtualThreadUnmount"
+
+typedef struct {
+	// Measurement thread id (assigned on first use).
+	int thread_id;
+	// CPU time spent on carriers until the last unmount.
+	int64_t thread_time;
+	// CPU time of the carrier at the last mount.
+	int64_t mount_time;
+} vthread_state_t;
+
+/* State of the virtual thread mounted on the current (carrier) thread. */
+static THREAD_LOCAL vthread_state_t* current_vthread = NULL;
+
+static vthread_state_t*
+get_vthread_state(jvmtiEnv* jvmti, jthread thread) {
+	vthread_state_t* state = NULL;
+	jvmtiError err = (*jvmti)->GetThreadLocalStorage(jvmti, thread, (void**) &state);
+	if (err != JVMTI_ERROR_NONE) {
+		return NULL;
+	}
+
+	if (state == NULL) {
+		state = calloc(1, sizeof(vthread_state_t));
+		if (state == NULL) {
+			return NULL;
+		}
+		if ((*jvmti)->SetThreadLocalStorage(jvmti, thread, state) != JVMTI_ERROR_NONE) {
+			free(state);
+			return NULL;
+		}
+	}
+
+	return state;
+}
+
+/* Also used for VirtualThreadStart, the first mount is not reported. */
+static void JNICALL
+jvmti_callback_on_vthread_mount(jvmtiEnv* jvmti, JNIEnv* UNUSED_PARAMETER(jni), jthread thread) {
+	vthread_state_t* state = get_vthread_state(jvmti, thread);
+	if (state != NULL) {
+		state->mount_time = ubench_measure_get_threadtime();
+	}
+	current_vthread = state;
+}
+
+static void JNICALL
+jvmti_callback_on_vthread_unmount(
+	jvmtiEnv* UNUSED_PARAMETER(jvmti), JNIEnv* UNUSED_PARAMETER(jni), jthread UNUSED_PARAMETER(thread)
+) {
+	vthread_state_t* state = current_vthread;
+	if (state != NULL) {
+		state->thread_time += ubench_measure_get_threadtime() - state->mount_time;
+	}
+	current_vthread = NULL;
+}
+
+static void JNICALL
+jvmti_callback_on_vthread_end(jvmtiEnv* jvmti, JNIEnv* UNUSED_PARAMETER(jni), jthread thread) {
+	// Reported on the carrier instead of the last unmount.
+	current_vthread = NULL;
+
+	vthread_state_t* state = NULL;
+	if ((*jvmti)->GetThreadLocalStorage(jvmti, thread, (void**) &state) == JVMTI_ERROR_NONE) {
+		(*jvmti)->SetThreadLocalStorage(jvmti, thread, NULL);
+		if (state != NULL) {
+			// Reused (with its per-thread buffers) by the next new thread.
+			ubench_measure_release_thread_id(state->thread_id);
+		}
+		free(state);
+	}
+}
+
+static jvmti_context_t vthreads_context = {
+	// Added with the first event set using SYS:thread-time.
+	.has_capabilities = false,
+	.callbacks = {
+		.VirtualThreadStart = &jvmti_callback_on_vthread_mount,
+		.VirtualThreadEnd = &jvmti_callback_on_vthread_end,
+	},
+	// Enabled with the first event set using SYS:thread-time.
+	.events = {
+		0
+	}
+};
+
+static jint vthread_mount_index = -1;
+static jint vthread_unmount_index = -1;
+
+static bool vthreads_available = false;
+static ubench_spinlock_t vthreads_enable_lock = UBENCH_SPINLOCK_INITIALIZER;
+static volatile bool vthreads_enabled = false;
+
+static void
+deallocate(jvmtiEnv* jvmti, void* ptr) {
+	(*jvmti)->Deallocate(jvmti, (unsigned char*) ptr);
+}
+
+static bool
+find_extension_events(jvmtiEnv* jvmti) {
+	jint count = 0;
+	jvmtiExtensionEventInfo* events = NULL;
+	if ((*jvmti)->GetExtensionEvents(jvmti, &count, &events) != JVMTI_ERROR_NONE) {
+		return false;
+	}
+
+	for (jint i = 0; i < count; i++) {
+		if (strcmp(events[i].id, VTHREAD_MOUNT_EVENT) == 0) {
+			vthread_mount_index = events[i].extension_event_index;
+		} else if (strcmp(events[i].id, VTHREAD_UNMOUNT_EVENT) == 0) {
+			vthread_unmount_index = events[i].extension_event_index;
+		}
+
+		for (jint j = 0; j < events[i].param_count; j++) {
+			deallocate(jvmti, events[i].params[j].name);
+		}
+		deallocate(jvmti, events[i].params);
+		deallocate(jvmti, events[i].short_description);
+		deallocate(jvmti, events[i].id);
+	}
+	deallocate(jvmti, events);
+
+	return (vthread_mount_index >= 0) && (vthread_unmount_index >= 0);
+}
+
+INTERNAL bool
+ubench_vthreads_init(JavaVM* jvm) {
+	assert(jvm != NULL);
+
+	if (!ubench_jvmti_context_init_and_enable(&vthreads_context, jvm)) {
+		return false;
+	}
+
+	vthreads_available = find_extension_events(vthreads_context.jvmti);
+	return vthreads_available;
+}
+
+static bool
+enable_events(jvmtiEnv* jvmti) {
+	jvmtiCapabilities capabilities;
+	memset(&capabilities, 0, sizeof(capabilities));
+	capabilities.can_support_virtual_threads = 1;
+	jvmtiError err = (*jvmti)->AddCapabilities(jvmti, &capabilities);
+	if (err != JVMTI_ERROR_NONE) {
+		DEBUG_PRINTF("failed to add virtual thread capability (error %ld).", (long) err);
+		return false;
+	}
+
+	jvmtiError err_start = (*jvmti)->SetEventNotificationMode(jvmti, JVMTI_ENABLE, JVMTI_EVENT_VIRTUAL_THREAD_START, NULL);
+	jvmtiError err_end = (*jvmti)->SetEventNotificationMode(jvmti, JVMTI_ENABLE, JVMTI_EVENT_VIRTUAL_THREAD_END, NULL);
+	// Setting the callback enables the extension event.
+	jvmtiError err_mount = (*jvmti)->SetExtensionEventCallback(
+		jvmti, vthread_mount_index, (jvmtiExtensionEvent) &jvmti_callback_on_vthread_mount
+	);
+	jvmtiError err_unmount = (*jvmti)->SetExtensionEventCallback(
+		jvmti, vthread_unmount_index, (jvmtiExtensionEvent) &jvmti_callback_on_vthread_unmount
+	);
+	if ((err_start != JVMTI_ERROR_NONE) || (err_end != JVMTI_ERROR_NONE)
+		|| (err_mount != JVMTI_ERROR_NONE) || (err_unmount != JVMTI_ERROR_NONE)) {
+		DEBUG_PRINTF(
+			"failed to enable virtual thread events (errors %ld, %ld, %ld, %ld).",
+			(long) err_start, (long) err_end, (long) err_mount, (long) err_unmount
+		);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Enables the mount events, called when creating an event set with
+ * SYS:thread-time. Returns false when virtual threads are not supported
+ * (thread time of platform threads does not need the events).
+ */
+INTERNAL bool
+ubench_vthreads_enable(void) {
+	if (!vthreads_available) {
+		return false;
+	}
+	if (vthreads_enabled) {
+		return true;
+	}
+
+	ubench_spinlock_lock(&vthreads_enable_lock);
+	if (!vthreads_enabled) {
+		vthreads_enabled = enable_events(vthreads_context.jvmti);
+	}
+	ubench_spinlock_unlock(&vthreads_enable_lock);
+
+	return vthreads_enabled;
+}
+
+/*
+ * Converts CPU time of the current native thread to the CPU time of the
+ * virtual thread running on it (if any).
+ */
+INTERNAL int64_t
+ubench_vthreads_get_thread_time(int64_t carrier_time) {
+	const vthread_state_t* state = current_vthread;
+	if (state == NULL) {
+		return carrier_time;
+	}
+
+	return state->thread_time + (carrier_time - state->mount_time);
+}
+
+/*
+ * Returns measurement thread id of the virtual thread running on the
+ * current native thread (0 when there is none).
+ */
+INTERNAL int
+ubench_vthreads_get_current_id(void) {
+	// Only the virtual thread itself can get here, no locking needed.
+	vthread_state_t* state = current_vthread;
+	if (state == NULL) {
+		return 0;
+	}
+
+	if (state->thread_id == 0) {
+		state->thread_id = ubench_measure_new_thread_id();
+	}
+	return state->thread_id;
+}
+
+#else
+
+INTERNAL bool
+ubench_vthreads_init(JavaVM* UNUSED_PARAMETER(jvm)) {
+	return false;
+}
+
+INTERNAL bool
+ubench_vthreads_enable(void) {
+	return false;
+}
+
+INTERNAL int64_t
+ubench_vthreads_get_thread_time(int64_t carrier_time) {
+	return carrier_time;
+}
+
+INTERNAL int
+ubench_vthreads_get_current_id(void) {
+	return 0;
+}
+
+#endif
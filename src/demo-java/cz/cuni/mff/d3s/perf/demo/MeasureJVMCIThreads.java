@@ -16,16 +16,14 @@
  */
 package cz.cuni.mff.d3s.perf.demo;
 
-import java.io.File;
-import java.io.FileReader;
-import java.io.IOException;
 import java.util.ArrayList;
 import java.util.List;
-import java.util.Scanner;
 
 import cz.cuni.mff.d3s.perf.BenchmarkResults;
 import cz.cuni.mff.d3s.perf.Measurement;
 import cz.cuni.mff.d3s.perf.MeasurementException;
+import cz.cuni.mff.d3s.perf.NativeThreadInfo;
+import cz.cuni.mff.d3s.perf.NativeThreads;
 
 public class MeasureJVMCIThreads {
     private static final String[] EVENTS = { "PAPI_TOT_INS" };
@@ -75,36 +73,9 @@ public class MeasureJVMCIThreads {
     private static ThreadWrapper[] getJVMCIThreads() {
         List<ThreadWrapper> result = new ArrayList<>();
 
-        for (Thread t : Thread.getAllStackTraces().keySet()) {
-            if (t.getName().startsWith("JVMCI CompilerThread")) {
-                result.add(ThreadWrapper.createJavaThread(t));
-            }
-        }
-
-        File tasks = new File("/xproc/self/task");
-        File[] threadDirs = tasks.listFiles();
-        for (File threadDir : threadDirs) {
-            try {
-                long id = Long.parseLong(threadDir.getName());
-                FileReader reader = new FileReader(new File(threadDir, "status"));
-                Scanner sc = new Scanner(reader);
-                while (sc.hasNextLine()) {
-                    String line = sc.nextLine();
-                    String[] parts = line.split("\t", 2);
-                    if (parts.length != 2) {
-                        continue;
-                    }
-                    if (parts[0].equals("Name:")) {
-                        String name = parts[1];
-                        if (name.startsWith("JVMCI CompilerT")) {
-                            result.add(ThreadWrapper.createNativeThread(id, name));
-                        }
-                        break;
-                    }
-                }
-                sc.close();
-            } catch (IOException e) {
-                continue;
+        for (NativeThreadInfo t : NativeThreads.listThreads()) {
+            if (t.getName().startsWith("JVMCI CompilerT")) {
+                result.add(ThreadWrapper.createNativeThread(t.getNativeId(), t.getName()));
             }
         }
 
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package cz.cuni.mff.d3s.perf;
+
+/** Single sampled allocation (see {@link AllocationSampler}). */
+public final class AllocationSample {
+    /** Name of the class of the allocated object. */
+    private final String className;
+
+    /** Size of the allocated object. */
+    private final long size;
+
+    /** Agent id of the allocating thread. */
+    private final int threadId;
+
+    /** Time of the allocation. */
+    private final long timestamp;
+
+    /** Index of the measurement that contains the allocation. */
+    private final int measurementIndex;
+
+    /** Create new sample (called by the C agent).
+     *
+     * @param name Class name of the allocated object.
+     * @param bytes Object size in bytes.
+     * @param thread Agent id of the allocating thread.
+     * @param time Timestamp of the allocation.
+     * @param measurement Index of the measurement or -1.
+     */
+    AllocationSample(final String name, final long bytes, final int thread,
+            final long time, final int measurement) {
+        className = name;
+        size = bytes;
+        threadId = thread;
+        timestamp = time;
+        measurementIndex = measurement;
+    }
+
+    /** Get name of the class of the allocated object.
+     *
+     * @return Class name (e.g. java.lang.String or [J), empty when unknown.
+     */
+    public String getClassName() {
+        return className;
+    }
+
+    /** Get size of the allocated object.
+     *
+     * @return Size in bytes.
+     */
+    public long getSize() {
+        return size;
+    }
+
+    /** Get agent id of the allocating thread.
+     *
+     * @return Thread id (as in the THREAD column of results).
+     */
+    public int getThreadId() {
+        return threadId;
+    }
+
+    /** Get time of the allocation.
+     *
+     * <p>
+     * The clock is the one of <code>SYS:wallclock-time</code>, so the
+     * timestamps can be compared with the raw results of event sets.
+     *
+     * @return Timestamp.
+     */
+    public long getTimestamp() {
+        return timestamp;
+    }
+
+    /** Get measurement during which the allocation happened.
+     *
+     * @return Row index in {@link Measurement#getResults(int)} (for samples
+     *     returned by {@link Measurement#getAllocationSamples(int)}) or -1.
+     */
+    public int getMeasurementIndex() {
+        return measurementIndex;
+    }
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package cz.cuni.mff.d3s.perf;
+
+import java.util.List;
+
+/** Sampling of object allocations.
+ *
+ * <p>
+ * When enabled, the JVM reports roughly one allocation per given number of
+ * allocated bytes (JVMTI SampledObjectAlloc, JDK 11 and newer). The C agent
+ * keeps a bounded ring of recent samples per allocating thread, older samples
+ * are overwritten. The ring of a terminated thread is reused by threads
+ * started later, so its samples may be lost then. Samples taken during
+ * measurements of an event set with the <code>JVM:alloc-samples</code> event
+ * are available through {@link Measurement#getAllocationSamples(int)}.
+ */
+public final class AllocationSampler {
+    static {
+        UbenchAgent.load();
+    }
+
+    /** Prevent instantiation. */
+    private AllocationSampler() {}
+
+    /** Start sampling allocations.
+     *
+     * @param samplingInterval Average number of bytes between samples
+     *     (0 samples every allocation).
+     * @throws cz.cuni.mff.d3s.perf.MeasurementException When the JVM does not support
+     *     allocation sampling.
+     */
+    public static void enable(final int samplingInterval) {
+        if (!nativeEnable(samplingInterval)) {
+            throw new MeasurementException("Allocation sampling is not supported.");
+        }
+    }
+
+    /** Enable sampling with a given interval.
+     *
+     * @param samplingInterval Average number of bytes between samples.
+     * @return Whether sampling was enabled.
+     */
+    private static native boolean nativeEnable(int samplingInterval);
+
+    /** Stop sampling allocations (taken samples are kept). */
+    public static native void disable();
+
+    /** Forget all taken samples. */
+    public static native void clear();
+
+    /** Get samples of all threads.
+     *
+     * @return Samples, grouped by thread.
+     */
+    public static native List<AllocationSample> getSamples();
+}
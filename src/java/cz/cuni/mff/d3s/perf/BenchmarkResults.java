@@ -32,4 +32,22 @@ public interface BenchmarkResults {
      * @return Actual benchmark scores.
      */
     List<long[]> getData();
+
+    /** Get values of a single event across all benchmark iterations.
+     *
+     * <p>
+     * Results returned by {@link Measurement} store the values by columns,
+     * so this is cheaper than going through {@link #getData()}.
+     *
+     * @param column Column (event) index.
+     * @return Values of the column.
+     */
+    default long[] getColumn(final int column) {
+        List<long[]> data = getData();
+        long[] result = new long[data.size()];
+        for (int i = 0; i < result.length; i++) {
+            result[i] = data.get(i)[column];
+        }
+        return result;
+    }
 }
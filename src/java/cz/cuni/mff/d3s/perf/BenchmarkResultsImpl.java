@@ -17,35 +17,37 @@
 
 package cz.cuni.mff.d3s.perf;
 
-import java.util.ArrayList;
+import java.util.AbstractList;
 import java.util.Arrays;
-import java.util.Collections;
 import java.util.List;
 
-/** Simplest implementation of BenchmarkResults used by C agent. */
+/** Columnar implementation of BenchmarkResults used by C agent.
+ *
+ * <p>
+ * All values are kept in a single array, column after column, so that the
+ * C agent can export them in bulk. Rows returned by {@link #getData()} are
+ * created only when accessed.
+ */
 class BenchmarkResultsImpl implements BenchmarkResults {
     /** Collected events. */
     private final String[] events;
-    
-    /** Collected data (row-wise). */
-    private final List<long[]> data;
+
+    /** Number of rows. */
+    private final int rowCount;
+
+    /** Collected data (column-wise). */
+    private final long[] values;
 
     /** Construct with given columns.
      *
      * @param eventNames Event names (column headers).
+     * @param rows Number of rows.
+     * @param columnValues Values of all columns (column after column).
      */
-    BenchmarkResultsImpl(final String[] eventNames) {
+    BenchmarkResultsImpl(final String[] eventNames, final int rows, final long[] columnValues) {
         events = eventNames;
-        data = new ArrayList<>();
-    }
-
-    /** Add one data row.
-     *
-     * @param row Counter values.
-     */
-    void addDataRow(final long[] row) {
-        /* Need to create the copy. */
-        data.add(Arrays.copyOf(row, row.length));
+        rowCount = rows;
+        values = columnValues;
     }
 
     /** {@inheritDoc} */
@@ -57,6 +59,32 @@ class BenchmarkResultsImpl implements BenchmarkResults {
     /** {@inheritDoc} */
     @Override
     public List<long[]> getData() {
-        return Collections.unmodifiableList(data);
+        return new AbstractList<long[]>() {
+            @Override
+            public long[] get(final int index) {
+                if ((index < 0) || (index >= rowCount)) {
+                    throw new IndexOutOfBoundsException("Row " + index);
+                }
+                long[] row = new long[events.length];
+                for (int i = 0; i < row.length; i++) {
+                    row[i] = values[i * rowCount + index];
+                }
+                return row;
+            }
+
+            @Override
+            public int size() {
+                return rowCount;
+            }
+        };
+    }
+
+    /** {@inheritDoc} */
+    @Override
+    public long[] getColumn(final int column) {
+        if ((column < 0) || (column >= events.length)) {
+            throw new IndexOutOfBoundsException("Column " + column);
+        }
+        return Arrays.copyOfRange(values, column * rowCount, (column + 1) * rowCount);
     }
 }
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package cz.cuni.mff.d3s.perf;
+
+/** Running statistics of events of a summary event set.
+ *
+ * <p>
+ * Returned by {@link Measurement#getSummary(int)} for event sets created
+ * with {@link Measurement#SUMMARY}. Events are indexed in the order they
+ * were passed when creating the event set.
+ */
+public final class BenchmarkSummary {
+    /** Collected events. */
+    private final String[] events;
+
+    /** Number of measurements of each event. */
+    private final long[] counts;
+
+    /** Mean values. */
+    private final double[] means;
+
+    /** Sums of squared differences from the mean. */
+    private final double[] squaredDifferences;
+
+    /** Minimal values. */
+    private final long[] minimums;
+
+    /** Maximal values. */
+    private final long[] maximums;
+
+    /** Number of failed measurements of each event. */
+    private final long[] failedCounts;
+
+    /** Construct with statistics of all events (called by the C agent).
+     *
+     * @param eventNames Event names.
+     * @param eventCounts Number of measurements.
+     * @param eventMeans Mean values.
+     * @param eventSquaredDifferences Sums of squared differences from the mean.
+     * @param eventMinimums Minimal values.
+     * @param eventMaximums Maximal values.
+     * @param eventFailedCounts Number of failed measurements.
+     */
+    BenchmarkSummary(final String[] eventNames, final long[] eventCounts,
+            final double[] eventMeans, final double[] eventSquaredDifferences,
+            final long[] eventMinimums, final long[] eventMaximums,
+            final long[] eventFailedCounts) {
+        events = eventNames;
+        counts = eventCounts;
+        means = eventMeans;
+        squaredDifferences = eventSquaredDifferences;
+        minimums = eventMinimums;
+        maximums = eventMaximums;
+        failedCounts = eventFailedCounts;
+    }
+
+    /** Get list of collected events.
+     *
+     * @return Event names.
+     */
+    public String[] getEventNames() {
+        return events;
+    }
+
+    /** Get number of measurements.
+     *
+     * @param event Event index.
+     * @return Number of completed measurements.
+     */
+    public long getCount(final int event) {
+        return counts[event];
+    }
+
+    /** Get number of failed measurements.
+     *
+     * <p>
+     * Values the backend failed to read (e.g., an unavailable counter)
+     * are not part of the statistics and are only counted here.
+     *
+     * @param event Event index.
+     * @return Number of measurements with a backend error.
+     */
+    public long getFailedCount(final int event) {
+        return failedCounts[event];
+    }
+
+    /** Get mean value.
+     *
+     * @param event Event index.
+     * @return Mean value (zero when nothing was measured).
+     */
+    public double getMean(final int event) {
+        return means[event];
+    }
+
+    /** Get sample variance.
+     *
+     * @param event Event index.
+     * @return Sample variance (NaN for less than two measurements).
+     */
+    public double getVariance(final int event) {
+        if (counts[event] < 2) {
+            return Double.NaN;
+        }
+        return squaredDifferences[event] / (counts[event] - 1);
+    }
+
+    /** Get sample standard deviation.
+     *
+     * @param event Event index.
+     * @return Sample standard deviation (NaN for less than two measurements).
+     */
+    public double getStandardDeviation(final int event) {
+        return Math.sqrt(getVariance(event));
+    }
+
+    /** Get minimal value.
+     *
+     * @param event Event index.
+     * @return Minimal value (Long.MAX_VALUE when nothing was measured).
+     */
+    public long getMin(final int event) {
+        return minimums[event];
+    }
+
+    /** Get maximal value.
+     *
+     * @param event Event index.
+     * @return Maximal value (Long.MIN_VALUE when nothing was measured).
+     */
+    public long getMax(final int event) {
+        return maximums[event];
+    }
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package cz.cuni.mff.d3s.perf;
+
+/** Single event of the {@link CompilationJournal}. */
+public final class CompilationEvent {
+    /** Time of the event. */
+    private final long timestamp;
+
+    /** Whether compiled code was unloaded (otherwise it was loaded). */
+    private final boolean unload;
+
+    /** JVMTI method id. */
+    private final long method;
+
+    /** Address of the compiled code. */
+    private final long codeAddress;
+
+    /** Size of the compiled code. */
+    private final int codeSize;
+
+    /** Deepest inlining in the compiled code. */
+    private final int inliningDepth;
+
+    /** Agent id of the thread that reported the event. */
+    private final int threadId;
+
+    /** Method name (resolved lazily). */
+    private String methodName;
+
+    /** Construct the event.
+     *
+     * @param time Time of the event.
+     * @param isUnload Whether compiled code was unloaded.
+     * @param methodId JVMTI method id.
+     * @param address Address of the compiled code.
+     * @param size Size of the compiled code (zero for unloads).
+     * @param depth Deepest inlining in the compiled code (zero for unloads).
+     * @param thread Agent id of the thread that reported the event.
+     */
+    CompilationEvent(final long time, final boolean isUnload, final long methodId,
+            final long address, final int size, final int depth, final int thread) {
+        timestamp = time;
+        unload = isUnload;
+        method = methodId;
+        codeAddress = address;
+        codeSize = size;
+        inliningDepth = depth;
+        threadId = thread;
+    }
+
+    /** Get time of the event.
+     *
+     * <p>
+     * The clock is the one of <code>SYS:wallclock-time</code>, so the
+     * timestamps can be compared with the raw results of event sets.
+     *
+     * @return Timestamp.
+     */
+    public long getTimestamp() {
+        return timestamp;
+    }
+
+    /** Tell whether the compiled code was unloaded.
+     *
+     * @return True for unloaded code, false for newly compiled code.
+     */
+    public boolean isUnload() {
+        return unload;
+    }
+
+    /** Get JVMTI method id (opaque identifier).
+     *
+     * @return Method id.
+     */
+    public long getMethodId() {
+        return method;
+    }
+
+    /** Get name of the method (with class name and signature).
+     *
+     * @return Method name or null when it cannot be resolved (e.g. class was unloaded).
+     */
+    public synchronized String getMethodName() {
+        if (methodName == null) {
+            methodName = CompilationJournal.resolveMethodName(method);
+        }
+        return methodName;
+    }
+
+    /** Get address of the compiled code.
+     *
+     * @return Code address.
+     */
+    public long getCodeAddress() {
+        return codeAddress;
+    }
+
+    /** Get size of the compiled code.
+     *
+     * @return Code size in bytes (zero for unloads).
+     */
+    public int getCodeSize() {
+        return codeSize;
+    }
+
+    /** Get deepest inlining in the compiled code.
+     *
+     * @return Number of inlined frames (zero when unknown or for unloads).
+     */
+    public int getInliningDepth() {
+        return inliningDepth;
+    }
+
+    /** Get agent id of the thread that reported the event.
+     *
+     * @return Thread id (as in the THREAD column of results).
+     */
+    public int getThreadId() {
+        return threadId;
+    }
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package cz.cuni.mff.d3s.perf;
+
+import java.util.ArrayList;
+import java.util.Comparator;
+import java.util.List;
+
+/** Journal of individual JIT compilation events.
+ *
+ * <p>
+ * Unlike {@link CompilationCounter}, the journal records which methods were
+ * compiled (and when their compiled code was unloaded, e.g. after
+ * deoptimization), so that a latency spike can be attributed to a specific
+ * recompilation. Recording is off by default. The C agent keeps a bounded
+ * ring of recent events per compiler thread, older events are overwritten.
+ */
+public final class CompilationJournal {
+    /** Values of a single entry returned by the C agent. */
+    private static final int ENTRY_FIELDS = 7;
+
+    /** Offset of the event kind in an entry. */
+    private static final int FIELD_KIND = 1;
+
+    /** Offset of the method id in an entry. */
+    private static final int FIELD_METHOD = 2;
+
+    /** Offset of the code address in an entry. */
+    private static final int FIELD_CODE_ADDRESS = 3;
+
+    /** Offset of the code size in an entry. */
+    private static final int FIELD_CODE_SIZE = 4;
+
+    /** Offset of the inlining depth in an entry. */
+    private static final int FIELD_INLINING_DEPTH = 5;
+
+    /** Offset of the thread id in an entry. */
+    private static final int FIELD_THREAD = 6;
+
+    /** Kind of the entry for unloaded code. */
+    private static final long KIND_UNLOAD = 2;
+
+    static {
+        UbenchAgent.load();
+    }
+
+    /** Prevent instantiation. */
+    private CompilationJournal() {}
+
+    /** Start recording compilation events. */
+    public static void enable() {
+        setEnabled(true);
+    }
+
+    /** Stop recording compilation events (recorded events are kept). */
+    public static void disable() {
+        setEnabled(false);
+    }
+
+    /** Enable or disable recording.
+     *
+     * @param enabled Whether to record the events.
+     */
+    private static native void setEnabled(boolean enabled);
+
+    /** Forget all recorded events. */
+    public static native void clear();
+
+    /** Read entries of all compiler threads.
+     *
+     * @return Entry values (ENTRY_FIELDS per entry) or null when out of memory.
+     */
+    private static native long[] readEntries();
+
+    /** Resolve method name of a given JVMTI method id.
+     *
+     * @param method Method id.
+     * @return Method name with class name and signature or null.
+     */
+    static native String resolveMethodName(long method);
+
+    /** Get recorded events.
+     *
+     * <p>
+     * Method names are resolved only when requested from the individual
+     * events.
+     *
+     * @return Events of all threads ordered by their timestamps.
+     * @throws cz.cuni.mff.d3s.perf.MeasurementException When the journal cannot be read.
+     */
+    public static List<CompilationEvent> getEvents() {
+        long[] entries = readEntries();
+        if (entries == null) {
+            throw new MeasurementException("Out of memory (reading compilation journal).");
+        }
+
+        List<CompilationEvent> events = new ArrayList<>(entries.length / ENTRY_FIELDS);
+        for (int i = 0; i < entries.length; i += ENTRY_FIELDS) {
+            events.add(new CompilationEvent(
+                entries[i],
+                entries[i + FIELD_KIND] == KIND_UNLOAD,
+                entries[i + FIELD_METHOD],
+                entries[i + FIELD_CODE_ADDRESS],
+                (int) entries[i + FIELD_CODE_SIZE],
+                (int) entries[i + FIELD_INLINING_DEPTH],
+                (int) entries[i + FIELD_THREAD]));
+        }
+        events.sort(Comparator.comparingLong(CompilationEvent::getTimestamp));
+
+        return events;
+    }
+}
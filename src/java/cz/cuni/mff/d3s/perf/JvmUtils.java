@@ -17,12 +17,8 @@
 
 package cz.cuni.mff.d3s.perf;
 
-import java.io.File;
-import java.io.FileReader;
-import java.io.IOException;
 import java.util.HashSet;
 import java.util.NoSuchElementException;
-import java.util.Scanner;
 import java.util.Set;
 
 /** Gather information about JVM. */
@@ -38,7 +34,8 @@ public final class JvmUtils {
      * OSes and individual JVMs.
      *
      * <p>
-     * <b>Warning:</b> This method uses Thread.getAllStackTraces() to
+     * <b>Warning:</b> Where {@link NativeThreads#listThreads()} is not
+     * supported, this method uses Thread.getAllStackTraces() to
      * retrieve list of all threads (as iterating through top-most
      * thread group does not give a full list). This method has behavior
      * of (almost) stop-the-world. Therefore, do not invoke this method
@@ -50,65 +47,31 @@ public final class JvmUtils {
     public static Set<Long> getNativeIdsOfJvmciThreads() {
         Set<Long> result = new HashSet<>();
 
+        try {
+            for (NativeThreadInfo t : NativeThreads.listThreads()) {
+                if (t.getName().startsWith("JVMCI CompilerT")) {
+                    result.add(t.getNativeId());
+                }
+            }
+            return result;
+        } catch (UnsupportedOperationException e) {
+            // Only Java threads can be found then.
+        }
+
         for (Thread t : Thread.getAllStackTraces().keySet()) {
             if (t.getName().startsWith("JVMCI CompilerThread")) {
                 try {
                     long nativeId = NativeThreads.getNativeId(t);
                     result.add(nativeId);
                 } catch (NoSuchElementException e) {
-                    // Okay, the thread is not known, we will try some
-                    // other way later on.
+                    // Okay, the thread is not known.
                 }
             }
         }
 
-        linuxGetSelfThreadsStartingWith("JVMCI CompilerT", result);
-
         return result;
     }
 
-    /** Get list of native ids of threads starting with given prefix.
-     *
-     * <p>
-     * The prefix is tested on native names as found in
-     * <code>/proc/nnnn/status</code> file.
-     *
-     * @param prefix Native thread name prefix.
-     * @param pids Where to store the found ids.
-     */
-    private static void linuxGetSelfThreadsStartingWith(final String prefix, final Set<Long> pids) {
-        File tasks = new File("/proc/self/task");
-        File[] threadDirs = tasks.listFiles();
-        if (threadDirs == null) {
-            return;
-        }
-
-        for (File threadDir : threadDirs) {
-            try {
-                long id = Long.parseLong(threadDir.getName());
-                FileReader reader = new FileReader(new File(threadDir, "status"));
-                Scanner sc = new Scanner(reader);
-                while (sc.hasNextLine()) {
-                    String line = sc.nextLine();
-                    String[] parts = line.split("\t", 2);
-                    if (parts.length != 2) {
-                        continue;
-                    }
-                    if (parts[0].equals("Name:")) {
-                        String name = parts[1];
-                        if (name.startsWith(prefix)) {
-                            pids.add(id);
-                        }
-                        break;
-                    }
-                }
-                sc.close();
-            } catch (IOException e) {
-                continue;
-            }
-        }
-    }
-
     /** Checks that the native agent is actually attached to the JVM.
      *
      * @return Whether the native part of this library is available.
@@ -0,0 +1,303 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package cz.cuni.mff.d3s.perf;
+
+import java.io.ByteArrayOutputStream;
+
+/** HDR histogram of values of a single event.
+ *
+ * <p>
+ * Returned by {@link Measurement#getHistogram(int, int)} for event sets
+ * created with {@link Measurement#HISTOGRAM}. The layout is the one of
+ * HdrHistogram: every power of two range of values is split into the same
+ * number of linear sub-buckets, hence values are kept with a fixed
+ * relative precision (given by the sub-bucket count). Negative values
+ * (failed measurements) are only counted as dropped.
+ */
+public final class LatencyHistogram {
+    /** Format version of {@link #toByteArray()}. */
+    private static final int SERIALIZATION_VERSION = 1;
+
+    /** Bits of a single byte of the variable-length encoding. */
+    private static final int VARINT_SHIFT = 7;
+
+    /** Mask of the value bits of a single byte of the encoding. */
+    private static final int VARINT_MASK = 0x7F;
+
+    /** Continuation bit of the encoding. */
+    private static final int VARINT_CONTINUATION = 0x80;
+
+    /** Largest supported sub-bucket magnitude (twice the half count must fit into int). */
+    private static final int MAX_MAGNITUDE = 30;
+
+    /** Percentile of all values. */
+    private static final double HUNDRED_PERCENT = 100.0;
+
+    /** Log2 of half of the number of sub-buckets in a bucket. */
+    private final int subBucketHalfCountMagnitude;
+
+    /** Half of the number of sub-buckets in a bucket. */
+    private final int subBucketHalfCount;
+
+    /** Counts of all sub-buckets. */
+    private final long[] counts;
+
+    /** Number of recorded values. */
+    private final long totalCount;
+
+    /** Number of values that were not recorded. */
+    private final long droppedCount;
+
+    /** Construct with given counts (called by the C agent).
+     *
+     * @param magnitude Log2 of half of the number of sub-buckets in a bucket.
+     * @param bucketCounts Counts of all sub-buckets.
+     * @param dropped Number of values that were not recorded.
+     */
+    LatencyHistogram(final int magnitude, final long[] bucketCounts, final long dropped) {
+        if ((magnitude < 0) || (magnitude > MAX_MAGNITUDE)) {
+            throw new IllegalArgumentException("Invalid sub-bucket magnitude " + magnitude);
+        }
+        subBucketHalfCountMagnitude = magnitude;
+        subBucketHalfCount = 1 << magnitude;
+        counts = bucketCounts;
+        droppedCount = dropped;
+
+        long total = 0;
+        for (long count : counts) {
+            total += count;
+        }
+        totalCount = total;
+    }
+
+    /** Get number of recorded values.
+     *
+     * @return Number of recorded values.
+     */
+    public long getTotalCount() {
+        return totalCount;
+    }
+
+    /** Get number of values that were not recorded (failed measurements).
+     *
+     * @return Number of dropped values.
+     */
+    public long getDroppedCount() {
+        return droppedCount;
+    }
+
+    /** Get value at given percentile.
+     *
+     * <p>
+     * Returns the highest value equivalent (within the precision of the
+     * histogram) to the value below which the given percentage of the
+     * recorded values fall.
+     *
+     * @param percentile Percentile (between 0 and 100).
+     * @return Value at the percentile (zero for an empty histogram).
+     */
+    public long getValueAtPercentile(final double percentile) {
+        double requested = Math.min(Math.max(percentile, 0.0), HUNDRED_PERCENT);
+        long countAtPercentile = (long) Math.ceil(requested / HUNDRED_PERCENT * totalCount);
+        countAtPercentile = Math.max(countAtPercentile, 1);
+
+        long cumulative = 0;
+        for (int i = 0; i < counts.length; i++) {
+            cumulative += counts[i];
+            if (cumulative >= countAtPercentile) {
+                return getHighestEquivalentValue(i);
+            }
+        }
+        return 0;
+    }
+
+    /** Get smallest recorded value (within the histogram precision).
+     *
+     * @return Smallest recorded value (zero for an empty histogram).
+     */
+    public long getMinValue() {
+        for (int i = 0; i < counts.length; i++) {
+            if (counts[i] > 0) {
+                return getLowestEquivalentValue(i);
+            }
+        }
+        return 0;
+    }
+
+    /** Get largest recorded value (within the histogram precision).
+     *
+     * @return Largest recorded value (zero for an empty histogram).
+     */
+    public long getMaxValue() {
+        for (int i = counts.length - 1; i >= 0; i--) {
+            if (counts[i] > 0) {
+                return getHighestEquivalentValue(i);
+            }
+        }
+        return 0;
+    }
+
+    /** Merge with another histogram.
+     *
+     * @param other Histogram with the same layout (e.g. of another run).
+     * @return New histogram with values of both histograms.
+     */
+    public LatencyHistogram merge(final LatencyHistogram other) {
+        if ((other.subBucketHalfCountMagnitude != subBucketHalfCountMagnitude)
+                || (other.counts.length != counts.length)) {
+            throw new IllegalArgumentException("Histograms have different layouts.");
+        }
+
+        long[] merged = new long[counts.length];
+        for (int i = 0; i < merged.length; i++) {
+            merged[i] = counts[i] + other.counts[i];
+        }
+        return new LatencyHistogram(subBucketHalfCountMagnitude, merged,
+            droppedCount + other.droppedCount);
+    }
+
+    /** Serialize the histogram into a compact form.
+     *
+     * <p>
+     * All numbers are stored as variable-length integers and runs of empty
+     * sub-buckets take only a single number (stored as a negative length).
+     *
+     * @return Serialized histogram (see {@link #fromByteArray(byte[])}).
+     */
+    public byte[] toByteArray() {
+        ByteArrayOutputStream output = new ByteArrayOutputStream();
+        writeVarint(output, SERIALIZATION_VERSION);
+        writeVarint(output, subBucketHalfCountMagnitude);
+        writeVarint(output, counts.length);
+        writeVarint(output, droppedCount);
+
+        int i = 0;
+        while (i < counts.length) {
+            int zeros = 0;
+            while ((i + zeros < counts.length) && (counts[i + zeros] == 0)) {
+                zeros++;
+            }
+            if (zeros > 1) {
+                writeVarint(output, -zeros);
+                i += zeros;
+            } else {
+                writeVarint(output, counts[i]);
+                i++;
+            }
+        }
+
+        return output.toByteArray();
+    }
+
+    /** Deserialize histogram created by {@link #toByteArray()}.
+     *
+     * @param data Serialized histogram.
+     * @return Histogram.
+     * @throws IllegalArgumentException Malformed data.
+     */
+    public static LatencyHistogram fromByteArray(final byte[] data) {
+        int[] position = {0};
+        if (readVarint(data, position) != SERIALIZATION_VERSION) {
+            throw new IllegalArgumentException("Unsupported histogram format.");
+        }
+        int magnitude = (int) readVarint(data, position);
+        long length = readVarint(data, position);
+        long dropped = readVarint(data, position);
+        if ((length < 0) || (length > Integer.MAX_VALUE)) {
+            throw new IllegalArgumentException("Invalid histogram length.");
+        }
+
+        long[] bucketCounts = new long[(int) length];
+        int i = 0;
+        while (i < bucketCounts.length) {
+            long value = readVarint(data, position);
+            if (value >= 0) {
+                bucketCounts[i] = value;
+                i++;
+            } else if (-value <= bucketCounts.length - i) {
+                i += (int) -value;
+            } else {
+                throw new IllegalArgumentException("Invalid run of empty buckets.");
+            }
+        }
+
+        return new LatencyHistogram(magnitude, bucketCounts, dropped);
+    }
+
+    /** Get lowest value stored in a given sub-bucket.
+     *
+     * @param index Index into counts.
+     * @return Lowest value of the sub-bucket.
+     */
+    private long getLowestEquivalentValue(final int index) {
+        int bucketIndex = (index >> subBucketHalfCountMagnitude) - 1;
+        long subBucketIndex = (index & (subBucketHalfCount - 1)) + subBucketHalfCount;
+        if (bucketIndex < 0) {
+            subBucketIndex -= subBucketHalfCount;
+            bucketIndex = 0;
+        }
+        return subBucketIndex << bucketIndex;
+    }
+
+    /** Get highest value stored in a given sub-bucket.
+     *
+     * @param index Index into counts.
+     * @return Highest value of the sub-bucket.
+     */
+    private long getHighestEquivalentValue(final int index) {
+        int bucketIndex = Math.max((index >> subBucketHalfCountMagnitude) - 1, 0);
+        return getLowestEquivalentValue(index) + (1L << bucketIndex) - 1;
+    }
+
+    /** Write zig-zag encoded variable-length integer.
+     *
+     * @param output Where to write.
+     * @param value Value to write.
+     */
+    private static void writeVarint(final ByteArrayOutputStream output, final long value) {
+        long encoded = (value << 1) ^ (value >> (Long.SIZE - 1));
+        while ((encoded & ~VARINT_MASK) != 0) {
+            output.write((int) (encoded & VARINT_MASK) | VARINT_CONTINUATION);
+            encoded >>>= VARINT_SHIFT;
+        }
+        output.write((int) encoded);
+    }
+
+    /** Read zig-zag encoded variable-length integer.
+     *
+     * @param data Data to read from.
+     * @param position Position in data (updated).
+     * @return Value read.
+     */
+    private static long readVarint(final byte[] data, final int[] position) {
+        long encoded = 0;
+        int shift = 0;
+        while (true) {
+            if ((position[0] >= data.length) || (shift >= Long.SIZE)) {
+                throw new IllegalArgumentException("Truncated histogram data.");
+            }
+            int b = data[position[0]] & (VARINT_MASK | VARINT_CONTINUATION);
+            position[0]++;
+            encoded |= ((long) (b & VARINT_MASK)) << shift;
+            if ((b & VARINT_CONTINUATION) == 0) {
+                break;
+            }
+            shift += VARINT_SHIFT;
+        }
+        return (encoded >>> 1) ^ -(encoded & 1);
+    }
+}
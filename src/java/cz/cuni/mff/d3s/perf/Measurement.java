@@ -32,6 +32,97 @@ public final class Measurement {
      */
     public static final int THREAD_INHERIT = 1;
 
+    /** Always read LINUX counters through the read() syscall.
+     *
+     * <p>
+     * By default, counters measuring the calling thread are read directly
+     * from userspace (via the rdpmc instruction) when the kernel allows it.
+     * This flag for <code>create*EventSet*</code> calls disables that,
+     * which is mostly useful for estimating the overhead of the two paths.
+     */
+    public static final int NO_RDPMC = 2;
+
+    /** Store measurements in a memory-mapped file that grows as needed.
+     *
+     * <p>
+     * By default, the C agent keeps at most <code>measurementCount</code>
+     * measurements (pairs of start and stop records) in memory and keeps
+     * overwriting the last one when the buffer is full (see
+     * {@link #getDroppedRecordCount(int)}). With this flag for
+     * <code>create*EventSet*</code> calls, <code>measurementCount</code>
+     * only sets the size of a file segment and the buffer grows for as long
+     * as needed. Completed parts are written to the file in the background
+     * and dropped from memory.
+     *
+     * <p>
+     * The file is created in the directory given by the
+     * <code>ubench.spill.dir</code> system property (defaulting to
+     * <code>java.io.tmpdir</code>) and removed when the event set is
+     * destroyed. Not supported on Windows.
+     */
+    public static final int SPILL_TO_FILE = 4;
+
+    /** Give every thread recording into the event set its own buffer.
+     *
+     * <p>
+     * By default, threads sharing an event set claim records from a single
+     * buffer. With this flag for <code>create*EventSet*</code> calls, each
+     * thread gets a cache-line aligned buffer of its own (allocated on its
+     * first use) for up to <code>measurementCount</code> measurements, so
+     * the threads do not interfere with each other when recording.
+     * {@link #getResults(int)} merges the buffers and adds a THREAD column.
+     * Buffers (and THREAD ids) of terminated threads are reused by threads
+     * started later. Cannot be combined with {@link #SPILL_TO_FILE}.
+     */
+    public static final int PER_THREAD_BUFFERS = 8;
+
+    /** Keep only running statistics instead of individual measurements.
+     *
+     * <p>
+     * With this flag for <code>create*EventSet*</code> calls, every stop
+     * folds the measured values into per-event count, mean, variance,
+     * minimum and maximum (kept per thread), so the memory used does not
+     * depend on the number of measurements and
+     * <code>measurementCount</code> is ignored. Use
+     * {@link #getSummary(int)} to retrieve the statistics. Values the
+     * backend failed to read are left out and counted as failed
+     * measurements instead. Samples are ignored. Cannot be combined with
+     * {@link #SPILL_TO_FILE}.
+     */
+    public static final int SUMMARY = 16;
+
+    /** Keep HDR histograms of the measured values.
+     *
+     * <p>
+     * Implies {@link #SUMMARY}: in addition to the running statistics,
+     * every stop records the measured values into a histogram of every
+     * event (with two significant digits of precision). Use
+     * {@link #getHistogram(int, int)} to retrieve them.
+     */
+    public static final int HISTOGRAM = 32;
+
+    /** Measure every thread of the process separately.
+     *
+     * <p>
+     * With this flag for {@link #createEventSet(int, String[], int...)},
+     * counters are opened for all threads of the process (as listed by
+     * <code>/proc/self/task</code>, so including JIT and GC threads). Java
+     * threads are added as they start, other threads started later are
+     * found after every stop (and measured from the next start). Every stop
+     * adds a row for each thread, {@link #getResults(int)} adds a THREAD
+     * column with the native thread ids and <code>measurementCount</code> is
+     * ignored. Only LINUX events are supported and the flag cannot be
+     * combined with other flags. Results must not be read while measuring.
+     *
+     * <p>
+     * Start and stop read the counters of every thread (one system call
+     * per thread), so they take longer the more threads there are. The
+     * calling thread is read last on start and first on stop, hence this
+     * cost is not part of its own measurement, but the intervals of the
+     * other threads are shifted by up to the time of reading them all.
+     */
+    public static final int ALL_THREADS = 64;
+
     /** Generics' helper. */
     private static final String[] STRING_ARRAY_TYPE = new String[0];
 
@@ -43,6 +134,13 @@ public final class Measurement {
     private Measurement() {}
 
     /** Create new event set.
+     *
+     * <p>
+     * Several threads may start, stop and sample the same event set
+     * concurrently: every thread gets its own records and the results pair
+     * start and stop of the same thread. Note that the PAPI and LINUX
+     * counters still count the thread the event set was created on (or
+     * attached to) unless {@link #THREAD_INHERIT} is used.
      *
      * @param measurementCount How many measurements should the C agent remember.
      * @param events An array of event names (use {@link #getSupportedEvents()} to get
@@ -118,18 +216,79 @@ public final class Measurement {
      */
     public static native void destroyEventSet(int eventSet);
 
+    /** Create a group of event sets that are started and stopped together.
+     *
+     * <p>
+     * The event sets are validated only once here, so that
+     * {@link #startGroup(int)} and {@link #stopGroup(int)} can go through
+     * all of them in a single cheap native call. Destroy the group before
+     * destroying any of its event sets.
+     *
+     * @param eventSets Event sets in the group (in the order they are started).
+     * @return Group number (opaque identifier).
+     * @throws cz.cuni.mff.d3s.perf.MeasurementException Invalid event set identification.
+     */
+    public static native int createEventSetGroup(int... eventSets);
+
+    /** Destroy existing event set group (the event sets are kept).
+     *
+     * <p>
+     * The group must not be started, stopped or sampled concurrently
+     * with this call.
+     *
+     * @param group Group to destroy.
+     * @throws cz.cuni.mff.d3s.perf.MeasurementException Invalid group identification.
+     */
+    public static native void destroyEventSetGroup(int group);
+
+    /** Start actual measurement.
+     *
+     * <p>
+     * Cheaper variant of {@link #start(int...)} for a single event set.
+     * Where the JVM allows it, the call also skips the usual JNI transition
+     * (through critical natives or java.lang.foreign downcalls).
+     *
+     * @param eventSet Event set where the measurement is started.
+     */
+    public static void start(final int eventSet) {
+        checkEntryPointResult(MeasurementEntryPoints.start(eventSet));
+    }
+
     /** Start actual measurement.
      *
      * @param eventSet Array of event sets where the measurements are started.
      */
     public static native void start(int... eventSet);
 
+    /** Start actual measurement in all event sets of a group.
+     *
+     * @param group Event set group (see {@link #createEventSetGroup(int...)}).
+     */
+    public static native void startGroup(int group);
+
+    /** Stop actual measurement.
+     *
+     * <p>
+     * Cheaper variant of {@link #stop(int...)} for a single event set.
+     *
+     * @param eventSet Event set where the measurement is stopped.
+     */
+    public static void stop(final int eventSet) {
+        checkEntryPointResult(MeasurementEntryPoints.stop(eventSet));
+    }
+
     /** Stop actual measurement.
      *
      * @param eventSet Array of event sets where the measurements are stopped.
      */
     public static native void stop(int... eventSet);
 
+    /** Stop actual measurement in all event sets of a group.
+     *
+     * @param group Event set group (see {@link #createEventSetGroup(int...)}).
+     */
+    public static native void stopGroup(int group);
+
     /** Sample the event counters.
      *
      * <p>
@@ -144,6 +303,36 @@ public final class Measurement {
      */
     public static native void sample(int sampleId, int... eventSet);
 
+    /** Sample the event counters of a single event set.
+     *
+     * <p>
+     * Cheaper variant of {@link #sample(int, int...)} for a single event set.
+     *
+     * @param sampleId User id to distinguish different calls.
+     * @param eventSet Event set where the measurement should be sampled.
+     */
+    public static void sample(final int sampleId, final int eventSet) {
+        checkEntryPointResult(MeasurementEntryPoints.sample(sampleId, eventSet));
+    }
+
+    /** Sample the event counters of all event sets of a group.
+     *
+     * @param sampleId User id to distinguish different calls.
+     * @param group Event set group (see {@link #createEventSetGroup(int...)}).
+     */
+    public static native void sampleGroup(int sampleId, int group);
+
+    /** Report failure of a single event set entry point.
+     *
+     * @param result Result of the MeasurementEntryPoints call.
+     * @throws cz.cuni.mff.d3s.perf.MeasurementException Invalid event set identification.
+     */
+    private static void checkEntryPointResult(final int result) {
+        if (result != 0) {
+            throw new MeasurementException("Invalid event set id.");
+        }
+    }
+
     /** Clear measurements.
      *
      * @param eventSet Array of event sets where the measurements are removed.
@@ -151,6 +340,10 @@ public final class Measurement {
     public static native void reset(int... eventSet);
 
     /** Retrieve results for one event set.
+     *
+     * <p>
+     * For event sets with {@link #PER_THREAD_BUFFERS}, the last column is
+     * THREAD, identifying the thread that recorded the row.
      *
      * @param eventSet Event set identification.
      * @return Measurement results.
@@ -162,13 +355,63 @@ public final class Measurement {
      * <p>
      * Note that the last column would always be TYPE with number -1 to
      * denote call to start(), -2 call to stop() and positive numbers
-     * denoting parameters from sample() call.
+     * denoting parameters from sample() call. The column before it is
+     * THREAD, identifying the thread that recorded the row.
      *
      * @param eventSet Event set identification.
      * @return Measurement results.
      */
     public static native BenchmarkResults getRawResults(int eventSet);
 
+    /** Count records lost because the buffer of the event set was full.
+     *
+     * <p>
+     * Records that do not fit overwrite the last measurement, so the
+     * results of an event set with a non-zero count are incomplete.
+     * Event sets with per-thread buffers (including {@link #SUMMARY})
+     * also count records of threads that could not get a buffer (too many
+     * threads alive at once or out of memory).
+     * The count is cleared by {@link #reset(int...)}.
+     *
+     * @param eventSet Event set identification.
+     * @return Number of lost records (two per lost measurement).
+     */
+    public static native long getDroppedRecordCount(int eventSet);
+
+    /** Retrieve running statistics of a summary event set.
+     *
+     * @param eventSet Event set identification (created with {@link #SUMMARY}).
+     * @return Statistics of all events of the event set.
+     * @throws cz.cuni.mff.d3s.perf.MeasurementException Invalid event set
+     *     identification or event set without {@link #SUMMARY}.
+     */
+    public static native BenchmarkSummary getSummary(int eventSet);
+
+    /** Retrieve histogram of one event of a histogram event set.
+     *
+     * @param eventSet Event set identification (created with {@link #HISTOGRAM}).
+     * @param event Event index (in the order used when creating the event set).
+     * @return Histogram of the event values recorded by all threads.
+     * @throws cz.cuni.mff.d3s.perf.MeasurementException Invalid event set
+     *     identification or event set without {@link #HISTOGRAM}.
+     */
+    public static native LatencyHistogram getHistogram(int eventSet, int event);
+
+    /** Retrieve allocations sampled during measurements of one event set.
+     *
+     * <p>
+     * Only samples taken by the measured thread between start and stop are
+     * returned, each with the index of its measurement (row of
+     * {@link #getResults(int)}). Sampling has to be enabled with
+     * {@link AllocationSampler#enable(int)}.
+     *
+     * @param eventSet Event set identification (with <code>JVM:alloc-samples</code>).
+     * @return Sampled allocations.
+     * @throws cz.cuni.mff.d3s.perf.MeasurementException Invalid event set
+     *     identification or event set without <code>JVM:alloc-samples</code>.
+     */
+    public static native List<AllocationSample> getAllocationSamples(int eventSet);
+
     /** Checks that event is supported.
      *
      * @param event Event name.
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package cz.cuni.mff.d3s.perf;
+
+import java.lang.invoke.MethodHandle;
+
+/** Cheapest available calls of start, stop and sample of a single event set.
+ *
+ * <p>
+ * The natives have critical variants that HotSpot (up to JDK 17) uses for
+ * compiled callers, skipping the JNI environment setup. On JDK 21 and newer,
+ * the same native functions are called through java.lang.foreign downcalls
+ * that skip the thread state transitions altogether (see
+ * {@link UbenchAgent#createDowncall(long, int)}).
+ *
+ * <p>
+ * All the calls return 0 or -1 for an invalid event set id, as the critical
+ * variants and the downcalls cannot throw exceptions. Both return
+ * {@link #NEEDS_JNI} for event sets with events that call back into the JVM
+ * (such as {@code JVM:allocated-bytes}) and for event sets that may block
+ * (spilled, per-thread, summary, PAPI or all-threads event sets), these are
+ * then measured through plain JNI.
+ */
+final class MeasurementEntryPoints {
+    /** Entry point id of start (for getDowncallAddress). */
+    static final int START = 0;
+
+    /** Entry point id of stop (for getDowncallAddress). */
+    static final int STOP = 1;
+
+    /** Entry point id of sample (for getDowncallAddress). */
+    static final int SAMPLE = 2;
+
+    /** Result of a downcall that has to be repeated through JNI. */
+    static final int NEEDS_JNI = -2;
+
+    static {
+        UbenchAgent.load();
+    }
+
+    /** Downcall to start (null when not available). */
+    private static final MethodHandle START_DOWNCALL =
+            UbenchAgent.createDowncall(getDowncallAddress(START), 1);
+
+    /** Downcall to stop (null when not available). */
+    private static final MethodHandle STOP_DOWNCALL =
+            UbenchAgent.createDowncall(getDowncallAddress(STOP), 1);
+
+    /** Downcall to sample (null when not available). */
+    private static final MethodHandle SAMPLE_DOWNCALL =
+            UbenchAgent.createDowncall(getDowncallAddress(SAMPLE), 2);
+
+    /** Prevent instantiation. */
+    private MeasurementEntryPoints() {}
+
+    /** Tells whether the downcalls are used.
+     *
+     * @return Whether java.lang.foreign downcalls are used instead of JNI.
+     */
+    static boolean usesDowncalls() {
+        return START_DOWNCALL != null;
+    }
+
+    /** Start measurement in one event set.
+     *
+     * @param eventSet Event set identification.
+     * @return 0 on success, -1 for invalid event set.
+     */
+    static int start(final int eventSet) {
+        if (START_DOWNCALL == null) {
+            int result = criticalStart(eventSet);
+            if (result == NEEDS_JNI) {
+                return nativeStart(eventSet);
+            }
+            return result;
+        }
+        int result;
+        try {
+            result = (int) START_DOWNCALL.invokeExact(eventSet);
+        } catch (RuntimeException | Error e) {
+            throw e;
+        } catch (Throwable e) {
+            throw new MeasurementException(e.toString());
+        }
+        if (result == NEEDS_JNI) {
+            return nativeStart(eventSet);
+        }
+        return result;
+    }
+
+    /** Stop measurement in one event set.
+     *
+     * @param eventSet Event set identification.
+     * @return 0 on success, -1 for invalid event set.
+     */
+    static int stop(final int eventSet) {
+        if (STOP_DOWNCALL == null) {
+            int result = criticalStop(eventSet);
+            if (result == NEEDS_JNI) {
+                return nativeStop(eventSet);
+            }
+            return result;
+        }
+        int result;
+        try {
+            result = (int) STOP_DOWNCALL.invokeExact(eventSet);
+        } catch (RuntimeException | Error e) {
+            throw e;
+        } catch (Throwable e) {
+            throw new MeasurementException(e.toString());
+        }
+        if (result == NEEDS_JNI) {
+            return nativeStop(eventSet);
+        }
+        return result;
+    }
+
+    /** Sample counters of one event set.
+     *
+     * @param sampleId User id to distinguish different calls.
+     * @param eventSet Event set identification.
+     * @return 0 on success, -1 for invalid event set.
+     */
+    static int sample(final int sampleId, final int eventSet) {
+        if (SAMPLE_DOWNCALL == null) {
+            int result = criticalSample(sampleId, eventSet);
+            if (result == NEEDS_JNI) {
+                return nativeSample(sampleId, eventSet);
+            }
+            return result;
+        }
+        int result;
+        try {
+            result = (int) SAMPLE_DOWNCALL.invokeExact(sampleId, eventSet);
+        } catch (RuntimeException | Error e) {
+            throw e;
+        } catch (Throwable e) {
+            throw new MeasurementException(e.toString());
+        }
+        if (result == NEEDS_JNI) {
+            return nativeSample(sampleId, eventSet);
+        }
+        return result;
+    }
+
+    /** Start measurement in one event set through a critical native.
+     *
+     * @param eventSet Event set identification.
+     * @return 0 on success, -1 for invalid event set, {@link #NEEDS_JNI}
+     *     when the event set has to be started through JNI.
+     */
+    private static native int criticalStart(int eventSet);
+
+    /** Stop measurement in one event set through a critical native.
+     *
+     * @param eventSet Event set identification.
+     * @return 0 on success, -1 for invalid event set, {@link #NEEDS_JNI}
+     *     when the event set has to be stopped through JNI.
+     */
+    private static native int criticalStop(int eventSet);
+
+    /** Sample counters of one event set through a critical native.
+     *
+     * @param sampleId User id to distinguish different calls.
+     * @param eventSet Event set identification.
+     * @return 0 on success, -1 for invalid event set, {@link #NEEDS_JNI}
+     *     when the event set has to be sampled through JNI.
+     */
+    private static native int criticalSample(int sampleId, int eventSet);
+
+    /** Start measurement in one event set through JNI.
+     *
+     * @param eventSet Event set identification.
+     * @return 0 on success, -1 for invalid event set.
+     */
+    private static native int nativeStart(int eventSet);
+
+    /** Stop measurement in one event set through JNI.
+     *
+     * @param eventSet Event set identification.
+     * @return 0 on success, -1 for invalid event set.
+     */
+    private static native int nativeStop(int eventSet);
+
+    /** Sample counters of one event set through JNI.
+     *
+     * @param sampleId User id to distinguish different calls.
+     * @param eventSet Event set identification.
+     * @return 0 on success, -1 for invalid event set.
+     */
+    private static native int nativeSample(int sampleId, int eventSet);
+
+    /** Get address of the native function behind an entry point.
+     *
+     * @param entryPoint Entry point id (START, STOP or SAMPLE).
+     * @return Address of the native function.
+     */
+    private static native long getDowncallAddress(int entryPoint);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package cz.cuni.mff.d3s.perf;
+
+/** Native thread of the JVM process (see {@link NativeThreads#listThreads()}). */
+public final class NativeThreadInfo {
+    /** What the thread is used for. */
+    public enum Kind {
+        /** Thread running Java code (as reported by JVMTI). */
+        JAVA,
+        /** JIT compiler thread (C1, C2 or JVMCI). */
+        JIT,
+        /** Garbage collector thread. */
+        GC,
+        /** Any other thread of the JVM. */
+        VM
+    }
+
+    /** Native id of the thread. */
+    private final long nativeId;
+
+    /** Name of the thread. */
+    private final String name;
+
+    /** Kind of the thread. */
+    private final Kind kind;
+
+    /** Create new thread information (called by the C agent).
+     *
+     * @param id Native thread id.
+     * @param threadName Thread name as seen by the OS.
+     * @param threadKind Kind of the thread.
+     */
+    NativeThreadInfo(final long id, final String threadName, final Kind threadKind) {
+        nativeId = id;
+        name = threadName;
+        kind = threadKind;
+    }
+
+    /** Get native id of the thread.
+     *
+     * @return Native thread id (as accepted by
+     *     {@link Measurement#createAttachedEventSetOnNativeThread}).
+     */
+    public long getNativeId() {
+        return nativeId;
+    }
+
+    /** Get name of the thread.
+     *
+     * <p>
+     * This is the name known to the OS, on Linux it is truncated to
+     * 15 characters (e.g. <code>C2 CompilerThre</code>).
+     *
+     * @return Thread name.
+     */
+    public String getName() {
+        return name;
+    }
+
+    /** Get kind of the thread.
+     *
+     * @return Thread kind.
+     */
+    public Kind getKind() {
+        return kind;
+    }
+}
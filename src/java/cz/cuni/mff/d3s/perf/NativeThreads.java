@@ -17,6 +17,7 @@
 
 package cz.cuni.mff.d3s.perf;
 
+import java.util.List;
 import java.util.NoSuchElementException;
 
 /** Mapping between Java threads and their native ids. */
@@ -85,4 +86,23 @@ public final class NativeThreads {
      * @return Whether registration was successful.
      */
     private static native boolean registerCurrentJavaThread(long javaThreadId);
+
+    /** List all native threads of the JVM process.
+     *
+     * <p>
+     * Unlike {@link Thread#getAllStackTraces()}, the list includes threads
+     * that are not visible from Java, such as JIT compiler and GC threads.
+     * Threads reported by JVMTI are of kind
+     * {@link NativeThreadInfo.Kind#JAVA}, the other ones are classified by
+     * their names (on best effort basis, the names differ between JVMs).
+     *
+     * <p>
+     * The agent caches the list, so repeated calls only read names of
+     * the threads started since the previous call.
+     *
+     * @return Threads of the process.
+     * @throws UnsupportedOperationException when not supported by the OS
+     *     (currently only Linux is supported).
+     */
+    public static native List<NativeThreadInfo> listThreads();
 }
@@ -1,5 +1,8 @@
 package cz.cuni.mff.d3s.perf;
 
+import java.lang.invoke.MethodHandle;
+import java.lang.reflect.Array;
+
 /**
  * Agent library loader. Allows loading the 'ubench-agent' library explicitly 
  * using {@link System#loadLibrary()} (if not loaded as native agent).
@@ -16,6 +19,81 @@ final class UbenchAgent {
         }
     }
     
+    /** Creates a downcall handle for a native function of the agent.
+     *
+     * <p>
+     * The function takes the given number of int arguments and returns int.
+     * The handle is created through java.lang.foreign (JDK 21 and newer)
+     * and marks the call as critical, i.e. the JVM does not switch the thread
+     * state around the call. That is only possible for short functions that
+     * do not call back into the JVM (such as start or stop of an event set).
+     *
+     * <p>
+     * The API is accessed reflectively so that the agent still builds and
+     * runs on older JDKs. Setting the <code>ubench.downcalls</code> system
+     * property to <code>false</code> disables the downcalls (JNI is used
+     * instead).
+     *
+     * @param address Address of the native function.
+     * @param parameterCount Number of int parameters.
+     * @return Downcall handle or {@code null} when not available.
+     */
+    static MethodHandle createDowncall(final long address, final int parameterCount) {
+        if ((address == 0)
+                || !Boolean.parseBoolean(System.getProperty("ubench.downcalls", "true"))) {
+            return null;
+        }
+
+        try {
+            final Class<?> linkerClass = Class.forName("java.lang.foreign.Linker");
+            final Class<?> optionClass = Class.forName("java.lang.foreign.Linker$Option");
+            final Class<?> segmentClass = Class.forName("java.lang.foreign.MemorySegment");
+            final Class<?> layoutClass = Class.forName("java.lang.foreign.MemoryLayout");
+            final Class<?> descriptorClass = Class.forName("java.lang.foreign.FunctionDescriptor");
+
+            final Object intLayout = Class.forName("java.lang.foreign.ValueLayout")
+                .getField("JAVA_INT").get(null);
+            final Object parameterLayouts = Array.newInstance(layoutClass, parameterCount);
+            for (int i = 0; i < parameterCount; i++) {
+                Array.set(parameterLayouts, i, intLayout);
+            }
+            final Object descriptor = descriptorClass
+                .getMethod("of", layoutClass, parameterLayouts.getClass())
+                .invoke(null, intLayout, parameterLayouts);
+
+            final Object function = segmentClass.getMethod("ofAddress", long.class)
+                .invoke(null, address);
+
+            final Object options = Array.newInstance(optionClass, 1);
+            Array.set(options, 0, getCriticalOption(optionClass));
+
+            final Object linker = linkerClass.getMethod("nativeLinker").invoke(null);
+            return (MethodHandle) linkerClass
+                .getMethod("downcallHandle", segmentClass, descriptorClass, options.getClass())
+                .invoke(linker, function, descriptor, options);
+        } catch (final ReflectiveOperationException e) {
+            // Older JDK or native access not allowed.
+            return null;
+        }
+    }
+
+    /** Get linker option that skips thread state transitions.
+     *
+     * @param optionClass The Linker.Option class.
+     * @return The option instance.
+     * @throws ReflectiveOperationException When the option is not available.
+     */
+    private static Object getCriticalOption(final Class<?> optionClass)
+            throws ReflectiveOperationException {
+        try {
+            // JDK 22 and newer.
+            return optionClass.getMethod("critical", boolean.class).invoke(null, false);
+        } catch (final NoSuchMethodException e) {
+            // JDK 21 (preview API).
+            return optionClass.getMethod("isTrivial").invoke(null);
+        }
+    }
+
     /** Determines if the agent library is loaded. 
      * 
      * @return {@code true} if the native library is loaded, {@code false} otherwise.
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package cz.cuni.mff.d3s.perf;
+
+import java.util.List;
+
+import org.junit.*;
+
+public class AllocationSamplerTest {
+    public static volatile Object BLACK_HOLE = null;
+    private static final int ALLOCATIONS = 200;
+    private static final int ARRAY_SIZE = 16 * 1024;
+
+    @Test
+    public void allocationsInMeasurementAreSampled() {
+        try {
+            AllocationSampler.enable(ARRAY_SIZE);
+        } catch (MeasurementException e) {
+            Assume.assumeNoException(e);
+        }
+        AllocationSampler.clear();
+
+        int eventSet = Measurement.createEventSet(1, new String[] { "JVM:alloc-samples" });
+        Measurement.start(eventSet);
+        for (int i = 0; i < ALLOCATIONS; i++) {
+            BLACK_HOLE = new byte[ARRAY_SIZE];
+        }
+        Measurement.stop(eventSet);
+        AllocationSampler.disable();
+
+        List<long[]> data = Measurement.getResults(eventSet).getData();
+        List<AllocationSample> samples = Measurement.getAllocationSamples(eventSet);
+        Measurement.destroyEventSet(eventSet);
+
+        Assert.assertEquals(1, data.size());
+        Assert.assertTrue("some allocations must be sampled", data.get(0)[0] > 0);
+        Assert.assertEquals(data.get(0)[0], samples.size());
+
+        boolean arrayFound = false;
+        for (AllocationSample sample : samples) {
+            Assert.assertEquals(0, sample.getMeasurementIndex());
+            Assert.assertTrue("size must be positive", sample.getSize() > 0);
+            if (sample.getClassName().equals("[B")) {
+                arrayFound = true;
+            }
+        }
+        Assert.assertTrue("byte array must be sampled", arrayFound);
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package cz.cuni.mff.d3s.perf;
+
+import java.util.List;
+
+import org.junit.*;
+
+public class CompilationJournalTest {
+    public static volatile long BLACK_HOLE = 0;
+    private static final int LOOPS_TO_ENSURE_COMPILATION = 100000;
+    private static final int MAX_WAITS = 50;
+
+    @Test
+    public void compilationOfHotMethodIsJournaled() {
+        CompilationJournal.clear();
+        CompilationJournal.enable();
+
+        boolean found = false;
+        for (int wait = 0; (wait < MAX_WAITS) && !found; wait++) {
+            for (int i = 0; i < LOOPS_TO_ENSURE_COMPILATION; i++) {
+                BLACK_HOLE = journaledAction(i);
+            }
+            found = findCompilationOf("journaledAction");
+            if (!found) {
+                TestUtils.noThrowSleep(100);
+            }
+        }
+
+        CompilationJournal.disable();
+        Assert.assertTrue("compilation of journaledAction must be journaled", found);
+    }
+
+    private static boolean findCompilationOf(String methodName) {
+        List<CompilationEvent> events = CompilationJournal.getEvents();
+        long previous = Long.MIN_VALUE;
+        boolean found = false;
+        for (CompilationEvent event : events) {
+            Assert.assertTrue("events must be ordered", event.getTimestamp() >= previous);
+            previous = event.getTimestamp();
+
+            String name = event.getMethodName();
+            if (!event.isUnload() && (name != null) && name.contains("CompilationJournalTest." + methodName)) {
+                Assert.assertTrue("compiled code cannot be empty", event.getCodeSize() > 0);
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    private static long journaledAction(int counter) {
+        return counter * 31L + BLACK_HOLE;
+    }
+}
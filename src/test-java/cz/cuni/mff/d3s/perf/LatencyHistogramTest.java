@@ -0,0 +1,73 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package cz.cuni.mff.d3s.perf;
+
+import org.junit.*;
+
+public class LatencyHistogramTest {
+    /* Same layout as used by the C agent. */
+    private static final int MAGNITUDE = 7;
+    private static final int LENGTH = 57 << MAGNITUDE;
+
+    private static LatencyHistogram withValues(final int... indices) {
+        long[] counts = new long[LENGTH];
+        for (int index : indices) {
+            counts[index]++;
+        }
+        return new LatencyHistogram(MAGNITUDE, counts, 0);
+    }
+
+    @Test
+    public void smallValuesAreExact() {
+        LatencyHistogram histogram = withValues(10, 20, 30, 40);
+
+        Assert.assertEquals(4, histogram.getTotalCount());
+        Assert.assertEquals(10, histogram.getMinValue());
+        Assert.assertEquals(20, histogram.getValueAtPercentile(50));
+        Assert.assertEquals(40, histogram.getValueAtPercentile(100));
+    }
+
+    @Test
+    public void largeValuesKeepRelativePrecision() {
+        // Index 3 * 128 + 64 is the sub-bucket 192 of the third bucket,
+        // i.e. values 768 to 771.
+        LatencyHistogram histogram = withValues(3 * 128 + 64);
+
+        Assert.assertEquals(768, histogram.getMinValue());
+        Assert.assertEquals(771, histogram.getMaxValue());
+    }
+
+    @Test
+    public void mergeAddsCounts() {
+        LatencyHistogram merged = withValues(1, 2).merge(withValues(2, 3));
+
+        Assert.assertEquals(4, merged.getTotalCount());
+        Assert.assertEquals(1, merged.getMinValue());
+        Assert.assertEquals(3, merged.getMaxValue());
+    }
+
+    @Test
+    public void serializationRoundTrips() {
+        LatencyHistogram histogram = withValues(0, 5, 5, 200, LENGTH - 1);
+        byte[] data = histogram.toByteArray();
+        LatencyHistogram copy = LatencyHistogram.fromByteArray(data);
+
+        Assert.assertTrue("serialized form must be compact", data.length < 32);
+        Assert.assertEquals(histogram.getTotalCount(), copy.getTotalCount());
+        Assert.assertEquals(histogram.getMaxValue(), copy.getMaxValue());
+        Assert.assertEquals(histogram.getValueAtPercentile(50), copy.getValueAtPercentile(50));
+    }
+}
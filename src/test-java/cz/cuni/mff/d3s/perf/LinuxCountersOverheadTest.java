@@ -0,0 +1,128 @@
+/*
+ * Copyright 2026 Charles University in Prague
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package cz.cuni.mff.d3s.perf;
+
+import org.junit.*;
+
+public class LinuxCountersOverheadTest {
+    private static final String[] EVENTS = { "LINUX:instructions" };
+
+    private static final int LOOPS = 10;
+    private static final int INNER_LOOPS = 100000;
+
+    /* Iterations of the workload measured by both paths. */
+    private static final int WORKLOAD_LOOPS = 100000;
+
+    /* Both paths shall count (nearly) the same instructions of the workload. */
+    private static final double TOLERANCE = 0.1;
+
+    private static volatile long sink;
+
+    private static double measureEmptyNativeCall() {
+        long best = Long.MAX_VALUE;
+        for (int loop = 0; loop < LOOPS; loop++) {
+            long start = System.nanoTime();
+            for (int i = 0; i < INNER_LOOPS; i++) {
+                OverheadEstimations.emptyNativeCall();
+                OverheadEstimations.emptyNativeCall();
+            }
+            best = Math.min(best, System.nanoTime() - start);
+        }
+        return (double) best / INNER_LOOPS;
+    }
+
+    private static double measureStartStop(int... options) {
+        int eventSet = Measurement.createEventSet(INNER_LOOPS, EVENTS, options);
+
+        long best = Long.MAX_VALUE;
+        for (int loop = 0; loop < LOOPS; loop++) {
+            long start = System.nanoTime();
+            for (int i = 0; i < INNER_LOOPS; i++) {
+                Measurement.start(eventSet);
+                Measurement.stop(eventSet);
+            }
+            best = Math.min(best, System.nanoTime() - start);
+            Measurement.reset(eventSet);
+        }
+
+        Measurement.destroyEventSet(eventSet);
+        return (double) best / INNER_LOOPS;
+    }
+
+    private static void workload() {
+        long sum = 0;
+        for (int i = 0; i < WORKLOAD_LOOPS; i++) {
+            sum += i * i;
+        }
+        sink = sum;
+    }
+
+    private static long measureWorkload(int... options) {
+        int eventSet = Measurement.createEventSet(LOOPS, EVENTS, options);
+        for (int loop = 0; loop < LOOPS; loop++) {
+            Measurement.start(eventSet);
+            workload();
+            Measurement.stop(eventSet);
+        }
+
+        long best = Long.MAX_VALUE;
+        for (long[] row : Measurement.getResults(eventSet).getData()) {
+            Assert.assertTrue(String.format("instruction count must be positive (got %d)", row[0]),
+                    row[0] > 0);
+            best = Math.min(best, row[0]);
+        }
+        Measurement.destroyEventSet(eventSet);
+
+        return best;
+    }
+
+    @Test
+    public void rdpmcAndSyscallCountTheSame() {
+        Assume.assumeTrue(Measurement.isEventSupported(EVENTS[0]));
+
+        // Warm-up (get the workload compiled).
+        for (int i = 0; i < LOOPS; i++) {
+            workload();
+        }
+
+        long rdpmc = measureWorkload();
+        long syscall = measureWorkload(Measurement.NO_RDPMC);
+
+        System.out.printf("Workload takes %d instructions with rdpmc and %d with read().\n",
+                rdpmc, syscall);
+
+        Assert.assertTrue(String.format("rdpmc path (%d) and syscall path (%d) differ",
+                rdpmc, syscall), Math.abs(rdpmc - syscall) <= TOLERANCE * Math.max(rdpmc, syscall));
+    }
+
+    @Test
+    public void printRdpmcAndSyscallOverhead() {
+        Assume.assumeTrue(Measurement.isEventSupported(EVENTS[0]));
+
+        // Warm-up (get everything compiled).
+        measureEmptyNativeCall();
+        measureStartStop();
+        measureStartStop(Measurement.NO_RDPMC);
+
+        double emptyCalls = measureEmptyNativeCall();
+        double rdpmc = measureStartStop();
+        double syscall = measureStartStop(Measurement.NO_RDPMC);
+
+        System.out.printf("Two empty native calls take %.2fns, start+stop takes %.2fns "
+                + "with rdpmc and %.2fns with read() (overhead %.2fns vs. %.2fns).\n",
+                emptyCalls, rdpmc, syscall, rdpmc - emptyCalls, syscall - emptyCalls);
+    }
+}
@@ -16,7 +16,10 @@
  */
 package cz.cuni.mff.d3s.perf;
 
+import java.util.HashSet;
 import java.util.List;
+import java.util.Set;
+import java.util.concurrent.CountDownLatch;
 
 import org.junit.*;
 
@@ -44,4 +47,385 @@ public class MeasurementTest {
         List<String> events = Measurement.getSupportedEvents();
         Assert.assertTrue("PAPI_TOT_INS must be present", events.contains("PAPI:PAPI_TOT_INS"));
     }
+
+    @Test
+    public void listingLinuxEventsWorks() {
+        Assume.assumeTrue(Measurement.isEventSupported("LINUX:task-clock"));
+
+        List<String> events = Measurement.getSupportedEvents();
+        Assert.assertTrue("LINUX:task-clock must be present", events.contains("LINUX:task-clock"));
+    }
+
+    @Test
+    public void linuxEventsAreCounted() {
+        Assume.assumeTrue(Measurement.isEventSupported("LINUX:task-clock"));
+
+        int eventSet = Measurement.createEventSet(1, new String[] { "LINUX:task-clock" });
+        Measurement.start(eventSet);
+        TestUtils.noThrowSleep(10);
+        Measurement.stop(eventSet);
+
+        List<long[]> data = Measurement.getResults(eventSet).getData();
+        Measurement.destroyEventSet(eventSet);
+
+        Assert.assertEquals(1, data.size());
+        Assert.assertTrue("task clock cannot be negative", data.get(0)[0] >= 0);
+    }
+
+    @Test
+    public void allThreadsAreMeasured() throws InterruptedException {
+        Assume.assumeTrue(Measurement.isEventSupported("LINUX:task-clock"));
+
+        int eventSet = Measurement.createEventSet(1, new String[] { "LINUX:task-clock" },
+            Measurement.ALL_THREADS);
+        Measurement.start(eventSet);
+        // Started during the measurement, it must be attached automatically.
+        Thread worker = new Thread(() -> {
+            long end = System.currentTimeMillis() + 100;
+            while (System.currentTimeMillis() < end) {
+                // Busy wait here.
+            }
+        });
+        worker.start();
+        worker.join();
+        Measurement.stop(eventSet);
+
+        BenchmarkResults results = Measurement.getResults(eventSet);
+        List<long[]> data = results.getData();
+        Measurement.destroyEventSet(eventSet);
+
+        Assert.assertArrayEquals(new String[] { "LINUX:task-clock", "THREAD" }, results.getEventNames());
+        Assert.assertTrue("there are more threads than the main one", data.size() > 1);
+
+        long busiest = 0;
+        for (long[] row : data) {
+            Assert.assertTrue("task clock cannot be negative", row[0] >= 0);
+            busiest = Math.max(busiest, row[0]);
+        }
+        Assert.assertTrue("worker must be measured", busiest >= 50 * 1000 * 1000);
+    }
+
+    @Test
+    public void allocatedBytesAreCounted() {
+        Assume.assumeTrue(Measurement.isEventSupported("JVM:allocated-bytes"));
+
+        final int arraySize = 1024 * 1024;
+        int eventSet = -1;
+        try {
+            eventSet = Measurement.createEventSet(1, new String[] { "JVM:allocated-bytes" });
+        } catch (MeasurementException e) {
+            // JDK older than 14.
+            Assume.assumeNoException(e);
+        }
+        Measurement.start(eventSet);
+        long[] array = new long[arraySize];
+        Measurement.stop(eventSet);
+
+        List<long[]> data = Measurement.getResults(eventSet).getData();
+        Measurement.destroyEventSet(eventSet);
+
+        Assert.assertEquals(1, data.size());
+        Assert.assertEquals(arraySize, array.length);
+        Assert.assertTrue("array allocation must be counted", data.get(0)[0] >= arraySize * 8L);
+    }
+
+    @Test
+    public void garbageCollectionsAreCounted() {
+        int eventSet = Measurement.createEventSet(1,
+            new String[] { "JVM:gc-count", "JVM:gc-pause-ns" });
+        Measurement.start(eventSet);
+        System.gc();
+        Measurement.stop(eventSet);
+
+        List<long[]> data = Measurement.getResults(eventSet).getData();
+        Measurement.destroyEventSet(eventSet);
+
+        Assert.assertEquals(1, data.size());
+        Assert.assertTrue("GC count cannot be negative", data.get(0)[0] >= 0);
+        Assert.assertTrue("GC pause cannot be negative", data.get(0)[1] >= 0);
+        if (data.get(0)[0] == 0) {
+            Assert.assertEquals("no GC means no pause", 0, data.get(0)[1]);
+        }
+    }
+
+    @Test
+    public void safepointsAreCounted() {
+        Assume.assumeTrue(Measurement.isEventSupported("JVM:safepoint-count"));
+
+        int eventSet = Measurement.createEventSet(1,
+            new String[] { "JVM:safepoint-count", "JVM:safepoint-ns", "JVM:safepoint-sync-ns" });
+        Measurement.start(eventSet);
+        System.gc();
+        Measurement.stop(eventSet);
+
+        List<long[]> data = Measurement.getResults(eventSet).getData();
+        Measurement.destroyEventSet(eventSet);
+
+        Assert.assertEquals(1, data.size());
+        Assert.assertTrue("safepoint count cannot be negative", data.get(0)[0] >= 0);
+        Assert.assertTrue("safepoint time cannot be negative", data.get(0)[1] >= 0);
+        Assert.assertTrue("safepoint sync time cannot be negative", data.get(0)[2] >= 0);
+    }
+
+    @Test
+    public void contendedMonitorIsCounted() throws InterruptedException {
+        final Object lock = new Object();
+        final CountDownLatch locked = new CountDownLatch(1);
+        Thread holder = new Thread(() -> {
+            synchronized (lock) {
+                locked.countDown();
+                TestUtils.noThrowSleep(100);
+            }
+        });
+
+        int eventSet = Measurement.createEventSet(1,
+            new String[] { "JVM:monitor-contended-enter", "JVM:monitor-wait-ns" });
+        holder.start();
+        locked.await();
+
+        Measurement.start(eventSet);
+        synchronized (lock) {
+            Assert.assertTrue(Thread.holdsLock(lock));
+        }
+        Measurement.stop(eventSet);
+        holder.join();
+
+        List<long[]> data = Measurement.getResults(eventSet).getData();
+        Measurement.destroyEventSet(eventSet);
+
+        Assert.assertEquals(1, data.size());
+        Assert.assertEquals(1, data.get(0)[0]);
+        Assert.assertTrue("thread must have been blocked", data.get(0)[1] > 0);
+    }
+
+    @Test
+    public void spilledEventSetKeepsAllMeasurements() {
+        final int loops = 5000;
+
+        int eventSet;
+        try {
+            eventSet = Measurement.createEventSet(10, new String[] { "SYS:wallclock-time" },
+                Measurement.SPILL_TO_FILE);
+        } catch (MeasurementException e) {
+            Assume.assumeNoException(e);
+            return;
+        }
+
+        for (int i = 0; i < loops; i++) {
+            Measurement.start(eventSet);
+            Measurement.stop(eventSet);
+        }
+
+        List<long[]> data = Measurement.getResults(eventSet).getData();
+        Measurement.destroyEventSet(eventSet);
+
+        Assert.assertEquals(loops, data.size());
+        for (long[] row : data) {
+            Assert.assertTrue("wall clock time cannot be negative", row[0] >= 0);
+        }
+    }
+
+    @Test
+    public void fullEventSetOverwritesLastMeasurement() {
+        final int loops = 3;
+        final int eventSet = Measurement.createEventSet(1, new String[] { "SYS:wallclock-time" });
+        for (int i = 0; i < loops; i++) {
+            Measurement.start(eventSet);
+            Measurement.stop(eventSet);
+        }
+
+        List<long[]> data = Measurement.getResults(eventSet).getData();
+        long dropped = Measurement.getDroppedRecordCount(eventSet);
+        Measurement.reset(eventSet);
+        long droppedAfterReset = Measurement.getDroppedRecordCount(eventSet);
+        Measurement.destroyEventSet(eventSet);
+
+        Assert.assertEquals(1, data.size());
+        Assert.assertEquals(2 * (loops - 1), dropped);
+        Assert.assertEquals(0, droppedAfterReset);
+    }
+
+    @Test
+    public void sharedEventSetPairsMeasurementsOfEachThread() throws InterruptedException {
+        final int threadCount = 4;
+        final int loops = 100;
+        final int eventSet = Measurement.createEventSet(threadCount * loops,
+            new String[] { "SYS:wallclock-time" });
+
+        Thread[] threads = new Thread[threadCount];
+        for (int t = 0; t < threadCount; t++) {
+            threads[t] = new Thread(() -> {
+                for (int i = 0; i < loops; i++) {
+                    Measurement.start(eventSet);
+                    Measurement.stop(eventSet);
+                }
+            });
+            threads[t].start();
+        }
+        for (Thread thread : threads) {
+            thread.join();
+        }
+
+        List<long[]> data = Measurement.getResults(eventSet).getData();
+        List<long[]> rawData = Measurement.getRawResults(eventSet).getData();
+        Measurement.destroyEventSet(eventSet);
+
+        Assert.assertEquals(threadCount * loops, data.size());
+        Assert.assertEquals(2 * threadCount * loops, rawData.size());
+        for (long[] row : data) {
+            Assert.assertTrue("wall clock time cannot be negative", row[0] >= 0);
+        }
+    }
+
+    @Test
+    public void perThreadEventSetMergesBuffersOfAllThreads() throws InterruptedException {
+        final int threadCount = 4;
+        final int loops = 100;
+        final int eventSet = Measurement.createEventSet(loops,
+            new String[] { "SYS:wallclock-time" }, Measurement.PER_THREAD_BUFFERS);
+
+        Thread[] threads = new Thread[threadCount];
+        for (int t = 0; t < threadCount; t++) {
+            threads[t] = new Thread(() -> {
+                for (int i = 0; i < loops; i++) {
+                    Measurement.start(eventSet);
+                    Measurement.stop(eventSet);
+                }
+            });
+            threads[t].start();
+        }
+        for (Thread thread : threads) {
+            thread.join();
+        }
+
+        BenchmarkResults results = Measurement.getResults(eventSet);
+        Measurement.destroyEventSet(eventSet);
+
+        String[] names = results.getEventNames();
+        Assert.assertEquals("THREAD", names[names.length - 1]);
+
+        List<long[]> data = results.getData();
+        Assert.assertEquals(threadCount * loops, data.size());
+        Set<Long> recordingThreads = new HashSet<>();
+        for (long[] row : data) {
+            Assert.assertTrue("wall clock time cannot be negative", row[0] >= 0);
+            recordingThreads.add(row[1]);
+        }
+        Assert.assertEquals(threadCount, recordingThreads.size());
+    }
+
+    @Test
+    public void eventSetGroupMeasuresAllItsEventSets() {
+        final int loops = 10;
+        final String[] events = { "SYS:wallclock-time" };
+        final int first = Measurement.createEventSet(2 * loops, events);
+        final int second = Measurement.createEventSet(2 * loops, events);
+        final int group = Measurement.createEventSetGroup(first, second);
+
+        for (int i = 0; i < loops; i++) {
+            Measurement.startGroup(group);
+            Measurement.sampleGroup(i + 1, group);
+            Measurement.stopGroup(group);
+        }
+        Measurement.destroyEventSetGroup(group);
+
+        List<long[]> firstData = Measurement.getResults(first).getData();
+        List<long[]> secondData = Measurement.getRawResults(second).getData();
+        Measurement.destroyEventSet(first);
+        Measurement.destroyEventSet(second);
+
+        Assert.assertEquals(loops, firstData.size());
+        Assert.assertEquals(3 * loops, secondData.size());
+    }
+
+    @Test(expected = MeasurementException.class)
+    public void groupWithReusedEventSetIsInvalid() {
+        final String[] events = { "SYS:wallclock-time" };
+        final int eventSet = Measurement.createEventSet(2, events);
+        final int group = Measurement.createEventSetGroup(eventSet);
+        Measurement.destroyEventSet(eventSet);
+
+        // The new event set takes the slot of the destroyed one.
+        final int reused = Measurement.createEventSet(2, events);
+        try {
+            Measurement.startGroup(group);
+        } finally {
+            Measurement.destroyEventSetGroup(group);
+            Measurement.destroyEventSet(reused);
+        }
+    }
+
+    @Test
+    public void summaryEventSetKeepsRunningStatistics() {
+        final int loops = 1000;
+        final int eventSet = Measurement.createEventSet(1,
+            new String[] { "SYS:wallclock-time" }, Measurement.SUMMARY);
+        for (int i = 0; i < loops; i++) {
+            Measurement.start(eventSet);
+            Measurement.stop(eventSet);
+        }
+
+        BenchmarkSummary summary = Measurement.getSummary(eventSet);
+        Measurement.reset(eventSet);
+        BenchmarkSummary afterReset = Measurement.getSummary(eventSet);
+        Measurement.destroyEventSet(eventSet);
+
+        Assert.assertEquals(loops, summary.getCount(0));
+        Assert.assertEquals(0, summary.getFailedCount(0));
+        Assert.assertTrue("minimum cannot exceed mean", summary.getMin(0) <= summary.getMean(0));
+        Assert.assertTrue("mean cannot exceed maximum", summary.getMean(0) <= summary.getMax(0));
+        Assert.assertTrue("variance cannot be negative", summary.getVariance(0) >= 0);
+        Assert.assertEquals(0, afterReset.getCount(0));
+    }
+
+    @Test
+    public void histogramEventSetRecordsAllMeasurements() {
+        final int loops = 1000;
+        final int eventSet = Measurement.createEventSet(1,
+            new String[] { "SYS:wallclock-time" }, Measurement.HISTOGRAM);
+        for (int i = 0; i < loops; i++) {
+            Measurement.start(eventSet);
+            Measurement.stop(eventSet);
+        }
+
+        LatencyHistogram histogram = Measurement.getHistogram(eventSet, 0);
+        BenchmarkSummary summary = Measurement.getSummary(eventSet);
+        Measurement.destroyEventSet(eventSet);
+
+        Assert.assertEquals(loops, histogram.getTotalCount());
+        Assert.assertEquals(loops, summary.getCount(0));
+        Assert.assertTrue("median cannot exceed p99",
+            histogram.getValueAtPercentile(50) <= histogram.getValueAtPercentile(99));
+        Assert.assertTrue("maximum must be within histogram precision",
+            histogram.getMaxValue() >= summary.getMax(0));
+    }
+
+    @Test(expected = MeasurementException.class)
+    public void startOfInvalidEventSetThrows() {
+        Measurement.start(-1);
+    }
+
+    @Test
+    public void columnsOfResultsMatchRows() {
+        final int loops = 10;
+        final int eventSet = Measurement.createEventSet(loops,
+            new String[] { "SYS:wallclock-time", "JVM:compilations" });
+        for (int i = 0; i < loops; i++) {
+            Measurement.start(eventSet);
+            Measurement.stop(eventSet);
+        }
+
+        BenchmarkResults results = Measurement.getRawResults(eventSet);
+        Measurement.destroyEventSet(eventSet);
+
+        List<long[]> data = results.getData();
+        Assert.assertEquals(2 * loops, data.size());
+        for (int column = 0; column < results.getEventNames().length; column++) {
+            long[] values = results.getColumn(column);
+            Assert.assertEquals(data.size(), values.length);
+            for (int row = 0; row < values.length; row++) {
+                Assert.assertEquals(data.get(row)[column], values[row]);
+            }
+        }
+    }
 }
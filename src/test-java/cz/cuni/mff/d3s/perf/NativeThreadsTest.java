@@ -73,4 +73,52 @@ public class NativeThreadsTest {
         // Try re-registering the worker thread instead.
         Assert.assertFalse(NativeThreads.registerJavaThread(thread, 0));
     }
+
+    @Test
+    public void registrationSurvivesThreadChurn() throws InterruptedException {
+        for (int round = 0; round < 20; round++) {
+            Thread[] threads = new Thread[50];
+            final boolean[] registered = new boolean[threads.length];
+            for (int i = 0; i < threads.length; i++) {
+                final int index = i;
+                threads[i] = new Thread(() -> {
+                    // Throws when the thread is not known.
+                    NativeThreads.getNativeId(Thread.currentThread());
+                    registered[index] = true;
+                });
+                threads[i].start();
+            }
+            for (Thread t : threads) {
+                t.join();
+            }
+            for (boolean r : registered) {
+                Assert.assertTrue(r);
+            }
+        }
+
+        // The long-running worker must still be known.
+        NativeThreads.getNativeId(thread);
+    }
+
+    @Test
+    public void listedThreadsIncludeJavaThreads() throws InterruptedException {
+        Assume.assumeTrue(System.getProperty("os.name", "").equals("Linux"));
+
+        long workerId = NativeThreads.getNativeId(thread);
+        NativeThreadInfo.Kind workerKind = null;
+        for (NativeThreadInfo info : NativeThreads.listThreads()) {
+            if (info.getNativeId() == workerId) {
+                workerKind = info.getKind();
+            }
+        }
+        Assert.assertEquals(NativeThreadInfo.Kind.JAVA, workerKind);
+
+        worker.terminate = true;
+        thread.join();
+
+        // The cached list must drop terminated threads.
+        for (NativeThreadInfo info : NativeThreads.listThreads()) {
+            Assert.assertNotEquals(workerId, info.getNativeId());
+        }
+    }
 }
@@ -16,6 +16,9 @@
  */
 package cz.cuni.mff.d3s.perf;
 
+import java.lang.reflect.Method;
+import java.util.List;
+
 import org.junit.*;
 
 public class ThreadTimeTest {
@@ -103,6 +106,40 @@ public class ThreadTimeTest {
         }
     }
 
+    private static Thread startVirtualThread(Runnable task) {
+        // Available since JDK 21 only.
+        try {
+            Method start = Thread.class.getMethod("startVirtualThread", Runnable.class);
+            return (Thread) start.invoke(null, task);
+        } catch (ReflectiveOperationException e) {
+            Assume.assumeNoException(e);
+            return null;
+        }
+    }
+
+    @Test
+    public void threadTimeOfVirtualThread() throws InterruptedException {
+        final int eventSet = Measurement.createEventSet(1, EVENTS_NO_RSUAGE);
+
+        // Sleeping unmounts the thread, it may continue on another carrier.
+        Thread thread = startVirtualThread(() -> {
+            Measurement.start(eventSet);
+            for (int i = 0; i < TEST_LENGTH_SEC / 2; i++) {
+                busyWait(1);
+                TestUtils.noThrowSleep(1000);
+            }
+            Measurement.stop(eventSet);
+        });
+        thread.join();
+
+        List<long[]> data = Measurement.getResults(eventSet).getData();
+        Measurement.destroyEventSet(eventSet);
+
+        double[] res = nanosToMillis(data.get(0));
+        Assert.assertEquals(TEST_LENGTH_SEC * 1000, res[0], DELTA_MILLIS);
+        Assert.assertEquals(TEST_LENGTH_SEC * 500, res[1], DELTA_MILLIS);
+    }
+
     // For debugging purposes, it is possible to run this directly.
     public static void main(String[] args) {
         int lengthSec = TEST_LENGTH_SEC;